@@ -4,67 +4,1335 @@
 #include <ctime>
 #include <iomanip>
 #include <limits> // for input validation
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
 
 using namespace std;
 
-// Component structure
-struct Component {
-    string name;
-    int quantity;
-    string status;
+// Component status, stored as one byte per component
+enum ComponentStatus : uint8_t {
+    STATUS_GOOD,
+    STATUS_BAD
+};
+
+const char* statusText(ComponentStatus status) {
+    return status == STATUS_BAD ? "Bad!" : "Good";
+}
+
+// Parse "Good" or "Bad!"; returns false for anything else
+bool parseStatus(const string& text, ComponentStatus& status) {
+    if (text == "Good") {
+        status = STATUS_GOOD;
+    } else if (text == "Bad!") {
+        status = STATUS_BAD;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Interned component names: every distinct name is stored once and
+// components refer to it by a 32-bit id
+class NameTable {
+private:
+    vector<string> names;
+    unordered_map<string, uint32_t> ids;
+    
+public:
+    uint32_t intern(const string& name) {
+        unordered_map<string, uint32_t>::iterator it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.push_back(name);
+        ids[name] = id;
+        return id;
+    }
+    
+    const string& name(uint32_t id) const {
+        return names[id];
+    }
+    
+    size_t size() const {
+        return names.size();
+    }
+};
+
+// Struct-of-arrays store for the components of every unit. Each component
+// is a row spread over parallel columns (unit, name id, quantity, status),
+// so a fleet-wide scan such as "all Bad! components" reads the one-byte
+// status column and touches the others only for the rows it reports.
+//
+// A unit may have any number of components. Its rows are chained in order
+// through the next/prev columns, starting at the unit's head row. Deleting
+// a component moves the last row into its place, so the columns never
+// have holes. Row numbers therefore change on delete; refer to components
+// by unit and position, not by row, across a delete.
+//
+// Names are stored without their "-<number>" suffix; the number is the
+// component's position in its unit and is added when displayed.
+//
+// The store also keeps running totals: components per status, per name
+// and status, and Bad! components per unit. Every change adjusts them by
+// one, so summaries of the whole lab are read, never counted.
+class ComponentStore {
+public:
+    static const uint32_t NONE = 0xFFFFFFFFu;
+    
+    uint32_t addUnit() {
+        unitHead.push_back(NONE);
+        unitTail.push_back(NONE);
+        unitSize.push_back(0);
+        unitBad.push_back(0);
+        return static_cast<uint32_t>(unitHead.size() - 1);
+    }
+    
+    uint32_t unitCount() const {
+        return static_cast<uint32_t>(unitHead.size());
+    }
+    
+    uint32_t componentCount(uint32_t unit) const {
+        return unitSize[unit];
+    }
+    
+    uint32_t rowCount() const {
+        return static_cast<uint32_t>(status.size());
+    }
+    
+    void reserve(size_t units, size_t components) {
+        unitHead.reserve(units);
+        unitTail.reserve(units);
+        unitSize.reserve(units);
+        unitBad.reserve(units);
+        unitOf.reserve(components);
+        nameOf.reserve(components);
+        quantity.reserve(components);
+        status.reserve(components);
+        next.reserve(components);
+        prev.reserve(components);
+    }
+    
+    // Appends a component to the unit and returns its row
+    uint32_t addComponent(uint32_t unit, const string& name, int count, ComponentStatus state) {
+        uint32_t row = rowCount();
+        unitOf.push_back(unit);
+        nameOf.push_back(names.intern(name));
+        quantity.push_back(count);
+        status.push_back(state);
+        next.push_back(NONE);
+        prev.push_back(unitTail[unit]);
+        if (unitTail[unit] == NONE) {
+            unitHead[unit] = row;
+        } else {
+            next[unitTail[unit]] = row;
+        }
+        unitTail[unit] = row;
+        unitSize[unit]++;
+        tally(row, 1);
+        return row;
+    }
+    
+    // First component row of the unit and the one after row, or NONE
+    uint32_t firstComponent(uint32_t unit) const {
+        return unitHead[unit];
+    }
+    
+    uint32_t nextComponent(uint32_t row) const {
+        return next[row];
+    }
+    
+    // Position of the row within its unit (0-based)
+    int indexOf(uint32_t row) const {
+        int index = 0;
+        while (prev[row] != NONE) {
+            row = prev[row];
+            index++;
+        }
+        return index;
+    }
+    
+    // Row of the unit's component at index (0-based), or NONE
+    uint32_t componentAt(uint32_t unit, int index) const {
+        if (index < 0 || static_cast<uint32_t>(index) >= unitSize[unit]) {
+            return NONE;
+        }
+        uint32_t row = unitHead[unit];
+        while (index-- > 0) {
+            row = next[row];
+        }
+        return row;
+    }
+    
+    void removeComponent(uint32_t row) {
+        uint32_t unit = unitOf[row];
+        tally(row, -1);
+        unlink(row);
+        unitSize[unit]--;
+        
+        // Move the last row into the hole
+        uint32_t last = rowCount() - 1;
+        if (row != last) {
+            unitOf[row] = unitOf[last];
+            nameOf[row] = nameOf[last];
+            quantity[row] = quantity[last];
+            status[row] = status[last];
+            next[row] = next[last];
+            prev[row] = prev[last];
+            relink(row);
+        }
+        unitOf.pop_back();
+        nameOf.pop_back();
+        quantity.pop_back();
+        status.pop_back();
+        next.pop_back();
+        prev.pop_back();
+    }
+    
+    uint32_t unitOfRow(uint32_t row) const {
+        return unitOf[row];
+    }
+    
+    const string& name(uint32_t row) const {
+        return names.name(nameOf[row]);
+    }
+    
+    uint32_t nameIdOf(uint32_t row) const {
+        return nameOf[row];
+    }
+    
+    int getQuantity(uint32_t row) const {
+        return quantity[row];
+    }
+    
+    ComponentStatus getStatus(uint32_t row) const {
+        return static_cast<ComponentStatus>(status[row]);
+    }
+    
+    void setName(uint32_t row, const string& name) {
+        tally(row, -1);
+        nameOf[row] = names.intern(name);
+        tally(row, 1);
+    }
+    
+    void setQuantity(uint32_t row, int count) {
+        quantity[row] = count;
+    }
+    
+    void setStatus(uint32_t row, ComponentStatus state) {
+        tally(row, -1);
+        status[row] = state;
+        tally(row, 1);
+    }
+    
+    // Calls visit(row) for every component with the given status, in row
+    // order; reads only the status column
+    template <typename Visit>
+    void forEachWithStatus(ComponentStatus state, Visit visit) const {
+        const uint8_t* column = status.data();
+        uint32_t rows = rowCount();
+        for (uint32_t row = 0; row < rows; row++) {
+            if (column[row] == state) {
+                visit(row);
+            }
+        }
+    }
+    
+    size_t countWithStatus(ComponentStatus state) const {
+        size_t count = 0;
+        const uint8_t* column = status.data();
+        uint32_t rows = rowCount();
+        for (uint32_t row = 0; row < rows; row++) {
+            count += column[row] == state;
+        }
+        return count;
+    }
+    
+    size_t distinctNames() const {
+        return names.size();
+    }
+    
+    // Running totals
+    size_t totalWithStatus(ComponentStatus state) const {
+        return statusTotal[state];
+    }
+    
+    // Components named names.name(nameId) with the given status
+    size_t totalWithName(uint32_t nameId, ComponentStatus state) const {
+        return nameId < nameTotal[state].size() ? nameTotal[state][nameId] : 0;
+    }
+    
+    const string& nameById(uint32_t nameId) const {
+        return names.name(nameId);
+    }
+    
+    uint32_t badInUnit(uint32_t unit) const {
+        return unitBad[unit];
+    }
+    
+    uint32_t unitsWithBad() const {
+        return unitsWithBadCount;
+    }
+    
+    // Bytes held by the columns
+    size_t memoryUsed() const {
+        return unitHead.capacity() * sizeof(uint32_t) * 4
+             + unitOf.capacity() * sizeof(uint32_t) + nameOf.capacity() * sizeof(uint32_t)
+             + quantity.capacity() * sizeof(int) + status.capacity()
+             + next.capacity() * sizeof(uint32_t) + prev.capacity() * sizeof(uint32_t);
+    }
+    
+private:
+    friend class InventoryDatabase;
+    
+    // Adds (delta 1) or takes away (delta -1) the row from the totals
+    void tally(uint32_t row, int delta) {
+        uint8_t state = status[row];
+        uint32_t nameId = nameOf[row];
+        statusTotal[state] += delta;
+        if (nameId >= nameTotal[state].size()) {
+            nameTotal[STATUS_GOOD].resize(names.size(), 0);
+            nameTotal[STATUS_BAD].resize(names.size(), 0);
+        }
+        nameTotal[state][nameId] += delta;
+        if (state == STATUS_BAD) {
+            uint32_t& bad = unitBad[unitOf[row]];
+            if (delta > 0 && bad++ == 0) {
+                unitsWithBadCount++;
+            } else if (delta < 0 && --bad == 0) {
+                unitsWithBadCount--;
+            }
+        }
+    }
+    
+    // Sets the totals from scratch, after the columns were filled directly
+    void recount() {
+        statusTotal[STATUS_GOOD] = statusTotal[STATUS_BAD] = 0;
+        nameTotal[STATUS_GOOD].assign(names.size(), 0);
+        nameTotal[STATUS_BAD].assign(names.size(), 0);
+        unitBad.assign(unitHead.size(), 0);
+        unitsWithBadCount = 0;
+        for (uint32_t row = 0; row < rowCount(); row++) {
+            tally(row, 1);
+        }
+    }
+    
+    void unlink(uint32_t row) {
+        uint32_t unit = unitOf[row];
+        if (prev[row] == NONE) {
+            unitHead[unit] = next[row];
+        } else {
+            next[prev[row]] = next[row];
+        }
+        if (next[row] == NONE) {
+            unitTail[unit] = prev[row];
+        } else {
+            prev[next[row]] = prev[row];
+        }
+    }
+    
+    // Points the neighbours and unit of a row that was just moved to "to"
+    // at its new place
+    void relink(uint32_t to) {
+        uint32_t unit = unitOf[to];
+        if (prev[to] == NONE) {
+            unitHead[unit] = to;
+        } else {
+            next[prev[to]] = to;
+        }
+        if (next[to] == NONE) {
+            unitTail[unit] = to;
+        } else {
+            prev[next[to]] = to;
+        }
+    }
+    
+    NameTable names;
+    
+    // Per unit
+    vector<uint32_t> unitHead;
+    vector<uint32_t> unitTail;
+    vector<uint32_t> unitSize;
+    
+    // Per component row
+    vector<uint32_t> unitOf;
+    vector<uint32_t> nameOf;
+    vector<int> quantity;
+    vector<uint8_t> status;
+    vector<uint32_t> next;
+    vector<uint32_t> prev;
+    
+    // Totals
+    size_t statusTotal[2] = {0, 0};
+    vector<uint32_t> nameTotal[2];     // by status, then name id
+    vector<uint32_t> unitBad;          // Bad! components in each unit
+    uint32_t unitsWithBadCount = 0;
+};
+
+const uint32_t ComponentStore::NONE;
+
+// CRC-32 (IEEE) of a block of bytes, to detect damaged files
+uint32_t crc32(const char* data, size_t size) {
+    // Built once, thread-safely, on first use
+    static const vector<uint32_t> table = []() {
+        vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Read-only view of a whole file, mapped into memory
+class MappedFile {
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    const char* bytes;
+    size_t length;
+    bool opened;
+    
+public:
+    explicit MappedFile(const string& path) : bytes(0), length(0), opened(false) {
+#ifdef _WIN32
+        mapping = NULL;
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+            return;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+        opened = true;
+        if (length == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        bytes = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : 0;
+        opened = bytes != 0;
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            return;
+        }
+        length = static_cast<size_t>(info.st_size);
+        opened = true;
+        if (length == 0) {
+            return;
+        }
+        void* address = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            opened = false;
+            return;
+        }
+        madvise(address, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(address);
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (bytes) {
+            UnmapViewOfFile(bytes);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (bytes) {
+            munmap(const_cast<char*>(bytes), length);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+    
+    bool isOpen() const {
+        return opened;
+    }
+    
+    const char* data() const {
+        return bytes;
+    }
+    
+    size_t size() const {
+        return length;
+    }
+    
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// Flushes a file and waits until it is on disk
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Cuts an open file back to size bytes and leaves it positioned at the end
+bool truncateFile(FILE* file, size_t size) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    bool ok = _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+    bool ok = ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+    return ok && fseek(file, 0, SEEK_END) == 0;
+}
+
+// Writes data to path + ".tmp", syncs it and renames it over path, so
+// path holds either the old or the new contents, never a mix
+bool replaceFile(const string& path, const char* data, size_t size) {
+    string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size && syncFile(file);
+    fclose(file);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+// Keeps a ComponentStore on disk as a snapshot file plus a journal of
+// changed units next to it (path + ".journal").
+//
+// The snapshot holds the name table and then the store column by column,
+// rows in unit order: component count per unit, name id, quantity and
+// status, with a CRC-32 at the end. load() maps it and copies each column
+// in one go, then replays the journal.
+//
+// Every add, edit or delete rewrites only the unit it changed: saveUnit()
+// appends one journal record with that unit's components (u32 length,
+// u32 CRC-32, then u32 unit, u32 count and per component u16 name length,
+// name, i32 quantity, u8 status) and syncs it. A record replaces the whole
+// unit, so replaying one twice is harmless. Once the journal outgrows a
+// quarter of the snapshot (and JOURNAL_LIMIT), checkpoint() writes a new
+// snapshot beside the old one, renames it into place and empties the
+// journal. Numbers are in host byte order.
+class InventoryDatabase {
+public:
+    static const size_t JOURNAL_LIMIT = 4 << 20;
+    
+    explicit InventoryDatabase(const string& path)
+        : path(path), journal(0), snapshotBytes(0), journalBytes(0), compactionFailed(false), tornJournal(false) {}
+        
+    ~InventoryDatabase() {
+        if (journal) {
+            fclose(journal);
+        }
+    }
+    
+    // Loads the saved inventory into an empty store. Returns 1 if it was
+    // loaded, 0 if there is none yet and -1 if the snapshot is damaged.
+    // A journal ending in a torn record is folded into a new snapshot, or
+    // if that fails, cut back to its whole records (see failedToCompact()).
+    int load(ComponentStore& store) {
+        {
+            MappedFile snapshot(path);
+            if (!snapshot.isOpen()) {
+                return 0;
+            }
+            if (!readSnapshot(snapshot.data(), snapshot.size(), store)) {
+                return -1;
+            }
+            snapshotBytes = snapshot.size();
+        }
+        
+        bool damaged = false;
+        {
+            MappedFile changes(path + ".journal");
+            size_t offset = 0;
+            while (offset < changes.size()) {
+                size_t next = replayRecord(changes.data(), changes.size(), offset, store);
+                if (next == 0) {
+                    damaged = true;
+                    break;
+                }
+                offset = next;
+            }
+            journalBytes = offset;
+        }
+        // Records appended after a torn one would never be replayed
+        compactionFailed = damaged && !checkpoint(store);
+        if (compactionFailed) {
+            tornJournal = !openJournal("r+b") || !truncateFile(journal, journalBytes);
+            if (tornJournal && journal) {
+                fclose(journal);
+                journal = 0;
+            }
+        } else if (!damaged) {
+            // saveUnit() opens it again if this fails
+            openJournal("ab");
+        }
+        return 1;
+    }
+    
+    // Whether load() found a torn journal record and could not write a
+    // new snapshot; the data loaded, but the journal was cut back instead
+    bool failedToCompact() const {
+        return compactionFailed;
+    }
+    
+    // Records the current components of the unit
+    bool saveUnit(const ComponentStore& store, uint32_t unit) {
+        if (!journal && (tornJournal || !openJournal("ab"))) {
+            return false;
+        }
+        vector<char> record(8);
+        putValue(record, unit);
+        putValue(record, store.unitSize[unit]);
+        for (uint32_t row = store.unitHead[unit]; row != ComponentStore::NONE; row = store.next[row]) {
+            const string& name = store.name(row);
+            putValue(record, static_cast<uint16_t>(name.size()));
+            record.insert(record.end(), name.begin(), name.end());
+            putValue(record, static_cast<int32_t>(store.quantity[row]));
+            putValue(record, store.status[row]);
+        }
+        uint32_t length = static_cast<uint32_t>(record.size() - 8);
+        uint32_t checksum = crc32(record.data() + 8, length);
+        memcpy(record.data(), &length, 4);
+        memcpy(record.data() + 4, &checksum, 4);
+        if (fwrite(record.data(), 1, record.size(), journal) != record.size() || !syncFile(journal)) {
+            return false;
+        }
+        journalBytes += record.size();
+        if (journalBytes > JOURNAL_LIMIT && journalBytes > snapshotBytes / 4) {
+            return checkpoint(store);
+        }
+        return true;
+    }
+    
+    // Writes the whole store as the new snapshot and empties the journal
+    bool checkpoint(const ComponentStore& store) {
+        vector<char> image;
+        writeSnapshot(store, image);
+        if (!replaceFile(path, image.data(), image.size())) {
+            return false;
+        }
+        snapshotBytes = image.size();
+        journalBytes = 0;
+        tornJournal = false;
+        return openJournal("wb") && syncFile(journal);
+    }
+    
+    size_t journalSize() const {
+        return journalBytes;
+    }
+    
+    size_t snapshotSize() const {
+        return snapshotBytes;
+    }
+    
+private:
+    static const size_t HEADER_SIZE = 8 + 4 * 4;
+    
+    template <typename T>
+    static void putValue(vector<char>& out, T value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+    
+    template <typename T>
+    static T getValue(const char*& in) {
+        T value;
+        memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+    
+    template <typename T>
+    static void putColumn(vector<char>& out, const vector<T>& column) {
+        const char* bytes = reinterpret_cast<const char*>(column.data());
+        out.insert(out.end(), bytes, bytes + column.size() * sizeof(T));
+    }
+    
+    template <typename T>
+    static void getColumn(const char*& in, vector<T>& column, size_t count) {
+        column.resize(count);
+        if (count > 0) {
+            memcpy(&column[0], in, count * sizeof(T));
+        }
+        in += count * sizeof(T);
+    }
+    
+    bool openJournal(const char* mode) {
+        if (journal) {
+            fclose(journal);
+        }
+        journal = fopen((path + ".journal").c_str(), mode);
+        return journal != 0;
+    }
+    
+    static void writeSnapshot(const ComponentStore& store, vector<char>& image) {
+        uint32_t units = store.unitCount();
+        uint32_t rows = store.rowCount();
+        uint32_t names = static_cast<uint32_t>(store.names.size());
+        image.insert(image.end(), MAGIC, MAGIC + 8);
+        putValue(image, units);
+        putValue(image, rows);
+        putValue(image, names);
+        putValue(image, static_cast<uint32_t>(0));
+        for (uint32_t id = 0; id < names; id++) {
+            const string& name = store.names.name(id);
+            putValue(image, static_cast<uint32_t>(name.size()));
+            image.insert(image.end(), name.begin(), name.end());
+        }
+        putColumn(image, store.unitSize);
+        
+        // Rows in unit order, so loading rebuilds the chains by counting
+        vector<uint32_t> nameOf;
+        vector<int32_t> quantity;
+        vector<uint8_t> status;
+        nameOf.reserve(rows);
+        quantity.reserve(rows);
+        status.reserve(rows);
+        for (uint32_t unit = 0; unit < units; unit++) {
+            for (uint32_t row = store.unitHead[unit]; row != ComponentStore::NONE; row = store.next[row]) {
+                nameOf.push_back(store.nameOf[row]);
+                quantity.push_back(store.quantity[row]);
+                status.push_back(store.status[row]);
+            }
+        }
+        putColumn(image, nameOf);
+        putColumn(image, quantity);
+        putColumn(image, status);
+        putValue(image, crc32(image.data(), image.size()));
+    }
+    
+    static bool readSnapshot(const char* data, size_t size, ComponentStore& store) {
+        if (size < HEADER_SIZE + 4 || memcmp(data, MAGIC, 8) != 0) {
+            return false;
+        }
+        const char* trailer = data + size - 4;
+        if (crc32(data, size - 4) != getValue<uint32_t>(trailer)) {
+            return false;
+        }
+        const char* in = data + 8;
+        const char* end = data + size - 4;
+        uint32_t units = getValue<uint32_t>(in);
+        uint32_t rows = getValue<uint32_t>(in);
+        uint32_t names = getValue<uint32_t>(in);
+        in += 4;
+        for (uint32_t id = 0; id < names; id++) {
+            if (end - in < 4) {
+                return false;
+            }
+            uint32_t length = getValue<uint32_t>(in);
+            if (static_cast<size_t>(end - in) < length) {
+                return false;
+            }
+            store.names.intern(string(in, length));
+            in += length;
+        }
+        if (static_cast<size_t>(end - in) != units * 4ull + rows * 9ull) {
+            return false;
+        }
+        getColumn(in, store.unitSize, units);
+        getColumn(in, store.nameOf, rows);
+        getColumn(in, store.quantity, rows);
+        getColumn(in, store.status, rows);
+        
+        store.unitHead.assign(units, ComponentStore::NONE);
+        store.unitTail.assign(units, ComponentStore::NONE);
+        store.unitOf.resize(rows);
+        store.next.resize(rows);
+        store.prev.resize(rows);
+        uint32_t row = 0;
+        for (uint32_t unit = 0; unit < units; unit++) {
+            uint32_t count = store.unitSize[unit];
+            if (count > rows - row) {
+                return false;
+            }
+            if (count > 0) {
+                store.unitHead[unit] = row;
+                store.unitTail[unit] = row + count - 1;
+            }
+            for (uint32_t i = 0; i < count; i++, row++) {
+                store.unitOf[row] = unit;
+                store.prev[row] = i == 0 ? ComponentStore::NONE : row - 1;
+                store.next[row] = i + 1 == count ? ComponentStore::NONE : row + 1;
+            }
+        }
+        for (uint32_t i = 0; i < rows; i++) {
+            if (store.nameOf[i] >= names || store.status[i] > STATUS_BAD) {
+                return false;
+            }
+        }
+        if (row != rows) {
+            return false;
+        }
+        store.recount();
+        return true;
+    }
+    
+    // Applies the journal record at offset and returns the offset after
+    // it, or 0 if it is torn or damaged
+    static size_t replayRecord(const char* data, size_t size, size_t offset, ComponentStore& store) {
+        if (size - offset < 16) {
+            return 0;
+        }
+        const char* in = data + offset;
+        uint32_t length = getValue<uint32_t>(in);
+        uint32_t checksum = getValue<uint32_t>(in);
+        if (size - offset - 8 < length || length < 8 || crc32(in, length) != checksum) {
+            return 0;
+        }
+        const char* end = in + length;
+        uint32_t unit = getValue<uint32_t>(in);
+        uint32_t count = getValue<uint32_t>(in);
+        while (store.unitCount() <= unit) {
+            store.addUnit();
+        }
+        while (store.unitHead[unit] != ComponentStore::NONE) {
+            store.removeComponent(store.unitHead[unit]);
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (end - in < 2) {
+                return 0;
+            }
+            uint16_t nameLength = getValue<uint16_t>(in);
+            if (static_cast<size_t>(end - in) < nameLength + 5u) {
+                return 0;
+            }
+            string name(in, nameLength);
+            in += nameLength;
+            int32_t quantity = getValue<int32_t>(in);
+            uint8_t status = getValue<uint8_t>(in);
+            store.addComponent(unit, name, quantity, status == STATUS_BAD ? STATUS_BAD : STATUS_GOOD);
+        }
+        return in == end ? offset + 8 + length : 0;
+    }
+    
+    static const char MAGIC[8];
+    
+    string path;
+    FILE* journal;
+    size_t snapshotBytes;
+    size_t journalBytes;
+    bool compactionFailed;
+    bool tornJournal;      // still ends in a torn record, so nothing may be appended
+};
+
+const char InventoryDatabase::MAGIC[8] = {'L', 'A', 'B', 'I', 'N', 'V', '0', '1'};
+const size_t InventoryDatabase::JOURNAL_LIMIT;
+const size_t InventoryDatabase::HEADER_SIZE;
+
+// A fixed set of worker threads for splitting work over partitions.
+// parallelFor() hands out indexes one at a time from a shared counter, so
+// a thread that finishes a small lab early picks up the next one instead
+// of waiting; the calling thread works too.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads) : stopping(false), generation(0), task(0), count(0), busy(0) {
+        for (unsigned i = 1; i < threads; i++) {
+            workers.push_back(thread(&ThreadPool::work, this));
+        }
+    }
+    
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+    
+    unsigned size() const {
+        return static_cast<unsigned>(workers.size() + 1);
+    }
+    
+    // Runs job(i) for every i in [0, total) and returns when all are done
+    void parallelFor(size_t total, const function<void(size_t)>& job) {
+        {
+            lock_guard<mutex> lock(guard);
+            task = &job;
+            count = total;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        run();
+        unique_lock<mutex> lock(guard);
+        done.wait(lock, [this] { return busy == 0; });
+        task = 0;
+    }
+    
+private:
+    void run() {
+        for (size_t i = next++; i < count; i = next++) {
+            (*task)(i);
+        }
+    }
+    
+    void work() {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> lock(guard);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            run();
+            lock_guard<mutex> lock(guard);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+    
+    vector<thread> workers;
+    mutex guard;
+    condition_variable wake;
+    condition_variable done;
+    bool stopping;
+    unsigned long generation;
+    const function<void(size_t)>* task;
+    size_t count;
+    atomic<size_t> next;
+    size_t busy;
+};
+
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
+// Draws the program's screens in the terminal without starting a shell.
+// While installed, everything written to cout goes into the current frame
+// instead of straight to the terminal, and clear() starts a new frame at
+// the top of the screen. Just before the program waits for input, the
+// frame is compared row by row with what the terminal shows, and only the
+// changed cells are written, with ANSI escapes, in a single write. What
+// the terminal echoes while the user types is added to the frame as well,
+// so the two stay in step.
+//
+// A frame taller than the terminal is shown scrolled to its end, as if it
+// had been written out in full, with the rows above the screen in the
+// terminal's scrollback. Those rows cannot be redrawn, so when a new frame
+// has the same rows above the screen, only the screen's rows are compared;
+// otherwise the whole frame is written out again. When cout is not a
+// terminal, frames are written out as plain text.
+class Screen {
+public:
+    Screen() : output(*this), input(*this), savedOut(0), savedIn(0), terminal(false), echoes(false),
+               simulated(false), streaming(false), wipe(true), sent(0), width(80), height(24),
+               shownWidth(80), shownHeight(24) {}
+               
+    ~Screen() {
+        uninstall();
+    }
+    
+    // Takes over cout and cin
+    void install() {
+#ifdef _WIN32
+        DWORD mode;
+        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+        terminal = GetConsoleMode(console, &mode)
+            && SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        echoes = terminal && GetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), &mode);
+#else
+        terminal = isatty(STDOUT_FILENO);
+        echoes = terminal && isatty(STDIN_FILENO);
+#endif
+        if (terminal) {
+            measure();
+        }
+        savedOut = cout.rdbuf(&output);
+        savedIn = cin.rdbuf(&input);
+    }
+    
+    // Writes what is left of the frame and gives cout and cin back
+    void uninstall() {
+        if (savedOut) {
+            present();
+            cout.rdbuf(savedOut);
+            cin.rdbuf(savedIn);
+            savedOut = 0;
+        }
+    }
+    
+    // Starts a new frame at the top of the screen
+    void clear() {
+        frame.clear();
+        sent = 0;
+        streaming = false;
+    }
+    
+    // Brings the terminal up to date with the frame
+    void present() {
+        string out;
+        if (terminal && !simulated) {
+            measure();
+        }
+        render(out);
+        writeOut(out.data(), out.size());
+    }
+    
+    // The escapes and text that bring the terminal up to date, which from
+    // then on is assumed to show the frame
+    void render(string& out) {
+        if (!terminal) {
+            out.append(frame, sent, string::npos);
+            sent = frame.size();
+            return;
+        }
+        splitRows(frame, rows);
+        size_t top = rows.size() > height ? rows.size() - height : 0;
+        // The terminal shows this frame up to sent, with the cursor at its
+        // end, so the rest can be written after it and scroll the screen
+        if (streaming || (top > 0 && sent > 0)) {
+            out.append(frame, sent, string::npos);
+            keep(rows);
+            return;
+        }
+        // Only the rows on the screen can be redrawn
+        bool sameAbove = top == 0 || (scrolled.size() == top && equal(scrolled.begin(), scrolled.end(), rows.begin()));
+        if (wipe || !sameAbove) {
+            rewrite(out, rows);
+            return;
+        }
+        size_t start = out.size();
+        for (size_t row = 0; row < max(rows.size() - top, shown.size()); row++) {
+            const string& now = top + row < rows.size() ? rows[top + row] : empty;
+            const string& before = row < shown.size() ? shown[row] : empty;
+            if (now == before) {
+                continue;
+            }
+            // The changed span: from the first differing cell, and to the
+            // last one when the row keeps its length
+            size_t first = 0;
+            while (first < now.size() && first < before.size() && now[first] == before[first]) {
+                first++;
+            }
+            size_t end = now.size();
+            if (now.size() == before.size()) {
+                while (end > first && now[end - 1] == before[end - 1]) {
+                    end--;
+                }
+            }
+            moveTo(out, row, first);
+            out.append(now, first, end - first);
+            if (now.size() < before.size()) {
+                out += "\x1b[K";
+            }
+        }
+        moveTo(out, rows.size() - top - 1, rows.back().size());
+        if (out.size() - start > frame.size() + 7) {
+            out.resize(start);
+            rewrite(out, rows);
+            return;
+        }
+        streaming = top > 0;
+        keep(rows);
+    }
+    
+    // For the benchmark: act as a terminal of the given size, without
+    // writing anything to it
+    void simulate(size_t columns, size_t lines) {
+        terminal = true;
+        simulated = true;
+        width = columns;
+        height = lines;
+    }
+    
+    streambuf* buffer() {
+        return &output;
+    }
+    
+    // Rows the terminal shows, or 0 when cout is not a terminal
+    size_t lines() const {
+        return terminal ? height : 0;
+    }
+    
+private:
+    // Collects what is written to cout into the frame. Flushes (endl) do
+    // nothing; the frame goes out when input is read.
+    class Output : public streambuf {
+    public:
+        explicit Output(Screen& screen) : screen(screen) {}
+        
+    protected:
+        int_type overflow(int_type c) {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                screen.frame += traits_type::to_char_type(c);
+            }
+            return traits_type::not_eof(c);
+        }
+        
+        streamsize xsputn(const char* text, streamsize count) {
+            screen.frame.append(text, static_cast<size_t>(count));
+            return count;
+        }
+        
+    private:
+        Screen& screen;
+    };
+    
+    // Reads stdin for cin, presenting the frame before it waits
+    class Input : public streambuf {
+    public:
+        explicit Input(Screen& screen) : screen(screen) {}
+        
+    protected:
+        int_type underflow() {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            screen.present();
+#ifdef _WIN32
+            int count = _read(0, buffer, sizeof(buffer));
+#else
+            ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+#endif
+            if (count <= 0) {
+                return traits_type::eof();
+            }
+            if (screen.echoes) {
+                screen.echoed(buffer, static_cast<size_t>(count));
+            }
+            setg(buffer, buffer, buffer + count);
+            return traits_type::to_int_type(*gptr());
+        }
+        
+    private:
+        Screen& screen;
+        char buffer[4096];
+    };
+    
+    // The terminal echoed what the user typed at the end of the frame
+    void echoed(const char* text, size_t count) {
+        frame.append(text, count);
+        splitRows(frame, rows);
+        keep(rows);
+    }
+    
+    // Clears the terminal and writes the whole frame
+    void rewrite(string& out, const vector<string>& frameRows) {
+        out += "\x1b[H\x1b[2J";
+        out.append(frame);
+        wipe = false;
+        streaming = frameRows.size() > height;
+        keep(frameRows);
+    }
+    
+    // The terminal now holds all of the frame: its last rows on the screen
+    // and any above them scrolled off
+    void keep(const vector<string>& frameRows) {
+        size_t top = frameRows.size() > height ? frameRows.size() - height : 0;
+        scrolled.assign(frameRows.begin(), frameRows.begin() + top);
+        shown.assign(frameRows.begin() + top, frameRows.end());
+        sent = frame.size();
+    }
+    
+    // Screen rows of the text: lines, wrapped at the terminal width
+    void splitRows(const string& text, vector<string>& out) const {
+        size_t count = 0;
+        size_t start = 0;
+        while (true) {
+            size_t newline = text.find('\n', start);
+            size_t lineEnd = newline == string::npos ? text.size() : newline;
+            do {
+                size_t take = min(width, lineEnd - start);
+                if (count == out.size()) {
+                    out.push_back(string());
+                }
+                out[count++].assign(text, start, take);
+                start += take;
+            } while (start < lineEnd);
+            if (newline == string::npos) {
+                break;
+            }
+            start = newline + 1;
+        }
+        out.resize(count);
+    }
+    
+    static void moveTo(string& out, size_t row, size_t column) {
+        out += "\x1b[" + to_string(row + 1) + ";" + to_string(column + 1) + "H";
+    }
+    
+    void measure() {
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+            width = info.srWindow.Right - info.srWindow.Left + 1;
+            height = info.srWindow.Bottom - info.srWindow.Top + 1;
+        }
+#else
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            width = size.ws_col;
+            height = size.ws_row;
+        }
+#endif
+        // A resized terminal rewraps and scrolls what it shows
+        if (width != shownWidth || height != shownHeight) {
+            wipe = true;
+            shownWidth = width;
+            shownHeight = height;
+        }
+    }
+    
+    void writeOut(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int written = _write(1, data, static_cast<unsigned>(size));
+#else
+            ssize_t written = write(STDOUT_FILENO, data, size);
+#endif
+            if (written <= 0) {
+                return;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+    
+    Output output;
+    Input input;
+    streambuf* savedOut;
+    streambuf* savedIn;
+    bool terminal;      // cout is a terminal that understands ANSI escapes
+    bool echoes;        // and cin is that terminal, echoing what is typed
+    bool simulated;
+    bool streaming;     // the frame is taller than the screen and goes out as it grows
+    bool wipe;          // the terminal's contents are unknown
+    string frame;
+    size_t sent;        // bytes of the frame already written or echoed
+    vector<string> rows;
+    vector<string> shown;      // the rows on the screen
+    vector<string> scrolled;   // and the frame's rows above them, in the scrollback
+    const string empty;
+    size_t width;
+    size_t height;
+    size_t shownWidth;
+    size_t shownHeight;
 };
 
-// Unit class to manage components
+Screen screen;
+
+// Generate random status
+ComponentStatus randomStatus() {
+    return (rand() % 5 == 0) ? STATUS_BAD : STATUS_GOOD;
+}
+
+// Unit class to manage components: a view of one unit in the store
 class Unit {
 private:
-    static const int MAX_COMPONENTS = 7;
-    Component components[MAX_COMPONENTS];
-    int numComponents;
-
+    ComponentStore& store;
+    uint32_t id;
+    
 public:
-    // Constructor
-    Unit() {
-        numComponents = 5;  // Start with 5 default components
-        
-        // Initialize default components with numbers
-        components[0] = {"Mouse-1", 1, randomStatus()};
-        components[1] = {"Keyboard-2", 1, randomStatus()};
-        components[2] = {"AVR-3", 1, randomStatus()};
-        components[3] = {"HDMI-4", 1, randomStatus()};
-        components[4] = {"System Unit-5", 1, randomStatus()};
+    Unit(ComponentStore& store, uint32_t id) : store(store), id(id) {}
+    
+    // Add a unit with the 5 default components
+    static uint32_t create(ComponentStore& store) {
+        uint32_t id = store.addUnit();
+        store.addComponent(id, "Mouse", 1, randomStatus());
+        store.addComponent(id, "Keyboard", 1, randomStatus());
+        store.addComponent(id, "AVR", 1, randomStatus());
+        store.addComponent(id, "HDMI", 1, randomStatus());
+        store.addComponent(id, "System Unit", 1, randomStatus());
+        return id;
+    }
+    
+    // Display name with the component number, e.g. "Mouse-1"
+    string componentName(int index) const {
+        return store.name(store.componentAt(id, index)) + "-" + to_string(index + 1);
     }
     
-    // Generate random status
-    string randomStatus() {
-        return (rand() % 5 == 0) ? "Bad!" : "Good";
+    int componentCount() const {
+        return static_cast<int>(store.componentCount(id));
     }
     
     // Display components of this unit
-    void displayComponents(int unitNo) {
+    void displayComponents(int unitNo, const string& labName) {
         cout << "\n---------------- UNIT " << unitNo << " ----------------\n";
-        cout << "COMPUTER LAB 01\n";
+        cout << labName << "\n";
         cout << "----------------------------------------\n";
         cout << left << setw(20) << "COMPONENT NAME" << setw(15) << "QUANTITY" << "STATUS\n";
         cout << "----------------------------------------\n";
         
-        for (int i = 0; i < numComponents; i++) {
-            cout << left << setw(20) << components[i].name 
-                 << setw(15) << components[i].quantity 
-                 << components[i].status << endl;
+        int index = 1;
+        for (uint32_t row = store.firstComponent(id); row != ComponentStore::NONE; row = store.nextComponent(row)) {
+            cout << left << setw(20) << store.name(row) + "-" + to_string(index++)
+                 << setw(15) << store.getQuantity(row)
+                 << statusText(store.getStatus(row)) << endl;
         }
         cout << "----------------------------------------\n";
     }
     
     // Add a new component
-    void addComponent() {
-        if (numComponents >= MAX_COMPONENTS) {
-            cout << "Cannot add more components. Maximum limit reached.\n";
-            return;
-        }
-        
+    bool addComponent() {
         string name;
         int quantity;
-        string status;
+        string statusInput;
+        ComponentStatus status;
         
         clearScreen();
         cout << "\n----- ADD NEW COMPONENT -----\n";
@@ -72,9 +1340,6 @@ public:
         cout << "Enter component name: ";
         cin >> name;
         
-        // Add number to component name
-        name = name + "-" + to_string(numComponents + 1);
-        
         cout << "Enter quantity: ";
         cin >> quantity;
         while (cin.fail() || quantity <= 0) {
@@ -85,34 +1350,36 @@ public:
         }
         
         cout << "Enter status (Good or Bad!): ";
-        cin >> status;
-        while (status != "Good" && status != "Bad!") {
+        cin >> statusInput;
+        while (!parseStatus(statusInput, status)) {
             cout << "Invalid status. Enter 'Good' or 'Bad!': ";
-            cin >> status;
+            cin >> statusInput;
         }
         
-        components[numComponents] = {name, quantity, status};
-        numComponents++;
+        // The number is added from the component's position when displayed
+        store.addComponent(id, name, quantity, status);
         
         cout << "\nComponent added successfully!\n";
+        return true;
     }
     
     // Edit an existing component
-    void editComponent(int index) {
-        if (index < 0 || index >= numComponents) {
+    bool editComponent(int index) {
+        uint32_t row = store.componentAt(id, index);
+        if (row == ComponentStore::NONE) {
             cout << "Invalid component selection.\n";
-            return;
+            return false;
         }
         
-        string name, status;
+        string name, statusInput;
         int quantity;
-        string componentNumber = components[index].name.substr(components[index].name.find("-"));
+        ComponentStatus status;
         
         clearScreen();
         cout << "\n----- EDIT COMPONENT -----\n";
-        cout << "Current component: " << components[index].name << endl;
-        cout << "Current quantity: " << components[index].quantity << endl;
-        cout << "Current status: " << components[index].status << endl;
+        cout << "Current component: " << componentName(index) << endl;
+        cout << "Current quantity: " << store.getQuantity(row) << endl;
+        cout << "Current status: " << statusText(store.getStatus(row)) << endl;
         cout << "----------------------------\n";
         
         cout << "Enter new name (or press Enter to keep current): ";
@@ -120,82 +1387,332 @@ public:
         getline(cin, name);
         
         if (!name.empty()) {
-            // Preserve the component number
-            components[index].name = name + componentNumber;
+            // The component number is kept, as it comes from the position
+            store.setName(row, name);
         }
         
         cout << "Enter new quantity (or 0 to keep current): ";
         cin >> quantity;
         if (quantity > 0) {
-            components[index].quantity = quantity;
+            store.setQuantity(row, quantity);
         }
         
         cout << "Enter new status (Good or Bad!): ";
-        cin >> status;
-        if (status == "Good" || status == "Bad!") {
-            components[index].status = status;
+        cin >> statusInput;
+        if (parseStatus(statusInput, status)) {
+            store.setStatus(row, status);
         }
         
         cout << "\nComponent updated successfully!\n";
+        return true;
     }
     
     // Delete a component
-    void deleteComponent(int index) {
-        if (index < 0 || index >= numComponents) {
+    bool deleteComponent(int index) {
+        uint32_t row = store.componentAt(id, index);
+        if (row == ComponentStore::NONE) {
             cout << "Invalid component selection.\n";
-            return;
-        }
-        
-        // Shift components to fill the gap
-        for (int i = index; i < numComponents - 1; i++) {
-            components[i] = components[i + 1];
-            
-            // Update the component number in the name
-            size_t pos = components[i].name.find("-");
-            if (pos != string::npos) {
-                string baseName = components[i].name.substr(0, pos);
-                components[i].name = baseName + "-" + to_string(i + 1);
-            }
+            return false;
         }
         
-        numComponents--;
+        // Later components move up a number by themselves
+        store.removeComponent(row);
         cout << "\nComponent deleted successfully!\n";
+        return true;
     }
     
-    // Get the status of the first component (for display all units)
+    // Bad! if any component is Bad! (for display all units)
     string getMainStatus() const {
-        if (numComponents > 0) {
-            return components[0].status;
+        if (componentCount() == 0) {
+            return "Unknown";
         }
-        return "Unknown";
+        return statusText(store.badInUnit(id) > 0 ? STATUS_BAD : STATUS_GOOD);
+    }
+    
+    int badCount() const {
+        return static_cast<int>(store.badInUnit(id));
     }
     
 private:
-    // Helper function to clear screen (platform-independent)
+    // Helper function to clear screen
     void clearScreen() {
-        #ifdef _WIN32
-            system("cls");
-        #else
-            system("clear");
-        #endif
+        screen.clear();
     }
 };
 
 // Helper function to clear screen
 void clearScreen() {
-    #ifdef _WIN32
-        system("cls");
-    #else
-        system("clear");
-    #endif
+    screen.clear();
+}
+
+// One lab: a partition of the fleet with its own component store and
+// database file, so labs are loaded, scanned and saved independently
+struct Lab {
+    Lab(uint32_t site, const string& name, const string& path) : site(site), name(name), db(path) {}
+    
+    uint32_t site;
+    string name;
+    ComponentStore store;
+    InventoryDatabase db;
+};
+
+// Per lab figures and fleet-wide component quantities from Fleet::aggregate()
+struct FleetReport {
+    struct LabLine {
+        size_t units;
+        size_t components;
+        size_t bad;
+        size_t unitsWithBad;
+    };
+    
+    vector<LabLine> labs;
+    map<string, long long> goodQuantity;   // by component name
+    map<string, long long> badQuantity;
+};
+
+// Quotes a CSV field if it needs it
+string csvField(const string& text) {
+    if (text.find_first_of(",\"\n") == string::npos) {
+        return text;
+    }
+    string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        quoted += text[i] == '"' ? "\"\"" : string(1, text[i]);
+    }
+    return quoted + "\"";
 }
 
-// Function to display the main menu
-void displayMainMenu() {
+// Sites, their labs, and each lab's units. Lab i is kept in its own
+// database (path for lab 0, path + ".<i>" for the others) and the list of
+// sites and labs in a catalog, path + ".labs": a "LABCAT01" line, then one
+// "<site>\t<lab>" line per lab in order. An inventory with no catalog is
+// the single lab of the earlier versions, stored at path.
+//
+// Each lab is a partition: load(), findBad(), aggregate() and exportCsv()
+// give every lab to the thread pool as one task and combine the results
+// in lab order afterwards, so the output does not depend on the threads.
+class Fleet {
+public:
+    explicit Fleet(const string& path) : path(path) {}
+    
+    // Returns 1 if the inventory was loaded, 0 if there is none yet and
+    // -1 if it is damaged, with the name of the damaged file in damaged
+    int load(ThreadPool& pool, string& damaged) {
+        ifstream catalog((path + ".labs").c_str());
+        bool single = !catalog;
+        if (single) {
+            createLab("SITE 01", "COMPUTER LAB 01", 0);
+        } else {
+            string line;
+            if (!getline(catalog, line) || line != "LABCAT01") {
+                damaged = path + ".labs";
+                return -1;
+            }
+            while (getline(catalog, line)) {
+                size_t tab = line.find('\t');
+                if (tab == string::npos) {
+                    damaged = path + ".labs";
+                    return -1;
+                }
+                createLab(line.substr(0, tab), line.substr(tab + 1), 0);
+            }
+            // saveCatalog() always writes at least one lab
+            if (labs.empty()) {
+                damaged = path + ".labs";
+                return -1;
+            }
+        }
+        
+        vector<int> results(labs.size());
+        pool.parallelFor(labs.size(), [&](size_t i) {
+            results[i] = labs[i]->db.load(labs[i]->store);
+        });
+        if (single && results[0] == 0) {
+            labs.clear();
+            sites.clear();
+            return 0;
+        }
+        for (size_t i = 0; i < labs.size(); i++) {
+            // A lab in the catalog always has a file
+            if (results[i] != 1) {
+                damaged = labPath(i);
+                return -1;
+            }
+            if (labs[i]->db.failedToCompact()) {
+                cout << "Could not compact " << labPath(i) << "!\n";
+            }
+        }
+        return 1;
+    }
+    
+    // Adds a lab of new units in memory and returns its index; saveLab()
+    // and saveCatalog() write it
+    size_t createLab(const string& site, const string& name, int units) {
+        uint32_t siteIndex = 0;
+        while (siteIndex < sites.size() && sites[siteIndex] != site) {
+            siteIndex++;
+        }
+        if (siteIndex == sites.size()) {
+            sites.push_back(site);
+        }
+        labs.push_back(unique_ptr<Lab>(new Lab(siteIndex, name, labPath(labs.size()))));
+        ComponentStore& store = labs.back()->store;
+        store.reserve(units, static_cast<size_t>(units) * 5);
+        for (int i = 0; i < units; i++) {
+            Unit::create(store);
+        }
+        return labs.size() - 1;
+    }
+    
+    bool saveLab(size_t index) {
+        return labs[index]->db.checkpoint(labs[index]->store);
+    }
+    
+    bool saveCatalog() {
+        string text = "LABCAT01\n";
+        for (size_t i = 0; i < labs.size(); i++) {
+            text += sites[labs[i]->site] + "\t" + labs[i]->name + "\n";
+        }
+        return replaceFile(path + ".labs", text.data(), text.size());
+    }
+    
+    size_t labCount() const {
+        return labs.size();
+    }
+    
+    Lab& lab(size_t index) {
+        return *labs[index];
+    }
+    
+    const string& siteName(uint32_t site) const {
+        return sites[site];
+    }
+    
+    // Units with a Bad! component, per lab; returns how many Bad!
+    // components there are in the fleet
+    size_t findBad(ThreadPool& pool, vector<vector<uint32_t> >& unitsByLab) const {
+        unitsByLab.assign(labs.size(), vector<uint32_t>());
+        vector<size_t> found(labs.size());
+        pool.parallelFor(labs.size(), [&](size_t i) {
+            const ComponentStore& store = labs[i]->store;
+            vector<uint32_t>& units = unitsByLab[i];
+            store.forEachWithStatus(STATUS_BAD, [&](uint32_t row) {
+                units.push_back(store.unitOfRow(row));
+            });
+            found[i] = units.size();
+            sort(units.begin(), units.end());
+            units.erase(unique(units.begin(), units.end()), units.end());
+        });
+        size_t total = 0;
+        for (size_t i = 0; i < found.size(); i++) {
+            total += found[i];
+        }
+        return total;
+    }
+    
+    // Counts come from each lab's running totals; quantities are summed
+    // by scanning every lab's rows
+    void aggregate(ThreadPool& pool, FleetReport& report) const {
+        report.labs.resize(labs.size());
+        vector<vector<long long> > quantities(labs.size());
+        pool.parallelFor(labs.size(), [&](size_t i) {
+            const ComponentStore& store = labs[i]->store;
+            FleetReport::LabLine& line = report.labs[i];
+            line.units = store.unitCount();
+            line.bad = store.totalWithStatus(STATUS_BAD);
+            line.components = line.bad + store.totalWithStatus(STATUS_GOOD);
+            line.unitsWithBad = store.unitsWithBad();
+            
+            // By name id, Good then Bad!
+            vector<long long>& sums = quantities[i];
+            sums.assign(store.distinctNames() * 2, 0);
+            for (uint32_t row = 0; row < store.rowCount(); row++) {
+                sums[store.nameIdOf(row) * 2 + store.getStatus(row)] += store.getQuantity(row);
+            }
+        });
+        report.goodQuantity.clear();
+        report.badQuantity.clear();
+        for (size_t i = 0; i < labs.size(); i++) {
+            const ComponentStore& store = labs[i]->store;
+            for (uint32_t id = 0; id < store.distinctNames(); id++) {
+                if (store.totalWithName(id, STATUS_GOOD) + store.totalWithName(id, STATUS_BAD) > 0) {
+                    report.goodQuantity[store.nameById(id)] += quantities[i][id * 2];
+                    report.badQuantity[store.nameById(id)] += quantities[i][id * 2 + 1];
+                }
+            }
+        }
+    }
+    
+    // Writes every component as a CSV line: site, lab, unit, component,
+    // quantity, status. Each lab's text is built in parallel, then the
+    // labs are written in order.
+    bool exportCsv(ThreadPool& pool, const string& fileName) const {
+        vector<string> text;
+        buildCsv(pool, text);
+        return writeCsv(fileName, text);
+    }
+    
+    // The CSV lines of each lab, one string per lab, built in parallel
+    void buildCsv(ThreadPool& pool, vector<string>& text) const {
+        text.assign(labs.size(), string());
+        pool.parallelFor(labs.size(), [&](size_t i) {
+            const Lab& lab = *labs[i];
+            string prefix = csvField(sites[lab.site]) + "," + csvField(lab.name) + ",C";
+            string& out = text[i];
+            out.reserve(lab.store.rowCount() * (prefix.size() + 32));
+            for (uint32_t unit = 0; unit < lab.store.unitCount(); unit++) {
+                string unitField = to_string(unit + 1);
+                int index = 1;
+                for (uint32_t row = lab.store.firstComponent(unit); row != ComponentStore::NONE;
+                     row = lab.store.nextComponent(row)) {
+                    out.append(prefix).append(unitField).append(",");
+                    out.append(csvField(lab.store.name(row) + "-" + to_string(index++))).append(",");
+                    out.append(to_string(lab.store.getQuantity(row))).append(",");
+                    out.append(statusText(lab.store.getStatus(row))).append("\n");
+                }
+            }
+        });
+    }
+    
+    // Writes the header and each lab's lines from buildCsv() in lab order
+    static bool writeCsv(const string& fileName, const vector<string>& text) {
+        FILE* file = fopen(fileName.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        const char header[] = "site,lab,unit,component,quantity,status\n";
+        bool ok = fwrite(header, 1, sizeof(header) - 1, file) == sizeof(header) - 1;
+        for (size_t i = 0; ok && i < text.size(); i++) {
+            ok = fwrite(text[i].data(), 1, text[i].size(), file) == text[i].size();
+        }
+        return fclose(file) == 0 && ok;
+    }
+    
+private:
+    string labPath(size_t index) const {
+        return index == 0 ? path : path + "." + to_string(index);
+    }
+    
+    string path;
+    vector<string> sites;
+    vector<unique_ptr<Lab> > labs;
+};
+
+// Function to display the main menu; paged adds the option that turns
+// the page of the unit grid
+void displayMainMenu(bool paged = false) {
     cout << "\n======== COMPUTER LAB INVENTORY SYSTEM ========\n";
     cout << "1. Search Unit\n";
     cout << "2. Display All Units\n";
-    cout << "3. Exit\n";
+    cout << "3. List Bad! Components\n";
+    cout << "4. Select Lab\n";
+    cout << "5. Add Lab\n";
+    cout << "6. Fleet Summary\n";
+    cout << "7. Export Fleet to CSV\n";
+    cout << "8. Exit\n";
+    if (paged) {
+        cout << "9. Next Page of Units\n";
+    }
     cout << "=============================================\n";
     cout << "Enter your choice: ";
 }
@@ -211,20 +1728,88 @@ void displayUnitMenu() {
     cout << "Enter your choice: ";
 }
 
-// Function to display the component grid for 34 computers
-void displayComponentGrid() {
-    cout << "\n======== COMPUTER LABORATORY 01 UNIT LAYOUT (34 UNITS) ========\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
-    cout << "|  C01  |  C02  |  C03  |  C04  |  C05  |  C06  |  C07  |\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
-    cout << "|  C08  |  C09  |  C10  |  C11  |  C12  |  C13  |  C14  |\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
-    cout << "|  C15  |  C16  |  C17  |  C18  |  C19  |  C20  |  C21  |\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
-    cout << "|  C22  |  C23  |  C24  |  C25  |  C26  |  C27  |  C28  |\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
-    cout << "|  C29  |  C30  |  C31  |  C32  |  C33  |  C34  |       |\n";
-    cout << "+-------+-------+-------+-------+-------+-------+-------+\n";
+// Grid rows per page for the unit grid of a lab, so that the grid and the
+// main menu fit a terminal of the given height (0 when not a terminal: one
+// page) with a row to spare for the typed choice
+int gridPageRows(size_t lines, int numUnits) {
+    const int OTHER_LINES = 18;   // grid heading, page line, main menu and the spare row
+    int gridRows = (numUnits + 6) / 7;
+    // Unpaged, the page line and option 9 are left out
+    if (lines == 0 || gridRows * 2 + OTHER_LINES - 2 <= static_cast<int>(lines)) {
+        return max(gridRows, 1);
+    }
+    return max(1, (static_cast<int>(lines) - OTHER_LINES) / 2);
+}
+
+// Function to display the unit grid of a lab, 7 units to a row; cells
+// widen to fit the largest unit number. With pageRows, only that many grid
+// rows are drawn, from page page.
+void displayComponentGrid(const string& siteName, const string& labName, int numUnits, int pageRows = 0,
+                          int page = 0) {
+    const int COLUMNS = 7;
+    size_t digits = max<size_t>(2, to_string(numUnits).size());
+    string border;
+    for (int column = 0; column < COLUMNS; column++) {
+        border += "+" + string(digits + 5, '-');
+    }
+    border += "+\n";
+    cout << "\n======== " << siteName << " / " << labName << " UNIT LAYOUT (" << numUnits << " UNITS) ========\n";
+    cout << border;
+    int gridRows = (numUnits + COLUMNS - 1) / COLUMNS;
+    int firstRow = pageRows > 0 ? page * pageRows : 0;
+    int endRow = pageRows > 0 ? min(gridRows, firstRow + pageRows) : gridRows;
+    string line;
+    for (int row = firstRow; row < endRow; row++) {
+        line.clear();
+        for (int column = 0; column < COLUMNS; column++) {
+            int unit = row * COLUMNS + column + 1;
+            if (unit <= numUnits) {
+                string number = to_string(unit);
+                line += "|  C" + string(digits - number.size(), '0') + number + "  ";
+            } else {
+                line += "|" + string(digits + 5, ' ');
+            }
+        }
+        line += "|\n";
+        cout << line << border;
+    }
+    if (endRow - firstRow < gridRows) {
+        cout << "Units C" << firstRow * COLUMNS + 1 << "-C" << min(numUnits, endRow * COLUMNS) << " of " << numUnits
+             << " (page " << page + 1 << " of " << (gridRows + pageRows - 1) / pageRows << ")\n";
+    }
+}
+
+// Lab totals, per status and per component name, from the store's
+// running totals
+void displayLabSummary(const string& labName, const ComponentStore& store) {
+    size_t good = store.totalWithStatus(STATUS_GOOD);
+    size_t bad = store.totalWithStatus(STATUS_BAD);
+    cout << labName << ": " << store.unitCount() << " units, " << good + bad << " components\n";
+    cout << "Good: " << good << "   Bad!: " << bad << "   Units with Bad!: " << store.unitsWithBad() << "\n";
+    cout << "----------------------------------------\n";
+    cout << left << setw(20) << "COMPONENT NAME" << setw(15) << "GOOD" << "BAD!\n";
+    for (uint32_t nameId = 0; nameId < store.distinctNames(); nameId++) {
+        size_t nameGood = store.totalWithName(nameId, STATUS_GOOD);
+        size_t nameBad = store.totalWithName(nameId, STATUS_BAD);
+        if (nameGood + nameBad > 0) {
+            cout << left << setw(20) << store.nameById(nameId) << setw(15) << nameGood << nameBad << endl;
+        }
+    }
+}
+
+// Lab summary, then each unit's status
+void displayAllUnits(const string& labName, ComponentStore& store) {
+    cout << "\n----- ALL UNITS STATUS -----\n";
+    displayLabSummary(labName, store);
+    cout << "----------------------------------------\n";
+    cout << left << setw(15) << "UNIT NUMBER" << setw(15) << "STATUS" << "BAD!\n";
+    cout << "----------------------------------------\n";
+    
+    for (uint32_t i = 0; i < store.unitCount(); i++) {
+        Unit unit(store, i);
+        cout << left << setw(15) << "C" + to_string(i + 1) << setw(15) << unit.getMainStatus()
+             << unit.badCount() << endl;
+    }
 }
 
 // Function to wait for user input
@@ -234,34 +1819,448 @@ void waitForInput() {
     cin.get();
 }
 
+// The old layout, one fixed array of {name, quantity, status} strings per
+// unit, kept for the benchmark
+struct ArrayComponent {
+    string name;
+    int quantity;
+    string status;
+};
+
+struct ArrayUnit {
+    ArrayComponent components[7];
+    int numComponents;
+};
+
+// Time a fleet-wide "all Bad! components" scan over numUnits units with
+// the old array-of-structs layout and with the component store
+void runBenchmark(int numUnits) {
+    typedef chrono::steady_clock Clock;
+    const char* defaults[] = {"Mouse", "Keyboard", "AVR", "HDMI", "System Unit"};
+    cout << "Benchmark: " << numUnits << " units, 5 components each\n";
+    
+    srand(1);
+    Clock::time_point start = Clock::now();
+    vector<ArrayUnit> arrayUnits(numUnits);
+    for (int i = 0; i < numUnits; i++) {
+        for (int c = 0; c < 5; c++) {
+            arrayUnits[i].components[c].name = string(defaults[c]) + "-" + to_string(c + 1);
+            arrayUnits[i].components[c].quantity = 1;
+            arrayUnits[i].components[c].status = statusText(randomStatus());
+        }
+        arrayUnits[i].numComponents = 5;
+    }
+    double arrayBuild = chrono::duration<double>(Clock::now() - start).count();
+    
+    srand(1);
+    start = Clock::now();
+    ComponentStore store;
+    store.reserve(numUnits, static_cast<size_t>(numUnits) * 5);
+    for (int i = 0; i < numUnits; i++) {
+        Unit::create(store);
+    }
+    double storeBuild = chrono::duration<double>(Clock::now() - start).count();
+    
+    const int ROUNDS = 5;
+    size_t arrayCount = 0, storeCount = 0;
+    vector<uint32_t> arrayUnitsFound, storeUnitsFound;
+    
+    start = Clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        arrayCount = 0;
+        for (int i = 0; i < numUnits; i++) {
+            for (int c = 0; c < arrayUnits[i].numComponents; c++) {
+                arrayCount += arrayUnits[i].components[c].status == "Bad!";
+            }
+        }
+    }
+    double arrayCountTime = chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    
+    start = Clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        storeCount = store.countWithStatus(STATUS_BAD);
+    }
+    double storeCountTime = chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    
+    start = Clock::now();
+    size_t runningCount = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        runningCount = store.totalWithStatus(STATUS_BAD);
+    }
+    double runningCountTime = chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    
+    start = Clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        arrayUnitsFound.clear();
+        for (int i = 0; i < numUnits; i++) {
+            for (int c = 0; c < arrayUnits[i].numComponents; c++) {
+                if (arrayUnits[i].components[c].status == "Bad!") {
+                    arrayUnitsFound.push_back(i);
+                }
+            }
+        }
+    }
+    double arrayListTime = chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    
+    start = Clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        storeUnitsFound.clear();
+        store.forEachWithStatus(STATUS_BAD, [&](uint32_t row) {
+            storeUnitsFound.push_back(store.unitOfRow(row));
+        });
+    }
+    double storeListTime = chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    
+    size_t arrayBytes = arrayUnits.capacity() * sizeof(ArrayUnit);
+    cout << fixed << setprecision(2);
+    cout << left << setw(28) << "" << setw(16) << "array of units" << "component store\n";
+    cout << left << setw(28) << "build (ms)" << setw(16) << arrayBuild * 1000 << storeBuild * 1000 << "\n";
+    cout << left << setw(28) << "memory (MB)" << setw(16) << arrayBytes / 1048576.0
+         << store.memoryUsed() / 1048576.0 << "\n";
+    cout << left << setw(28) << "count Bad! (ms)" << setw(16) << arrayCountTime * 1000 << storeCountTime * 1000 << "\n";
+    cout << left << setw(28) << "running total Bad! (ms)" << setw(16) << "" << runningCountTime * 1000 << "\n";
+    cout << left << setw(28) << "list units with Bad! (ms)" << setw(16) << arrayListTime * 1000 << storeListTime * 1000 << "\n";
+    cout << "Bad! components: " << arrayCount << " / " << storeCount
+         << (arrayCount == storeCount && runningCount == storeCount && arrayUnitsFound == storeUnitsFound ? " (same)" : " (MISMATCH)") << "\n";
+    cout << "Distinct component names stored: " << store.distinctNames() << "\n";
+}
+
+// Time saving and loading numUnits units: a full snapshot, reading it
+// back, single-unit saves, and reading it back again with the journal
+void runDatabaseBenchmark(int numUnits) {
+    typedef chrono::steady_clock Clock;
+    const string path = "bench-inventory.db";
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+    cout << "Database benchmark: " << numUnits << " units, 5 components each\n";
+    
+    srand(1);
+    ComponentStore store;
+    store.reserve(numUnits, static_cast<size_t>(numUnits) * 5);
+    for (int i = 0; i < numUnits; i++) {
+        Unit::create(store);
+    }
+    
+    InventoryDatabase db(path);
+    Clock::time_point start = Clock::now();
+    bool saved = db.checkpoint(store);
+    double saveTime = chrono::duration<double>(Clock::now() - start).count();
+    
+    start = Clock::now();
+    ComponentStore loaded;
+    InventoryDatabase reader(path);
+    int result = reader.load(loaded);
+    double loadTime = chrono::duration<double>(Clock::now() - start).count();
+    
+    // Random adds, edits and deletes, each saved on its own
+    const int EDITS = 2000;
+    const char* names[] = {"Mouse", "Keyboard", "AVR", "HDMI", "System Unit", "Webcam", "Headset"};
+    start = Clock::now();
+    for (int i = 0; i < EDITS; i++) {
+        uint32_t unit = static_cast<uint32_t>(rand() % numUnits);
+        int count = static_cast<int>(store.componentCount(unit));
+        int kind = rand() % 3;
+        if (kind == 0 || count == 0) {
+            store.addComponent(unit, names[rand() % 7], 1 + rand() % 4, randomStatus());
+        } else if (kind == 1) {
+            uint32_t row = store.componentAt(unit, rand() % count);
+            store.setName(row, names[rand() % 7]);
+            store.setStatus(row, randomStatus());
+        } else {
+            store.removeComponent(store.componentAt(unit, rand() % count));
+        }
+        saved = db.saveUnit(store, unit) && saved;
+    }
+    double editTime = chrono::duration<double>(Clock::now() - start).count();
+    size_t journalBytes = db.journalSize();
+    
+    start = Clock::now();
+    ComponentStore reloaded;
+    InventoryDatabase replayer(path);
+    result = min(result, replayer.load(reloaded));
+    double reloadTime = chrono::duration<double>(Clock::now() - start).count();
+    
+    bool same = reloaded.unitCount() == store.unitCount() && reloaded.rowCount() == store.rowCount()
+        && reloaded.totalWithStatus(STATUS_BAD) == store.countWithStatus(STATUS_BAD)
+        && store.totalWithStatus(STATUS_BAD) == store.countWithStatus(STATUS_BAD)
+        && reloaded.unitsWithBad() == store.unitsWithBad();
+    for (uint32_t unit = 0; same && unit < store.unitCount(); unit++) {
+        uint32_t a = store.firstComponent(unit);
+        uint32_t b = reloaded.firstComponent(unit);
+        while (same && (a != ComponentStore::NONE || b != ComponentStore::NONE)) {
+            same = a != ComponentStore::NONE && b != ComponentStore::NONE && store.name(a) == reloaded.name(b)
+                && store.getQuantity(a) == reloaded.getQuantity(b) && store.getStatus(a) == reloaded.getStatus(b);
+            if (same) {
+                a = store.nextComponent(a);
+                b = reloaded.nextComponent(b);
+            }
+        }
+    }
+    
+    cout << fixed << setprecision(2);
+    cout << "snapshot: " << db.snapshotSize() / 1048576.0 << " MB written in " << saveTime * 1000 << " ms\n";
+    cout << "load: " << loadTime * 1000 << " ms for " << loaded.rowCount() << " components\n";
+    cout << "saves: " << EDITS << " units in " << editTime * 1000 << " ms (" << editTime * 1e6 / EDITS
+         << " us and " << journalBytes / EDITS << " bytes each, synced)\n";
+    cout << "load with journal: " << reloadTime * 1000 << " ms\n";
+    cout << (saved && result == 1 && same ? "Reloaded inventory matches.\n" : "RELOADED INVENTORY DIFFERS OR FAILED.\n");
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+}
+
+// Time the fleet-wide scans over labs x unitsPerLab units with 1, 2, 4,
+// ... threads, up to maxThreads (0 for the number of cores)
+void runFleetBenchmark(int numLabs, int unitsPerLab, unsigned maxThreads) {
+    typedef chrono::steady_clock Clock;
+    const string csvPath = "bench-fleet.csv";
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    maxThreads = maxThreads > 0 ? maxThreads : cores;
+    cout << "Fleet benchmark: " << numLabs << " labs of " << unitsPerLab << " units, " << cores << " cores\n";
+    
+    srand(1);
+    Fleet fleet("bench-fleet.db");
+    for (int i = 0; i < numLabs; i++) {
+        fleet.createLab("SITE " + to_string(i / 20 + 1), "LAB " + to_string(i % 20 + 1), unitsPerLab);
+    }
+    
+    vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+    
+    const int ROUNDS = 3;
+    double base = 0;
+    size_t badCount = 0;
+    bool same = true;
+    cout << fixed << setprecision(2);
+    // The CSV file write is serial, so it is timed apart and left out of
+    // the speedup
+    cout << left << setw(10) << "threads" << setw(16) << "find Bad! (ms)" << setw(16) << "aggregate (ms)"
+         << setw(16) << "csv text (ms)" << setw(16) << "csv write (ms)" << "speedup\n";
+    for (size_t t = 0; t < threadCounts.size(); t++) {
+        ThreadPool pool(threadCounts[t]);
+        double times[4] = {1e18, 1e18, 1e18, 1e18};
+        for (int round = 0; round < ROUNDS; round++) {
+            vector<vector<uint32_t> > units;
+            FleetReport report;
+            vector<string> text;
+            Clock::time_point start = Clock::now();
+            size_t bad = fleet.findBad(pool, units);
+            Clock::time_point scanned = Clock::now();
+            fleet.aggregate(pool, report);
+            Clock::time_point aggregated = Clock::now();
+            fleet.buildCsv(pool, text);
+            Clock::time_point built = Clock::now();
+            same = Fleet::writeCsv(csvPath, text) && same;
+            Clock::time_point written = Clock::now();
+            times[0] = min(times[0], chrono::duration<double, milli>(scanned - start).count());
+            times[1] = min(times[1], chrono::duration<double, milli>(aggregated - scanned).count());
+            times[2] = min(times[2], chrono::duration<double, milli>(built - aggregated).count());
+            times[3] = min(times[3], chrono::duration<double, milli>(written - built).count());
+            same = same && (t == 0 && round == 0 ? true : bad == badCount);
+            badCount = bad;
+        }
+        double total = times[0] + times[1] + times[2];
+        if (t == 0) {
+            base = total;
+        }
+        cout << left << setw(10) << threadCounts[t] << setw(16) << times[0] << setw(16) << times[1]
+             << setw(16) << times[2] << setw(16) << times[3] << base / total << "x\n";
+    }
+    cout << "Bad! components: " << badCount << (same ? " (same with every thread count)" : " (MISMATCH OR EXPORT FAILED)") << "\n";
+    remove(csvPath.c_str());
+}
+
+// Time redrawing a lab's screens through Screen, on simulated terminals
+// of common sizes, against starting a shell to clear the screen
+void runScreenBenchmark(int numUnits) {
+    typedef chrono::steady_clock Clock;
+    const int ROUNDS = 200;
+    cout << "Screen benchmark: lab of " << numUnits << " units\n";
+    
+    srand(1);
+    ComponentStore store;
+    for (int i = 0; i < numUnits; i++) {
+        Unit::create(store);
+    }
+    
+    const size_t SIZES[][2] = {{80, 24}, {120, 60}};
+    ostringstream report;
+    report << fixed << setprecision(2);
+    streambuf* saved = cout.rdbuf();
+    for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+        Screen bench;
+        bench.simulate(SIZES[s][0], SIZES[s][1]);
+        cout.rdbuf(bench.buffer());
+        
+        // Draws the frame with draw() and renders it; returns microseconds
+        // per frame and the bytes of the last one in bytes
+        auto time = [&](function<void()> draw, size_t& bytes) {
+            string out;
+            Clock::time_point start = Clock::now();
+            for (int round = 0; round < ROUNDS; round++) {
+                bench.clear();
+                draw();
+                out.clear();
+                bench.render(out);
+            }
+            bytes = out.size();
+            return chrono::duration<double, micro>(Clock::now() - start).count() / ROUNDS;
+        };
+        
+        // The main screen, with the first page of the grid
+        int pageRows = gridPageRows(bench.lines(), numUnits);
+        bool paged = pageRows < (numUnits + 6) / 7;
+        auto mainScreen = [&] {
+            displayComponentGrid("SITE 01", "COMPUTER LAB 01", numUnits, pageRows);
+            displayMainMenu(paged);
+        };
+        
+        size_t firstBytes, gridBytes, listBytes;
+        string first;
+        bench.clear();
+        mainScreen();
+        bench.render(first);
+        firstBytes = first.size();
+        double gridTime = time(mainScreen, gridBytes);
+        
+        // The status list with one unit's status flipped each frame. The
+        // lab totals at its top change too, so once the list is taller than
+        // the terminal it is written out in full.
+        uint32_t row = store.firstComponent(numUnits / 2);
+        double listTime = time([&] {
+            store.setStatus(row, store.getStatus(row) == STATUS_BAD ? STATUS_GOOD : STATUS_BAD);
+            displayAllUnits("COMPUTER LAB 01", store);
+        }, listBytes);
+        string back;
+        bench.clear();
+        mainScreen();
+        bench.render(back);
+        
+        report << SIZES[s][0] << "x" << SIZES[s][1] << " terminal:\n";
+        report << "  first draw of the unit grid: " << firstBytes << " bytes\n";
+        report << "  redraw of the unit grid, unchanged: " << gridTime << " us, " << gridBytes << " bytes\n";
+        report << "  redraw of the status list, one unit changed: " << listTime << " us, " << listBytes << " bytes\n";
+        report << "  back to the unit grid from the status list: " << back.size() << " bytes\n";
+    }
+    cout.rdbuf(saved);
+    
+    const int SPAWNS = 10;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < SPAWNS; i++) {
+#ifdef _WIN32
+        system("cls > nul");
+#else
+        system("clear > /dev/null");
+#endif
+    }
+    double spawnTime = chrono::duration<double, micro>(Clock::now() - start).count() / SPAWNS;
+    
+    cout << report.str();
+    cout << fixed << setprecision(2);
+    cout << "clearing the screen through the shell: " << spawnTime << " us\n";
+}
+
 // Main function
-int main() {
+int main(int argc, char* argv[]) {
+    // Usage: "Inventory System" [inventory file] | --bench [units] | --bench-db [units]
+    //        | --bench-labs [labs] [units per lab] [max threads] | --bench-screen [units]
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        int numUnits = argc > 2 ? atoi(argv[2]) : 1000000;
+        runBenchmark(numUnits > 0 ? numUnits : 1);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-db") {
+        int numUnits = argc > 2 ? atoi(argv[2]) : 1000000;
+        runDatabaseBenchmark(numUnits > 0 ? numUnits : 1);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-labs") {
+        int numLabs = argc > 2 ? atoi(argv[2]) : 1000;
+        int unitsPerLab = argc > 3 ? atoi(argv[3]) : 500;
+        int maxThreads = argc > 4 ? atoi(argv[4]) : 0;
+        runFleetBenchmark(numLabs > 0 ? numLabs : 1, unitsPerLab > 0 ? unitsPerLab : 1, maxThreads > 0 ? maxThreads : 0);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-screen") {
+        int numUnits = argc > 2 ? atoi(argv[2]) : 1000;
+        runScreenBenchmark(numUnits > 0 ? numUnits : 1);
+        return 0;
+    }
+    
+    // Draw through the in-process renderer from here on
+    screen.install();
+    
     // Seed random number generator
     srand(static_cast<unsigned>(time(0)));
     
-    // Create array of units
-    const int NUM_UNITS = 34;
-    Unit units[NUM_UNITS];
+    // Load the saved labs, or create the first one on the first run
+    const int DEFAULT_UNITS = 34;
+    string dbPath = argc > 1 ? argv[1] : "inventory.db";
+    ThreadPool pool(max(1u, thread::hardware_concurrency()));
+    Fleet fleet(dbPath);
+    string damaged;
+    int loaded = fleet.load(pool, damaged);
+    if (loaded < 0) {
+        cout << damaged << " is damaged or unreadable; move the inventory away to start a new one.\n";
+        return 1;
+    }
+    if (loaded == 0) {
+        fleet.createLab("SITE 01", "COMPUTER LAB 01", DEFAULT_UNITS);
+        if (!fleet.saveLab(0)) {
+            cout << "Cannot write " << dbPath << "; changes will not be saved.\n";
+            waitForInput();
+        }
+    }
+    
+    // The lab the menus work on
+    size_t current = 0;
+    
+    // Save a changed unit of the current lab to disk
+    auto save = [&](int unitIndex) {
+        Lab& lab = fleet.lab(current);
+        if (!lab.db.saveUnit(lab.store, unitIndex)) {
+            cout << "\nCould not save the change to " << lab.name << "!\n";
+        }
+    };
     
     int choice, unitChoice, componentChoice;
     
+    // The page of the unit grid on the main screen; the grid is paged so
+    // that the main screen fits the terminal and is redrawn by difference
+    int gridPage = 0;
+    
     while (true) {
+        Lab& lab = fleet.lab(current);
+        ComponentStore& store = lab.store;
+        int numUnits = static_cast<int>(store.unitCount());
+        int pageRows = gridPageRows(screen.lines(), numUnits);
+        int gridPages = ((numUnits + 6) / 7 + pageRows - 1) / pageRows;
+        gridPage = gridPage < gridPages ? gridPage : 0;
+        
         clearScreen();
-        displayComponentGrid();
-        displayMainMenu();
+        displayComponentGrid(fleet.siteName(lab.site), lab.name, numUnits, pageRows, gridPage);
+        displayMainMenu(gridPages > 1);
         
         cin >> choice;
         
+        if (choice == 9 && gridPages > 1) {
+            gridPage = (gridPage + 1) % gridPages;
+            continue;
+        }
+        
         switch (choice) {
             case 1: // Search for a specific unit
                 clearScreen();
                 cout << "\n----- SEARCH UNIT -----\n";
-                cout << "Enter unit number (1-34): ";
+                cout << "Enter unit number (1-" << numUnits << "): ";
                 cin >> unitChoice;
                 
-                if (unitChoice >= 1 && unitChoice <= NUM_UNITS) {
+                if (unitChoice >= 1 && unitChoice <= numUnits) {
+                    Unit unit(store, unitChoice - 1);
                     clearScreen();
-                    units[unitChoice - 1].displayComponents(unitChoice);
+                    unit.displayComponents(unitChoice, lab.name);
                     
                     do {
                         displayUnitMenu();
@@ -269,19 +2268,25 @@ int main() {
                         
                         switch (choice) {
                             case 1: // Add component
-                                units[unitChoice - 1].addComponent();
+                                if (unit.addComponent()) {
+                                    save(unitChoice - 1);
+                                }
                                 break;
                                 
                             case 2: // Edit component
-                                cout << "\nEnter component number to edit (1-7): ";
+                                cout << "\nEnter component number to edit (1-" << unit.componentCount() << "): ";
                                 cin >> componentChoice;
-                                units[unitChoice - 1].editComponent(componentChoice - 1);
+                                if (unit.editComponent(componentChoice - 1)) {
+                                    save(unitChoice - 1);
+                                }
                                 break;
                                 
                             case 3: // Delete component
-                                cout << "\nEnter component number to delete (1-7): ";
+                                cout << "\nEnter component number to delete (1-" << unit.componentCount() << "): ";
                                 cin >> componentChoice;
-                                units[unitChoice - 1].deleteComponent(componentChoice - 1);
+                                if (unit.deleteComponent(componentChoice - 1)) {
+                                    save(unitChoice - 1);
+                                }
                                 break;
                                 
                             case 4: // Back to main menu
@@ -294,30 +2299,133 @@ int main() {
                         if (choice != 4) {
                             waitForInput();
                             clearScreen();
-                            units[unitChoice - 1].displayComponents(unitChoice);
+                            unit.displayComponents(unitChoice, lab.name);
                         }
                     } while (choice != 4);
                 } else {
-                    cout << "\nInvalid unit number. Please enter a number between 1 and 34.\n";
+                    cout << "\nInvalid unit number. Please enter a number between 1 and " << numUnits << ".\n";
                     waitForInput();
                 }
                 break;
                 
             case 2: // Display all units
                 clearScreen();
-                cout << "\n----- ALL UNITS STATUS -----\n";
-                cout << "----------------------------\n";
-                cout << left << setw(15) << "UNIT NUMBER" << "STATUS\n";
-                cout << "----------------------------\n";
+                displayAllUnits(lab.name, store);
+                waitForInput();
+                break;
+                
+            case 3: // List every Bad! component in the lab
+                clearScreen();
+                cout << "\n----- BAD! COMPONENTS -----\n";
+                cout << "----------------------------------------\n";
+                cout << left << setw(15) << "UNIT NUMBER" << setw(20) << "COMPONENT NAME" << "QUANTITY\n";
+                cout << "----------------------------------------\n";
                 
-                for (int i = 0; i < NUM_UNITS; i++) {
-                    cout << left << setw(15) << "C" + to_string(i + 1) << units[i].getMainStatus() << endl;
-                }
+                store.forEachWithStatus(STATUS_BAD, [&](uint32_t row) {
+                    cout << left << setw(15) << "C" + to_string(store.unitOfRow(row) + 1)
+                         << setw(20) << store.name(row) + "-" + to_string(store.indexOf(row) + 1)
+                         << store.getQuantity(row) << endl;
+                });
+                
+                waitForInput();
+                break;
                 
+            case 4: { // Choose the lab to work on
+                clearScreen();
+                cout << "\n----- SELECT LAB -----\n";
+                for (size_t i = 0; i < fleet.labCount(); i++) {
+                    Lab& entry = fleet.lab(i);
+                    cout << right << setw(5) << i + 1 << ". " << left << setw(20) << fleet.siteName(entry.site)
+                         << setw(20) << entry.name << entry.store.unitCount() << " units\n";
+                }
+                cout << "Enter lab number (1-" << fleet.labCount() << "): ";
+                int labChoice;
+                cin >> labChoice;
+                if (labChoice >= 1 && static_cast<size_t>(labChoice) <= fleet.labCount()) {
+                    current = labChoice - 1;
+                    gridPage = 0;
+                } else {
+                    cout << "\nInvalid lab number.\n";
+                    waitForInput();
+                }
+                break;
+            }
+            
+            case 5: { // Add a lab, to a new or existing site
+                string siteName, labName;
+                int labUnits;
+                clearScreen();
+                cout << "\n----- ADD LAB -----\n";
+                cout << "Enter site name: ";
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                getline(cin, siteName);
+                cout << "Enter lab name: ";
+                getline(cin, labName);
+                cout << "Enter number of units: ";
+                cin >> labUnits;
+                if (cin.fail() || labUnits <= 0 || siteName.empty() || labName.empty()
+                    || (siteName + labName).find('\t') != string::npos) {
+                    cin.clear();
+                    cout << "\nInvalid lab. Names must not be empty and units must be positive.\n";
+                } else {
+                    current = fleet.createLab(siteName, labName, labUnits);
+                    gridPage = 0;
+                    if (fleet.saveLab(current) && fleet.saveCatalog()) {
+                        cout << "\nLab added successfully!\n";
+                    } else {
+                        cout << "\nCould not save the new lab!\n";
+                    }
+                }
                 waitForInput();
                 break;
+            }
+            
+            case 6: { // Totals for every lab, worked out in parallel
+                clearScreen();
+                FleetReport report;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                fleet.aggregate(pool, report);
+                double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
                 
-            case 3: // Exit the program
+                cout << "\n----- FLEET SUMMARY -----\n";
+                cout << left << setw(20) << "SITE" << setw(20) << "LAB" << setw(10) << "UNITS"
+                     << setw(12) << "COMPONENTS" << setw(8) << "BAD!" << "UNITS WITH BAD!\n";
+                size_t units = 0, components = 0, bad = 0;
+                for (size_t i = 0; i < fleet.labCount(); i++) {
+                    const FleetReport::LabLine& line = report.labs[i];
+                    cout << left << setw(20) << fleet.siteName(fleet.lab(i).site) << setw(20) << fleet.lab(i).name
+                         << setw(10) << line.units << setw(12) << line.components << setw(8) << line.bad
+                         << line.unitsWithBad << "\n";
+                    units += line.units;
+                    components += line.components;
+                    bad += line.bad;
+                }
+                cout << "----------------------------------------\n";
+                cout << fleet.labCount() << " labs, " << units << " units, " << components << " components, "
+                     << bad << " Bad!\n";
+                cout << left << setw(20) << "COMPONENT NAME" << setw(15) << "GOOD QTY" << "BAD! QTY\n";
+                for (map<string, long long>::const_iterator it = report.goodQuantity.begin(); it != report.goodQuantity.end(); ++it) {
+                    cout << left << setw(20) << it->first << setw(15) << it->second << report.badQuantity[it->first] << "\n";
+                }
+                cout << "(" << fixed << setprecision(2) << elapsed << " ms on " << pool.size() << " threads)\n";
+                waitForInput();
+                break;
+            }
+            
+            case 7: { // Every component of every lab as a CSV file
+                string fileName;
+                cout << "Enter CSV file name: ";
+                cin >> fileName;
+                if (fleet.exportCsv(pool, fileName)) {
+                    cout << "\nExported " << fleet.labCount() << " labs to " << fileName << ".\n";
+                } else {
+                    cout << "\nCould not write " << fileName << "!\n";
+                }
+                waitForInput();
+                break;
+            }
+            
+            case 8: // Exit the program
                 cout << "\nThank you for using the Computer Lab Inventory System. Goodbye!\n";
                 return 0;
                 
@@ -1,12 +1,327 @@
 #include <iostream>
 #include <string>
-#include <cstdlib> // for system cls
+#include <cstdlib>
 #include <ctime> 
 #include <iomanip> // for UI mapping syntax setw
 #include <conio.h>  // for _getch
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
 
 using namespace std;
 
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
+// Draws the program's screens in the terminal without starting a shell.
+// While installed, everything written to cout goes into the current frame
+// instead of straight to the terminal, and clear() starts a new frame at
+// the top of the screen. Just before the program waits for input, the
+// frame is compared row by row with what the terminal shows, and only the
+// changed cells are written, with ANSI escapes, in a single write. What
+// the terminal echoes while the user types is added to the frame as well,
+// so the two stay in step. Reads through cin present the frame by
+// themselves; call present() before reading a key with _getch().
+//
+// A frame taller than the terminal is shown scrolled to its end, as if it
+// had been written out in full, with the rows above the screen in the
+// terminal's scrollback. Those rows cannot be redrawn, so when a new frame
+// has the same rows above the screen, only the screen's rows are compared;
+// otherwise the whole frame is written out again. When cout is not a
+// terminal, frames are written out as plain text.
+class Screen {
+public:
+    Screen() : output(*this), input(*this), savedOut(0), savedIn(0), terminal(false), echoes(false),
+               streaming(false), wipe(true), sent(0), width(80), height(24),
+               shownWidth(80), shownHeight(24) {}
+
+    ~Screen() {
+        uninstall();
+    }
+
+    // Takes over cout and cin
+    void install() {
+#ifdef _WIN32
+        DWORD mode;
+        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+        terminal = GetConsoleMode(console, &mode)
+            && SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        echoes = terminal && GetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), &mode);
+#else
+        terminal = isatty(STDOUT_FILENO);
+        echoes = terminal && isatty(STDIN_FILENO);
+#endif
+        if (terminal) {
+            measure();
+        }
+        savedOut = cout.rdbuf(&output);
+        savedIn = cin.rdbuf(&input);
+    }
+
+    // Writes what is left of the frame and gives cout and cin back
+    void uninstall() {
+        if (savedOut) {
+            present();
+            cout.rdbuf(savedOut);
+            cin.rdbuf(savedIn);
+            savedOut = 0;
+        }
+    }
+
+    // Starts a new frame at the top of the screen
+    void clear() {
+        frame.clear();
+        sent = 0;
+        streaming = false;
+    }
+
+    // Brings the terminal up to date with the frame
+    void present() {
+        string out;
+        if (terminal) {
+            measure();
+        }
+        render(out);
+        writeOut(out.data(), out.size());
+    }
+
+private:
+    // The escapes and text that bring the terminal up to date, which from
+    // then on is assumed to show the frame
+    void render(string& out) {
+        if (!terminal) {
+            out.append(frame, sent, string::npos);
+            sent = frame.size();
+            return;
+        }
+        splitRows(frame, rows);
+        size_t top = rows.size() > height ? rows.size() - height : 0;
+        // The terminal shows this frame up to sent, with the cursor at its
+        // end, so the rest can be written after it and scroll the screen
+        if (streaming || (top > 0 && sent > 0)) {
+            out.append(frame, sent, string::npos);
+            keep(rows);
+            return;
+        }
+        // Only the rows on the screen can be redrawn
+        bool sameAbove = top == 0 || (scrolled.size() == top && equal(scrolled.begin(), scrolled.end(), rows.begin()));
+        if (wipe || !sameAbove) {
+            rewrite(out, rows);
+            return;
+        }
+        size_t start = out.size();
+        for (size_t row = 0; row < max(rows.size() - top, shown.size()); row++) {
+            const string& now = top + row < rows.size() ? rows[top + row] : empty;
+            const string& before = row < shown.size() ? shown[row] : empty;
+            if (now == before) {
+                continue;
+            }
+            // The changed span: from the first differing cell, and to the
+            // last one when the row keeps its length
+            size_t first = 0;
+            while (first < now.size() && first < before.size() && now[first] == before[first]) {
+                first++;
+            }
+            size_t end = now.size();
+            if (now.size() == before.size()) {
+                while (end > first && now[end - 1] == before[end - 1]) {
+                    end--;
+                }
+            }
+            moveTo(out, row, first);
+            out.append(now, first, end - first);
+            if (now.size() < before.size()) {
+                out += "\x1b[K";
+            }
+        }
+        moveTo(out, rows.size() - top - 1, rows.back().size());
+        if (out.size() - start > frame.size() + 7) {
+            out.resize(start);
+            rewrite(out, rows);
+            return;
+        }
+        streaming = top > 0;
+        keep(rows);
+    }
+
+    // Collects what is written to cout into the frame. Flushes (endl) do
+    // nothing; the frame goes out when input is read.
+    class Output : public streambuf {
+    public:
+        explicit Output(Screen& screen) : screen(screen) {}
+
+    protected:
+        int_type overflow(int_type c) {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                screen.frame += traits_type::to_char_type(c);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        streamsize xsputn(const char* text, streamsize count) {
+            screen.frame.append(text, static_cast<size_t>(count));
+            return count;
+        }
+
+    private:
+        Screen& screen;
+    };
+
+    // Reads stdin for cin, presenting the frame before it waits
+    class Input : public streambuf {
+    public:
+        explicit Input(Screen& screen) : screen(screen) {}
+
+    protected:
+        int_type underflow() {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            screen.present();
+#ifdef _WIN32
+            int count = _read(0, buffer, sizeof(buffer));
+#else
+            ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+#endif
+            if (count <= 0) {
+                return traits_type::eof();
+            }
+            if (screen.echoes) {
+                screen.echoed(buffer, static_cast<size_t>(count));
+            }
+            setg(buffer, buffer, buffer + count);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        Screen& screen;
+        char buffer[4096];
+    };
+
+    // The terminal echoed what the user typed at the end of the frame
+    void echoed(const char* text, size_t count) {
+        frame.append(text, count);
+        splitRows(frame, rows);
+        keep(rows);
+    }
+
+    // Clears the terminal and writes the whole frame
+    void rewrite(string& out, const vector<string>& frameRows) {
+        out += "\x1b[H\x1b[2J";
+        out.append(frame);
+        wipe = false;
+        streaming = frameRows.size() > height;
+        keep(frameRows);
+    }
+
+    // The terminal now holds all of the frame: its last rows on the screen
+    // and any above them scrolled off
+    void keep(const vector<string>& frameRows) {
+        size_t top = frameRows.size() > height ? frameRows.size() - height : 0;
+        scrolled.assign(frameRows.begin(), frameRows.begin() + top);
+        shown.assign(frameRows.begin() + top, frameRows.end());
+        sent = frame.size();
+    }
+
+    // Screen rows of the text: lines, wrapped at the terminal width
+    void splitRows(const string& text, vector<string>& out) const {
+        size_t count = 0;
+        size_t start = 0;
+        while (true) {
+            size_t newline = text.find('\n', start);
+            size_t lineEnd = newline == string::npos ? text.size() : newline;
+            do {
+                size_t take = min(width, lineEnd - start);
+                if (count == out.size()) {
+                    out.push_back(string());
+                }
+                out[count++].assign(text, start, take);
+                start += take;
+            } while (start < lineEnd);
+            if (newline == string::npos) {
+                break;
+            }
+            start = newline + 1;
+        }
+        out.resize(count);
+    }
+
+    static void moveTo(string& out, size_t row, size_t column) {
+        out += "\x1b[" + to_string(row + 1) + ";" + to_string(column + 1) + "H";
+    }
+
+    void measure() {
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+            width = info.srWindow.Right - info.srWindow.Left + 1;
+            height = info.srWindow.Bottom - info.srWindow.Top + 1;
+        }
+#else
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            width = size.ws_col;
+            height = size.ws_row;
+        }
+#endif
+        // A resized terminal rewraps and scrolls what it shows
+        if (width != shownWidth || height != shownHeight) {
+            wipe = true;
+            shownWidth = width;
+            shownHeight = height;
+        }
+    }
+
+    void writeOut(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int written = _write(1, data, static_cast<unsigned>(size));
+#else
+            ssize_t written = write(STDOUT_FILENO, data, size);
+#endif
+            if (written <= 0) {
+                return;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    Output output;
+    Input input;
+    streambuf* savedOut;
+    streambuf* savedIn;
+    bool terminal;      // cout is a terminal that understands ANSI escapes
+    bool echoes;        // and cin is that terminal, echoing what is typed
+    bool streaming;     // the frame is taller than the screen and goes out as it grows
+    bool wipe;          // the terminal's contents are unknown
+    string frame;
+    size_t sent;        // bytes of the frame already written or echoed
+    vector<string> rows;
+    vector<string> shown;      // the rows on the screen
+    vector<string> scrolled;   // and the frame's rows above them, in the scrollback
+    const string empty;
+    size_t width;
+    size_t height;
+    size_t shownWidth;
+    size_t shownHeight;
+};
+
+Screen screen;
+
 // Declare functions
 void displayComponentGrid();
 void displayMenu();
@@ -42,15 +357,15 @@ public:
     }
 
     // Method to add a new component, if there's space
-    void addComponent() {
+    bool addComponent() {
         if (numComponents >= 7) {
             cout << "         Cannot add more components. Maximum of 7 components per unit.\n";
-            return;
+            return false;
         }
 
         string name, status;
         int quantity;
-        system("cls");
+        screen.clear();
         cout << "                                                 _________________________ \n";
     	cout << "                                                |  _____________________  |\n";
     	cout << "                                                |:|  ADD COMPONENT:____ |:|\n";
@@ -66,19 +381,20 @@ public:
         components[numComponents] = {name, quantity, status};
         numComponents++;
 
-        system("cls");
+        screen.clear();
         cout << "\n\n\n\n\n\n\n\n\n\n                                                 _________________________ \n";
     	cout << "                                                |  _____________________  |\n";
     	cout << "                                                |:|   COMPONENT ADDED   |:|\n";
     	cout << "                                                |:|_____________________|:|\n";
     	cout << "                                                |_________________________|\n";
+        return true;
     }
 
     // Method to edit a component
-    void editComponent(int componentIndex) {
+    bool editComponent(int componentIndex) {
        if (componentIndex < 0 || componentIndex >= numComponents) {
         	cout << "         Invalid component index.\n";
-        	return;
+        	return false;
    	 	}
 
     	string name, status;
@@ -123,7 +439,7 @@ public:
     // Update the component with the new details
     	components[componentIndex] = {name, quantity, status};
 
-    	system("cls");
+    	screen.clear();
 
     // Print the updated UI
     	cout << "\n\n\n\n\n\n\n\n\n\n                                                 _________________________ \n";
@@ -131,13 +447,14 @@ public:
     	cout << "                                                |:|  COMPONENT UPDATED  |:|\n";
     	cout << "                                                |:|_____________________|:|\n";
     	cout << "                                                |_________________________|\n";
+    	return true;
     }
 
     // Method to delete a component
-    void deleteComponent(int componentIndex) {
+    bool deleteComponent(int componentIndex) {
         if (componentIndex < 0 || componentIndex >= numComponents) {
             cout << "Invalid component index.\n";
-            return;
+            return false;
         }
 
         // Move the subsequent components to fill the deleted one
@@ -146,12 +463,13 @@ public:
         }
 
         numComponents--;
-        system("cls");
+        screen.clear();
         cout << "\n\n\n\n\n\n\n\n\n\n                                                 _________________________ \n";
     	cout << "                                                |  _____________________  |\n";
     	cout << "                                                |:| SUCCESSFULLY DELETE |:|\n";
     	cout << "                                                |:|_____________________|:|\n";
     	cout << "                                                |_________________________|\n";
+        return true;
     }
 
     // Method to display the details of the components in the unit
@@ -186,6 +504,232 @@ public:
     }
 };
 
+// CRC-32 (IEEE) of a block of bytes, to detect damaged records
+uint32_t crc32(const char* data, size_t size) {
+    // Built once, thread-safely, on first use
+    static const vector<uint32_t> table = []() {
+        vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Flushes a file and waits until it is on disk
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Cuts an open file back to size bytes and leaves it positioned at the end
+bool truncateFile(FILE* file, size_t size) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    bool ok = _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+    bool ok = ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+    return ok && fseek(file, 0, SEEK_END) == 0;
+}
+
+// Keeps the units on disk as a file of unit records plus a journal of
+// changed units beside it (path + ".journal"). Adding, editing or deleting
+// a component appends one record with that unit's components and syncs
+// it, so saving never rewrites the other units. load() reads the file,
+// replays the journal over it and, if the journal had anything in it,
+// writes a fresh file (to path + ".tmp", then renamed into place) and
+// empties the journal.
+//
+// Record: u32 length, u32 CRC-32 of the rest, u32 unit index, u32
+// component count, then per component the name as u32 length plus bytes,
+// i32 quantity and the status the same way as the name.
+class UnitDatabase {
+public:
+    explicit UnitDatabase(const string& path) : path(path), journal(0), tornJournal(false) {}
+
+    ~UnitDatabase() {
+        if (journal) {
+            fclose(journal);
+        }
+    }
+
+    // Loads the saved units. Returns false if there are none yet. A journal
+    // that cannot be folded into the file is kept, cut back to its whole
+    // records, and replayed next time.
+    bool load(Unit units[], int count) {
+        string data;
+        if (!readFile(path, data)) {
+            return false;
+        }
+        replay(data, units, count);
+        string changes;
+        if (readFile(path + ".journal", changes) && !changes.empty()) {
+            size_t whole = replay(changes, units, count);
+            if (!checkpoint(units, count)) {
+                cout << "         Could not compact " << path << "!\n";
+                // Records appended after a torn one would never be replayed
+                if (whole < changes.size()) {
+                    journal = fopen((path + ".journal").c_str(), "r+b");
+                    tornJournal = !journal || !truncateFile(journal, whole);
+                    if (tornJournal && journal) {
+                        fclose(journal);
+                        journal = 0;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    bool saveUnit(int index, const Unit& unit) {
+        if (!journal && !tornJournal) {
+            journal = fopen((path + ".journal").c_str(), "ab");
+        }
+        vector<char> record;
+        encode(record, index, unit);
+        return journal && fwrite(record.data(), 1, record.size(), journal) == record.size() && syncFile(journal);
+    }
+
+    // Writes every unit as the new file and empties the journal
+    bool checkpoint(const Unit units[], int count) {
+        vector<char> image;
+        for (int i = 0; i < count; i++) {
+            encode(image, i, units[i]);
+        }
+        string temporary = path + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fwrite(image.data(), 1, image.size(), file) == image.size() && syncFile(file);
+        fclose(file);
+#ifdef _WIN32
+        ok = ok && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+        if (!ok) {
+            remove(temporary.c_str());
+            return false;
+        }
+        if (journal) {
+            fclose(journal);
+        }
+        tornJournal = false;
+        journal = fopen((path + ".journal").c_str(), "wb");
+        return journal && syncFile(journal);
+    }
+
+private:
+    static bool readFile(const string& name, string& data) {
+        ifstream in(name.c_str(), ios::binary);
+        if (!in) {
+            return false;
+        }
+        data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        return true;
+    }
+
+    static void putInt(vector<char>& out, uint32_t value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    static void putText(vector<char>& out, const string& text) {
+        putInt(out, static_cast<uint32_t>(text.size()));
+        out.insert(out.end(), text.begin(), text.end());
+    }
+
+    static bool getInt(const char*& in, const char* end, uint32_t& value) {
+        if (end - in < 4) {
+            return false;
+        }
+        memcpy(&value, in, 4);
+        in += 4;
+        return true;
+    }
+
+    static bool getText(const char*& in, const char* end, string& text) {
+        uint32_t length;
+        if (!getInt(in, end, length) || static_cast<size_t>(end - in) < length) {
+            return false;
+        }
+        text.assign(in, length);
+        in += length;
+        return true;
+    }
+
+    static void encode(vector<char>& out, int index, const Unit& unit) {
+        size_t start = out.size();
+        out.resize(start + 8);
+        putInt(out, static_cast<uint32_t>(index));
+        putInt(out, static_cast<uint32_t>(unit.numComponents));
+        for (int i = 0; i < unit.numComponents; i++) {
+            putText(out, unit.components[i].name);
+            putInt(out, static_cast<uint32_t>(unit.components[i].quantity));
+            putText(out, unit.components[i].status);
+        }
+        uint32_t length = static_cast<uint32_t>(out.size() - start - 8);
+        uint32_t checksum = crc32(&out[start + 8], length);
+        memcpy(&out[start], &length, 4);
+        memcpy(&out[start + 4], &checksum, 4);
+    }
+
+    // Applies every whole record; stops at a torn or damaged one and
+    // returns how many bytes were applied
+    static size_t replay(const string& data, Unit units[], int count) {
+        const char* in = data.data();
+        const char* end = in + data.size();
+        const char* whole = in;
+        uint32_t length, checksum;
+        while (getInt(in, end, length) && getInt(in, end, checksum) && static_cast<size_t>(end - in) >= length
+               && crc32(in, length) == checksum) {
+            const char* recordEnd = in + length;
+            uint32_t index, numComponents, quantity;
+            if (!getInt(in, recordEnd, index) || !getInt(in, recordEnd, numComponents) || numComponents > 7) {
+                return whole - data.data();
+            }
+            Unit unit;
+            for (uint32_t i = 0; i < numComponents; i++) {
+                if (!getText(in, recordEnd, unit.components[i].name) || !getInt(in, recordEnd, quantity)
+                    || !getText(in, recordEnd, unit.components[i].status)) {
+                    return whole - data.data();
+                }
+                unit.components[i].quantity = static_cast<int>(quantity);
+            }
+            unit.numComponents = static_cast<int>(numComponents);
+            if (index < static_cast<uint32_t>(count)) {
+                units[index] = unit;
+            }
+            in = recordEnd;
+            whole = in;
+        }
+        return whole - data.data();
+    }
+
+    string path;
+    FILE* journal;
+    bool tornJournal;      // still ends in a torn record, so nothing may be appended
+};
+
 void invalidDisplay() {
 	cout << "\n\n\n\n\n\n\n\n\n\n                                      __-----_---__-----__-_---_-__----_-__--_-__\n";
 	cout << "                                     |  _______________________________________  |\n";
@@ -225,32 +769,35 @@ void displayMenu() {
     cout << "                                      +------------+       +--------------------------+ \n";
 }
 
-// Function to show the component options (Edit, Delete, Add, Back)
-void showComponentOptions(Unit& unit) {
+// Function to show the component options (Edit, Delete, Add, Back);
+// returns whether the unit was changed
+bool showComponentOptions(Unit& unit) {
     int choice, componentChoice;
+    bool changed = false;
 
     cout << "                                +------------+  +------------+  +------------+  +------------+\n";
     cout << "                                | [1] ADD    |  | [2] EDIT   |  | [3] DELETE |  | [4] BACK   |\n";
     cout << "                                +------------+  +------------+  +------------+  +------------+\n";
 
     // Wait for a single key press
+    screen.present();
     choice = _getch();  // This is used from conio.h (Windows-specific)
 
     if (choice == '1' || choice == '2' || choice == '3' || choice == '4') {
         choice -= '0';  // Convert char to integer
     } else {
-    	system("cls");
+    	screen.clear();
     	invalidDisplay();
-        return;
+        return false;
     }
 
     switch (choice) {
         case 1:  // Add component
-        	unit.addComponent();
+        	changed = unit.addComponent();
             break;
 
         case 2:  // Edit component
-        	system("cls");
+        	screen.clear();
         	cout << "                                                 _________________________ \n";
     		cout << "                                                |  _____________________  |\n";
     		cout << "                                                |:|  EDIT COMPONENT:___ |:|\n";
@@ -259,14 +806,14 @@ void showComponentOptions(Unit& unit) {
             cout << "         Enter component number (1 to 7) to edit: ";
             cin >> componentChoice;
             if (componentChoice >= 1 && componentChoice <= 7) {
-                unit.editComponent(componentChoice - 1);  // -1 for 0-indexed
+                changed = unit.editComponent(componentChoice - 1);  // -1 for 0-indexed
             } else {
                 cout << "         Invalid component number.\n";
             }
             break;
 
         case 3:  // Delete component
-        	system("cls");
+        	screen.clear();
         	cout << "                                                 _________________________ \n";
     		cout << "                                                |  _____________________  |\n";
     		cout << "                                                |:|  DELETE COMPONENT:_ |:|\n";
@@ -276,49 +823,60 @@ void showComponentOptions(Unit& unit) {
         	cout << "         Enter component number (1 to 7) to delete: ";
             cin >> componentChoice;
             if (componentChoice >= 1 && componentChoice <= 7) {
-                unit.deleteComponent(componentChoice - 1);  // -1 for 0-indexed
+                changed = unit.deleteComponent(componentChoice - 1);  // -1 for 0-indexed
             } else {
                 cout << "         Invalid component number.\n";
             }
             break;
 
         case 4:  // Back to main menu
-            return;
+            return false;
 
         default:
         	invalidDisplay();
             break;
     }
+    return changed;
 }
 
 // Main function
 int main() {
     srand(static_cast<unsigned>(time(0)));  // Seed for random number generation
 
+    // Draw through the in-process renderer from here on
+    screen.install();
+
     int choice, unitChoice;
 
     Unit units[20];  // Array to hold 20 units
+
+    // Load the saved units, or keep the new random ones on the first run
+    UnitDatabase database("units.db");
+    if (!database.load(units, 20)) {
+        database.checkpoint(units, 20);
+    }
     
     while (true) {
-        system("cls");
+        screen.clear();
 
         // Display grid and menu
         displayComponentGrid();
         displayMenu();
 
         // Wait for a user input (key press)
+        screen.present();
         choice = _getch();
         if (choice == '1' || choice == '2' || choice == '3') {
             choice -= '0';  // Convert char to integer
         } else {
-        	system("cls");
+        	screen.clear();
     		invalidDisplay();
             continue;
         }
 
         switch (choice) {
             case 1:  // Search functionality
-                system("cls");
+                screen.clear();
                 cout << "                                                 _________________________ \n";
     			cout << "                                                |  _____________________  |\n";
     			cout << "                                                |:|  SEARCH UNIT:_____  |:|\n";
@@ -328,9 +886,13 @@ int main() {
                 cin >> unitChoice;
                 if (unitChoice >= 1 && unitChoice <= 20) {
                     units[unitChoice - 1].displayComponents(unitChoice);  // Pass unitChoice instead of numComponents + 1
-                    showComponentOptions(units[unitChoice - 1]);  // Display Edit/Delete/Add options
+                    if (showComponentOptions(units[unitChoice - 1])) {  // Display Edit/Delete/Add options
+                        if (!database.saveUnit(unitChoice - 1, units[unitChoice - 1])) {
+                            cout << "         Could not save the change to units.db!\n";
+                        }
+                    }
                 } else {
-                	system("cls");
+                	screen.clear();
     				invalidDisplay();
                 }
                 cout << "\nPress any key to return to the main page...";
@@ -339,7 +901,7 @@ int main() {
                 break;
 
             case 2:  // Display all units
-                system("cls");
+                screen.clear();
                 cout << "                                                 _________________________\n";
                 cout << "                                                |  _____________________  |\n";
                 cout << "                                                |:|  DISPLAY ALL UNITS  |:|\n";
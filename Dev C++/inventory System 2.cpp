@@ -1,6 +1,26 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include <unordered_map>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -10,7 +30,911 @@ struct Computer {
     string position;
 };
 
-vector<Computer> inventory;
+// Handle to a computer in a ComputerStore. It stays valid, wherever the
+// computer moves, until that computer is deleted.
+struct ComputerHandle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Lowest set bit and number of set bits of a word
+int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, word);
+    return static_cast<int>(bit);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+int bitCount(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// A set of rows (positions in a ComputerStore) as one bit per row, so
+// AND, OR and NOT combine 64 rows per machine word
+class Bitmap {
+public:
+    explicit Bitmap(size_t rows = 0) : rows(rows), words((rows + 63) / 64, 0) {}
+
+    void set(size_t row) {
+        words[row >> 6] |= uint64_t(1) << (row & 63);
+    }
+
+    void reset(size_t row) {
+        words[row >> 6] &= ~(uint64_t(1) << (row & 63));
+    }
+
+    size_t size() const {
+        return rows;
+    }
+
+    // Grows (with the new rows clear) or shrinks to the given rows
+    void resize(size_t count) {
+        rows = count;
+        words.resize((rows + 63) / 64, 0);
+        if (rows % 64) {
+            words.back() &= (uint64_t(1) << (rows % 64)) - 1;
+        }
+    }
+
+    Bitmap &operator&=(const Bitmap &other) {
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] &= other.words[i];
+        }
+        return *this;
+    }
+
+    Bitmap &operator|=(const Bitmap &other) {
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] |= other.words[i];
+        }
+        return *this;
+    }
+
+    void flip() {
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] = ~words[i];
+        }
+        // Clear the bits past the last row
+        if (rows % 64) {
+            words.back() &= (uint64_t(1) << (rows % 64)) - 1;
+        }
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (size_t i = 0; i < words.size(); i++) {
+            total += bitCount(words[i]);
+        }
+        return total;
+    }
+
+    // Calls visit(row) for every row in the set, in order
+    template <class Visit>
+    void forEach(Visit visit) const {
+        for (size_t i = 0; i < words.size(); i++) {
+            for (uint64_t word = words[i]; word; word &= word - 1) {
+                visit(i * 64 + lowestBit(word));
+            }
+        }
+    }
+
+private:
+    size_t rows;
+    vector<uint64_t> words;
+};
+
+// The words of a component list, lower-cased: "Monitor, LAN Cable" has
+// "monitor", "lan" and "cable"
+void componentWords(const string &text, vector<string> &words) {
+    words.clear();
+    string word;
+    for (size_t i = 0; i <= text.size(); i++) {
+        if (i < text.size() && isalnum(static_cast<unsigned char>(text[i]))) {
+            word += static_cast<char>(tolower(static_cast<unsigned char>(text[i])));
+        } else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+}
+
+// The last number in a position ("Position 12", "Desk 12" -> 12), which
+// is what position ranges compare
+bool positionNumber(const string &position, long &number) {
+    size_t end = position.find_last_of("0123456789");
+    if (end == string::npos) {
+        return false;
+    }
+    size_t start = end;
+    while (start > 0 && isdigit(static_cast<unsigned char>(position[start - 1]))) {
+        start--;
+    }
+    number = atol(position.substr(start, end - start + 1).c_str());
+    return true;
+}
+
+string lowerCase(string text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = static_cast<char>(tolower(static_cast<unsigned char>(text[i])));
+    }
+    return text;
+}
+
+// Secondary indexes over the computers of a ComputerStore, which keeps
+// them in step as computers are added, changed and removed; rows are
+// places in the store. Each word of externalComponents has a sorted list
+// of the rows containing it (an inverted index); a word can be as rare as
+// one computer, so lists take less room than a bitmap per word, until a
+// word is common enough that its list would outgrow a bitmap. Positions
+// are kept as (number, row) pairs in an ordered set, so a range is a
+// search and a walk along the pairs it covers, and changing one is
+// O(log n).
+class ComputerIndex {
+public:
+    // Enters the computer at row, which is either empty or one past the
+    // last row
+    void insert(size_t row, const Computer &comp) {
+        if (row == rows) {
+            rows++;
+        }
+        componentWords(comp.externalComponents, words);
+        for (size_t i = 0; i < words.size(); i++) {
+            Rows &found = byWord[words[i]];
+            if (found.dense) {
+                if (found.bits.size() <= row) {
+                    found.bits.resize(rows);
+                }
+                found.bits.set(row);
+                continue;
+            }
+            // A word repeated within one computer is listed once
+            vector<uint32_t> &list = found.list;
+            vector<uint32_t>::iterator at = lower_bound(list.begin(), list.end(), static_cast<uint32_t>(row));
+            if (at == list.end() || *at != row) {
+                list.insert(at, static_cast<uint32_t>(row));
+            }
+            if (list.size() >= 64 && list.size() * 32 > rows) {
+                found.dense = true;
+                found.bits = Bitmap(rows);
+                for (size_t k = 0; k < list.size(); k++) {
+                    found.bits.set(list[k]);
+                }
+                vector<uint32_t>().swap(list);
+            }
+        }
+        long number;
+        if (positionNumber(comp.position, number)) {
+            positions.insert(make_pair(number, static_cast<uint32_t>(row)));
+        }
+    }
+
+    // Takes the computer at row out, leaving the row empty
+    void erase(size_t row, const Computer &comp) {
+        componentWords(comp.externalComponents, words);
+        for (size_t i = 0; i < words.size(); i++) {
+            unordered_map<string, Rows>::iterator found = byWord.find(words[i]);
+            if (found == byWord.end()) {
+                continue;
+            }
+            if (found->second.dense) {
+                found->second.bits.reset(row);
+                continue;
+            }
+            vector<uint32_t> &list = found->second.list;
+            vector<uint32_t>::iterator at = lower_bound(list.begin(), list.end(), static_cast<uint32_t>(row));
+            if (at != list.end() && *at == row) {
+                list.erase(at);
+            }
+            if (list.empty()) {
+                byWord.erase(found);
+            }
+        }
+        long number;
+        if (positionNumber(comp.position, number)) {
+            positions.erase(make_pair(number, static_cast<uint32_t>(row)));
+        }
+    }
+
+    // Drops the last row, which must be empty
+    void pop() {
+        rows--;
+    }
+
+    size_t size() const {
+        return rows;
+    }
+
+    Bitmap withWord(const string &word) const {
+        unordered_map<string, Rows>::const_iterator found = byWord.find(lowerCase(word));
+        if (found != byWord.end() && found->second.dense) {
+            Bitmap result = found->second.bits;
+            result.resize(rows);
+            return result;
+        }
+        Bitmap result(rows);
+        if (found != byWord.end()) {
+            const vector<uint32_t> &list = found->second.list;
+            for (size_t i = 0; i < list.size(); i++) {
+                result.set(list[i]);
+            }
+        }
+        return result;
+    }
+
+    // Rows first to end - 1, the computers at those places in the store
+    Bitmap inRows(size_t first, size_t end) const {
+        Bitmap result(rows);
+        for (size_t row = first; row < end && row < rows; row++) {
+            result.set(row);
+        }
+        return result;
+    }
+
+    // Rows whose position number is in [low, high]
+    Bitmap inPositions(long low, long high) const {
+        Bitmap result(rows);
+        set<pair<long, uint32_t> >::const_iterator it = positions.lower_bound(make_pair(low, uint32_t(0)));
+        for (; it != positions.end() && it->first <= high; ++it) {
+            result.set(it->second);
+        }
+        return result;
+    }
+
+private:
+    // Rows containing a word. Inserting into a list moves at most about a
+    // bitmap's worth of memory. A dense bitmap only grows when a row past
+    // its end is set; its bits past the last row are always clear.
+    struct Rows {
+        bool dense = false;
+        vector<uint32_t> list;
+        Bitmap bits;
+    };
+
+    size_t rows = 0;
+    unordered_map<string, Rows> byWord;
+    set<pair<long, uint32_t> > positions;
+    vector<string> words;     // scratch for componentWords()
+};
+
+// Computers indexed by id, so finding, editing and deleting one is O(1)
+// however large the fleet. The computers are kept packed in one vector
+// for scans; deleting one moves the last computer into its place
+// (swap-and-pop), so the order changes but ids and handles do not. A hash
+// index maps each id to a slot, and the slot records where its computer
+// currently is plus a generation that changes when it is deleted, which
+// is what makes old handles to it invalid. Freed slots are reused.
+// Ids are unique: add() refuses an id that is already taken.
+//
+// The store also keeps the ComputerIndex that queries use. Computers only
+// change through add(), update() and remove(), which adjust the indexes
+// for that one computer, so a query never has to index the fleet again.
+class ComputerStore {
+public:
+    typedef vector<Computer>::const_iterator const_iterator;
+
+    bool add(const Computer &comp, ComputerHandle *handle = 0) {
+        if (byId.count(comp.id)) {
+            return false;
+        }
+        uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot());
+            slots[slot].generation = 0;
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slots[slot].index = static_cast<uint32_t>(computers.size());
+        computers.push_back(comp);
+        slotOf.push_back(slot);
+        byId[comp.id] = slot;
+        indexes.insert(computers.size() - 1, comp);
+        if (handle) {
+            handle->slot = slot;
+            handle->generation = slots[slot].generation;
+        }
+        return true;
+    }
+
+    // The computer with an id, or null; a handle to it is stored if asked for
+    const Computer *find(int id, ComputerHandle *handle = 0) const {
+        unordered_map<int, uint32_t>::const_iterator it = byId.find(id);
+        if (it == byId.end()) {
+            return 0;
+        }
+        if (handle) {
+            handle->slot = it->second;
+            handle->generation = slots[it->second].generation;
+        }
+        return &computers[slots[it->second].index];
+    }
+
+    // The computer behind a handle, or null once it has been deleted
+    const Computer *get(ComputerHandle handle) const {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation) {
+            return 0;
+        }
+        return &computers[slots[handle.slot].index];
+    }
+
+    // Replaces the computer with the same id; false if there is none
+    bool update(const Computer &comp) {
+        unordered_map<int, uint32_t>::const_iterator it = byId.find(comp.id);
+        if (it == byId.end()) {
+            return false;
+        }
+        uint32_t index = slots[it->second].index;
+        indexes.erase(index, computers[index]);
+        computers[index] = comp;
+        indexes.insert(index, comp);
+        return true;
+    }
+
+    bool remove(int id) {
+        unordered_map<int, uint32_t>::iterator it = byId.find(id);
+        if (it == byId.end()) {
+            return false;
+        }
+        uint32_t slot = it->second;
+        uint32_t index = slots[slot].index;
+        indexes.erase(index, computers[index]);
+        uint32_t last = static_cast<uint32_t>(computers.size() - 1);
+        if (index != last) {
+            indexes.erase(last, computers[last]);
+            indexes.insert(index, computers[last]);
+            computers[index] = computers[last];
+            slotOf[index] = slotOf[last];
+            slots[slotOf[index]].index = index;
+        }
+        computers.pop_back();
+        slotOf.pop_back();
+        indexes.pop();
+        byId.erase(it);
+        slots[slot].generation++;
+        freeSlots.push_back(slot);
+        return true;
+    }
+
+    void reserve(size_t count) {
+        computers.reserve(count);
+        slotOf.reserve(count);
+        slots.reserve(count);
+        byId.reserve(count);
+    }
+
+    size_t size() const {
+        return computers.size();
+    }
+
+    // Computers in storage order
+    const Computer &operator[](size_t index) const {
+        return computers[index];
+    }
+
+    const_iterator begin() const {
+        return computers.begin();
+    }
+
+    const_iterator end() const {
+        return computers.end();
+    }
+
+    // Indexes over the computers, by storage order
+    const ComputerIndex &index() const {
+        return indexes;
+    }
+
+private:
+    struct Slot {
+        uint32_t index;       // position in computers while in use
+        uint32_t generation;
+    };
+
+    vector<Computer> computers;
+    vector<uint32_t> slotOf;  // slot of each computer, by position
+    vector<Slot> slots;
+    vector<uint32_t> freeSlots;
+    unordered_map<int, uint32_t> byId;
+    ComputerIndex indexes;
+};
+
+ComputerStore inventory;
+
+// Computers per row when "row N" splits the inventory, in the storage
+// order displayInventory() lists it, into rows
+const int TABLE_COLUMNS = 7;
+
+// A parsed query over the computers, e.g.
+//     row 3 AND has AVR
+//     (has LAN OR has AVR) AND NOT position 1-10
+// Conditions: "has <word>" (a word of the external components),
+// "position <n>" or "position <n>-<m>" (the number in the position), and
+// "row <n>" (the nth TABLE_COLUMNS computers listed). They combine with NOT,
+// AND and OR, in that order of precedence, and parentheses. Keywords and
+// words ignore case.
+class ComputerQuery {
+public:
+    // Returns false, with a message in error, if text is not a query
+    bool parse(const string &text, string &error) {
+        nodes.clear();
+        tokens.clear();
+        next = 0;
+        if (!tokenize(text, error)) {
+            return false;
+        }
+        if (tokens.empty()) {
+            error = "The query is empty";
+            return false;
+        }
+        root = parseOr(error);
+        if (root < 0) {
+            return false;
+        }
+        if (next < tokens.size()) {
+            error = "Unexpected '" + tokens[next] + "'";
+            return false;
+        }
+        return true;
+    }
+
+    // The rows of the index that match, a word of bits at a time
+    Bitmap evaluate(const ComputerIndex &index) const {
+        return evaluate(index, root);
+    }
+
+    // Whether one computer, at place row in the store, matches, by looking
+    // at its fields directly
+    bool matches(const Computer &comp, size_t row) const {
+        return matches(comp, row, root);
+    }
+
+private:
+    enum Kind { WORD, POSITION, ROW, AND, OR, NOT };
+
+    struct Node {
+        Kind kind;
+        string text;          // WORD
+        long low, high;       // POSITION, and ROW as storage indices [low, high)
+        int left, right;      // AND, OR and NOT (left only)
+    };
+
+    static bool isSymbol(char c) {
+        return c == '(' || c == ')' || c == '-';
+    }
+
+    bool tokenize(const string &text, string &error) {
+        size_t i = 0;
+        while (i < text.size()) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (isspace(c)) {
+                i++;
+            } else if (isSymbol(text[i])) {
+                tokens.push_back(string(1, text[i++]));
+            } else if (isalnum(c)) {
+                size_t start = i;
+                while (i < text.size() && isalnum(static_cast<unsigned char>(text[i]))) {
+                    i++;
+                }
+                tokens.push_back(text.substr(start, i - start));
+            } else {
+                error = "Unexpected '" + string(1, text[i]) + "'";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool accept(const string &keyword) {
+        if (next < tokens.size() && lowerCase(tokens[next]) == keyword) {
+            next++;
+            return true;
+        }
+        return false;
+    }
+
+    bool word(string &value, const string &what, string &error) {
+        if (next < tokens.size() && isalnum(static_cast<unsigned char>(tokens[next][0]))) {
+            value = tokens[next++];
+            return true;
+        }
+        error = "Expected " + what;
+        return false;
+    }
+
+    bool number(long &value, string &error) {
+        if (next < tokens.size() && isdigit(static_cast<unsigned char>(tokens[next][0]))) {
+            value = atol(tokens[next++].c_str());
+            return true;
+        }
+        error = "Expected a number";
+        return false;
+    }
+
+    int add(Kind kind, int left = -1, int right = -1) {
+        Node node;
+        node.kind = kind;
+        node.low = node.high = 0;
+        node.left = left;
+        node.right = right;
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    int parseOr(string &error) {
+        int left = parseAnd(error);
+        while (left >= 0 && accept("or")) {
+            int right = parseAnd(error);
+            left = right < 0 ? -1 : add(OR, left, right);
+        }
+        return left;
+    }
+
+    int parseAnd(string &error) {
+        int left = parseNot(error);
+        while (left >= 0 && accept("and")) {
+            int right = parseNot(error);
+            left = right < 0 ? -1 : add(AND, left, right);
+        }
+        return left;
+    }
+
+    int parseNot(string &error) {
+        if (accept("not")) {
+            int operand = parseNot(error);
+            return operand < 0 ? -1 : add(NOT, operand);
+        }
+        if (accept("(")) {
+            int inner = parseOr(error);
+            if (inner >= 0 && !accept(")")) {
+                error = "Expected ')'";
+                return -1;
+            }
+            return inner;
+        }
+        return parseCondition(error);
+    }
+
+    int parseCondition(string &error) {
+        string value;
+        long low, high;
+        if (accept("has")) {
+            if (!word(value, "a component word", error)) {
+                return -1;
+            }
+            int node = add(WORD);
+            nodes[node].text = lowerCase(value);
+            return node;
+        }
+        if (accept("row")) {
+            long row;
+            if (!number(row, error)) {
+                return -1;
+            }
+            int node = add(ROW);
+            nodes[node].low = row > 0 ? (row - 1) * TABLE_COLUMNS : 0;
+            nodes[node].high = row > 0 ? row * TABLE_COLUMNS : 0;
+            return node;
+        }
+        if (!accept("position")) {
+            error = next < tokens.size() ? "Unknown condition '" + tokens[next] + "'" : "Expected a condition";
+            return -1;
+        }
+        if (!number(low, error)) {
+            return -1;
+        }
+        high = low;
+        if (accept("-") && !number(high, error)) {
+            return -1;
+        }
+        int node = add(POSITION);
+        nodes[node].low = low;
+        nodes[node].high = high;
+        return node;
+    }
+
+    Bitmap evaluate(const ComputerIndex &index, int at) const {
+        const Node &node = nodes[at];
+        switch (node.kind) {
+            case WORD:
+                return index.withWord(node.text);
+            case POSITION:
+                return index.inPositions(node.low, node.high);
+            case ROW:
+                return index.inRows(node.low, node.high);
+            case NOT: {
+                Bitmap result = evaluate(index, node.left);
+                result.flip();
+                return result;
+            }
+            case AND: {
+                Bitmap result = evaluate(index, node.left);
+                result &= evaluate(index, node.right);
+                return result;
+            }
+            default: {
+                Bitmap result = evaluate(index, node.left);
+                result |= evaluate(index, node.right);
+                return result;
+            }
+        }
+    }
+
+    bool matches(const Computer &comp, size_t row, int at) const {
+        const Node &node = nodes[at];
+        switch (node.kind) {
+            case WORD: {
+                vector<string> words;
+                componentWords(comp.externalComponents, words);
+                return find(words.begin(), words.end(), node.text) != words.end();
+            }
+            case POSITION: {
+                long number;
+                return positionNumber(comp.position, number) && number >= node.low && number <= node.high;
+            }
+            case ROW:
+                return row >= static_cast<size_t>(node.low) && row < static_cast<size_t>(node.high);
+            case NOT:
+                return !matches(comp, row, node.left);
+            case AND:
+                return matches(comp, row, node.left) && matches(comp, row, node.right);
+            default:
+                return matches(comp, row, node.left) || matches(comp, row, node.right);
+        }
+    }
+
+    vector<Node> nodes;
+    vector<string> tokens;
+    size_t next = 0;
+    int root = -1;
+};
+
+// CRC-32 (IEEE) of a block of bytes, to detect damaged records
+uint32_t crc32(const char* data, size_t size) {
+    // Built once, thread-safely, on first use
+    static const vector<uint32_t> table = []() {
+        vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Flushes a file and waits until it is on disk
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Cuts an open file back to size bytes and leaves it positioned at the end
+bool truncateFile(FILE* file, size_t size) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    bool ok = _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+    bool ok = ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+    return ok && fseek(file, 0, SEEK_END) == 0;
+}
+
+// Keeps the inventory on disk as a file of records plus a journal of
+// changes beside it (path + ".journal"). Each add, edit or delete appends
+// one record for the computer it changed and syncs it, so saving never
+// rewrites the whole inventory. load() reads the file, replays the
+// journal over it and, if the journal had anything in it, writes a fresh
+// file (to path + ".tmp", then renamed into place) and empties the journal.
+//
+// Record: u32 length, u32 CRC-32 of the rest, u8 operation, then the
+// computer: i32 id and each text field as u32 length plus bytes. The file
+// holds an Add record per computer; Edit and Delete records name the
+// computer by id.
+class ComputerDatabase {
+public:
+    enum Operation : uint8_t {
+        ADD_COMPUTER = 1,
+        EDIT_COMPUTER = 2,
+        DELETE_COMPUTER = 3
+    };
+
+    explicit ComputerDatabase(const string& path) : path(path), journal(0), tornJournal(false) {}
+
+    ~ComputerDatabase() {
+        if (journal) {
+            fclose(journal);
+        }
+    }
+
+    // Loads the saved inventory. Returns false if there is none yet. A
+    // journal that cannot be folded into the file is kept, cut back to its
+    // whole records, and replayed next time.
+    bool load(ComputerStore& computers) {
+        string data;
+        if (!readFile(path, data)) {
+            return false;
+        }
+        replay(data, computers);
+        string changes;
+        if (readFile(path + ".journal", changes) && !changes.empty()) {
+            size_t whole = replay(changes, computers);
+            if (!checkpoint(computers)) {
+                cout << "Could not compact " << path << "!" << endl;
+                // Records appended after a torn one would never be replayed
+                if (whole < changes.size()) {
+                    journal = fopen((path + ".journal").c_str(), "r+b");
+                    tornJournal = !journal || !truncateFile(journal, whole);
+                    if (tornJournal && journal) {
+                        fclose(journal);
+                        journal = 0;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    bool save(Operation operation, const Computer& comp) {
+        if (!journal && !tornJournal) {
+            journal = fopen((path + ".journal").c_str(), "ab");
+        }
+        vector<char> record;
+        encode(record, operation, comp);
+        return journal && fwrite(record.data(), 1, record.size(), journal) == record.size() && syncFile(journal);
+    }
+
+    // Writes the whole inventory as the new file and empties the journal
+    bool checkpoint(const ComputerStore& computers) {
+        vector<char> image;
+        for (size_t i = 0; i < computers.size(); i++) {
+            encode(image, ADD_COMPUTER, computers[i]);
+        }
+        string temporary = path + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fwrite(image.data(), 1, image.size(), file) == image.size() && syncFile(file);
+        fclose(file);
+#ifdef _WIN32
+        ok = ok && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+        if (!ok) {
+            remove(temporary.c_str());
+            return false;
+        }
+        if (journal) {
+            fclose(journal);
+        }
+        tornJournal = false;
+        journal = fopen((path + ".journal").c_str(), "wb");
+        return journal && syncFile(journal);
+    }
+
+private:
+    static bool readFile(const string& name, string& data) {
+        ifstream in(name.c_str(), ios::binary);
+        if (!in) {
+            return false;
+        }
+        data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        return true;
+    }
+
+    static void putInt(vector<char>& out, uint32_t value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    static void putText(vector<char>& out, const string& text) {
+        putInt(out, static_cast<uint32_t>(text.size()));
+        out.insert(out.end(), text.begin(), text.end());
+    }
+
+    static bool getInt(const char*& in, const char* end, uint32_t& value) {
+        if (end - in < 4) {
+            return false;
+        }
+        memcpy(&value, in, 4);
+        in += 4;
+        return true;
+    }
+
+    static bool getText(const char*& in, const char* end, string& text) {
+        uint32_t length;
+        if (!getInt(in, end, length) || static_cast<size_t>(end - in) < length) {
+            return false;
+        }
+        text.assign(in, length);
+        in += length;
+        return true;
+    }
+
+    static void encode(vector<char>& out, Operation operation, const Computer& comp) {
+        size_t start = out.size();
+        out.resize(start + 8);
+        out.push_back(static_cast<char>(operation));
+        putInt(out, static_cast<uint32_t>(comp.id));
+        putText(out, comp.externalComponents);
+        putText(out, comp.position);
+        uint32_t length = static_cast<uint32_t>(out.size() - start - 8);
+        uint32_t checksum = crc32(&out[start + 8], length);
+        memcpy(&out[start], &length, 4);
+        memcpy(&out[start + 4], &checksum, 4);
+    }
+
+    // Applies every whole record; stops at a torn or damaged one and
+    // returns how many bytes were applied
+    static size_t replay(const string& data, ComputerStore& computers) {
+        const char* in = data.data();
+        const char* end = in + data.size();
+        const char* whole = in;
+        uint32_t length, checksum, id;
+        while (getInt(in, end, length) && getInt(in, end, checksum) && static_cast<size_t>(end - in) >= length
+               && length > 0 && crc32(in, length) == checksum) {
+            const char* recordEnd = in + length;
+            Operation operation = static_cast<Operation>(*in++);
+            Computer comp;
+            if (!getInt(in, recordEnd, id) || !getText(in, recordEnd, comp.externalComponents)
+                || !getText(in, recordEnd, comp.position)) {
+                return whole - data.data();
+            }
+            comp.id = static_cast<int>(id);
+            apply(operation, comp, computers);
+            in = recordEnd;
+            whole = in;
+        }
+        return whole - data.data();
+    }
+
+    static void apply(Operation operation, const Computer& comp, ComputerStore& computers) {
+        if (operation == ADD_COMPUTER) {
+            computers.add(comp);
+        } else if (operation == EDIT_COMPUTER) {
+            computers.update(comp);
+        } else {
+            computers.remove(comp.id);
+        }
+    }
+
+    string path;
+    FILE* journal;
+    bool tornJournal;      // still ends in a torn record, so nothing may be appended
+};
+
+ComputerDatabase database("computers.db");
+
+// Appends one change to the journal
+void saveChange(ComputerDatabase::Operation operation, const Computer &comp) {
+    if (!database.save(operation, comp)) {
+        cout << "Could not save the change to computers.db!" << endl;
+    }
+}
 
 void initializeInventory() {
     for (int i = 1; i <= 34; ++i) {
@@ -18,7 +942,7 @@ void initializeInventory() {
         comp.id = i;
         comp.externalComponents = "External Component " + to_string(i);
         comp.position = "Position " + to_string(i);
-        inventory.push_back(comp);
+        inventory.add(comp);
     }
 }
 
@@ -30,12 +954,17 @@ void addComputer() {
     Computer comp;
     cout << "Enter Computer ID: ";
     cin >> comp.id;
+    if (inventory.find(comp.id)) {
+        cout << "Computer ID already exists!" << endl;
+        return;
+    }
     cout << "Enter External Components: ";
     cin.ignore();
     getline(cin, comp.externalComponents);
     cout << "Enter Position: ";
     getline(cin, comp.position);
-    inventory.push_back(comp);
+    inventory.add(comp);
+    saveChange(ComputerDatabase::ADD_COMPUTER, comp);
     cout << "Computer added successfully!" << endl;
 }
 
@@ -43,47 +972,70 @@ void editComputer() {
     int id;
     cout << "Enter Computer ID to edit: ";
     cin >> id;
-    for (auto &comp : inventory) {
-        if (comp.id == id) {
-            cout << "Enter new External Components: ";
-            cin.ignore();
-            getline(cin, comp.externalComponents);
-            cout << "Enter new Position: ";
-            getline(cin, comp.position);
-            cout << "Computer updated successfully!" << endl;
-            return;
-        }
+    // The prompts show the current values through a handle to the computer
+    ComputerHandle handle;
+    if (!inventory.find(id, &handle)) {
+        cout << "Computer not found!" << endl;
+        return;
     }
-    cout << "Computer not found!" << endl;
+    Computer comp;
+    comp.id = id;
+    cout << "Enter new External Components (now " << inventory.get(handle)->externalComponents << "): ";
+    cin.ignore();
+    getline(cin, comp.externalComponents);
+    cout << "Enter new Position (now " << inventory.get(handle)->position << "): ";
+    getline(cin, comp.position);
+    inventory.update(comp);
+    saveChange(ComputerDatabase::EDIT_COMPUTER, comp);
+    cout << "Computer updated successfully!" << endl;
 }
 
 void deleteComputer() {
     int id;
     cout << "Enter Computer ID to delete: ";
     cin >> id;
-    for (auto it = inventory.begin(); it != inventory.end(); ++it) {
-        if (it->id == id) {
-            inventory.erase(it);
-            cout << "Computer deleted successfully!" << endl;
-            return;
-        }
+    const Computer *comp = inventory.find(id);
+    if (!comp) {
+        cout << "Computer not found!" << endl;
+        return;
     }
-    cout << "Computer not found!" << endl;
+    saveChange(ComputerDatabase::DELETE_COMPUTER, *comp);
+    inventory.remove(id);
+    cout << "Computer deleted successfully!" << endl;
 }
 
 void searchComputer() {
     int id;
     cout << "Enter Computer ID to search: ";
     cin >> id;
-    for (const auto &comp : inventory) {
-        if (comp.id == id) {
-            cout << "Computer ID: " << comp.id << endl;
-            cout << "External Components: " << comp.externalComponents << endl;
-            cout << "Position: " << comp.position << endl;
-            return;
-        }
+    const Computer *comp = inventory.find(id);
+    if (!comp) {
+        cout << "Computer not found!" << endl;
+        return;
     }
-    cout << "Computer not found!" << endl;
+    cout << "Computer ID: " << comp->id << endl;
+    cout << "External Components: " << comp->externalComponents << endl;
+    cout << "Position: " << comp->position << endl;
+}
+
+// Finds the computers matching a query, e.g. row 3 AND has AVR
+void queryComputers() {
+    string text, error;
+    cout << "Enter query (e.g. row 3 AND has AVR OR has LAN): ";
+    cin.ignore();
+    getline(cin, text);
+    ComputerQuery query;
+    if (!query.parse(text, error)) {
+        cout << "Invalid query: " << error << endl;
+        return;
+    }
+    Bitmap found = query.evaluate(inventory.index());
+    found.forEach([](size_t row) {
+        const Computer &comp = inventory[row];
+        cout << "ID: " << comp.id << ", External Components: " << comp.externalComponents
+             << ", Position: " << comp.position << endl;
+    });
+    cout << found.count() << " computer(s) found." << endl;
 }
 
 void displayMenu() {
@@ -91,7 +1043,8 @@ void displayMenu() {
     cout << "2. Edit Computer" << endl;
     cout << "3. Delete Computer" << endl;
     cout << "4. Search Computer" << endl;
-    cout << "5. Exit" << endl;
+    cout << "5. Query Computers" << endl;
+    cout << "6. Exit" << endl;
 }
 
 void displayInventory() {
@@ -101,8 +1054,194 @@ void displayInventory() {
     }
 }
 
-int main() {
-    initializeInventory();
+// Compare finding and deleting computers by id in a plain vector, scanned
+// the way editComputer() and deleteComputer() used to, with ComputerStore
+void runBenchmark(int count, int lookups) {
+    typedef chrono::steady_clock Clock;
+    int deletes = min(lookups / 5, count / 2);
+    cout << "Benchmark: " << count << " computers, " << lookups << " lookups and " << deletes << " deletes by id" << endl;
+
+    vector<Computer> scanned;
+    ComputerStore indexed;
+    vector<ComputerHandle> handles(count);
+    scanned.reserve(count);
+    indexed.reserve(count);
+    for (int i = 1; i <= count; ++i) {
+        Computer comp;
+        comp.id = i;
+        comp.externalComponents = "Monitor, Keyboard, Mouse";
+        comp.position = "Position " + to_string(i);
+        scanned.push_back(comp);
+        indexed.add(comp, &handles[i - 1]);
+    }
+    mt19937 rng(1);
+    uniform_int_distribution<int> pick(1, count);
+    vector<int> ids(lookups);
+    for (auto &id : ids) {
+        id = pick(rng);
+    }
+    vector<int> order(count);
+    for (int i = 0; i < count; ++i) {
+        order[i] = i + 1;
+    }
+    shuffle(order.begin(), order.end(), rng);
+
+    long long scanFound = 0, indexFound = 0, handleFound = 0;
+    Clock::time_point start = Clock::now();
+    for (int id : ids) {
+        for (const auto &comp : scanned) {
+            if (comp.id == id) {
+                scanFound++;
+                break;
+            }
+        }
+    }
+    double scanLookup = chrono::duration<double, micro>(Clock::now() - start).count() / lookups;
+    start = Clock::now();
+    for (int id : ids) {
+        indexFound += indexed.find(id) != 0;
+    }
+    double indexLookup = chrono::duration<double, micro>(Clock::now() - start).count() / lookups;
+    start = Clock::now();
+    for (int id : ids) {
+        handleFound += indexed.get(handles[id - 1]) != 0;
+    }
+    double handleLookup = chrono::duration<double, micro>(Clock::now() - start).count() / lookups;
+
+    start = Clock::now();
+    for (int i = 0; i < deletes; ++i) {
+        for (auto it = scanned.begin(); it != scanned.end(); ++it) {
+            if (it->id == order[i]) {
+                scanned.erase(it);
+                break;
+            }
+        }
+    }
+    double scanDelete = chrono::duration<double, micro>(Clock::now() - start).count() / max(deletes, 1);
+    start = Clock::now();
+    for (int i = 0; i < deletes; ++i) {
+        indexed.remove(order[i]);
+    }
+    double indexDelete = chrono::duration<double, micro>(Clock::now() - start).count() / max(deletes, 1);
+
+    // Handles to deleted computers must be refused, the rest still reach
+    // their computer although the deletes moved many of them
+    int stale = 0, wrong = 0;
+    for (int i = 0; i < count; ++i) {
+        const Computer *comp = indexed.get(handles[i]);
+        if (!comp) {
+            stale++;
+        } else if (comp->id != i + 1) {
+            wrong++;
+        }
+    }
+
+    cout << fixed << setprecision(3);
+    cout << "lookup: scan " << scanLookup << " us, index " << indexLookup << " us, handle " << handleLookup
+         << " us (" << scanFound << "/" << indexFound << "/" << handleFound << " found)" << endl;
+    cout << "delete: scan " << scanDelete << " us, index " << indexDelete << " us (" << scanned.size() << "/" << indexed.size() << " left)" << endl;
+    cout << "handles after deletes: " << stale << " refused, " << wrong << " wrong" << endl;
+}
+
+// Compare answering queries by checking every computer against combining
+// bitmaps from the indexes the store keeps, and time what keeping them
+// costs when filling the store and editing computers
+void runQueryBenchmark(int count, int repeats) {
+    const char *parts[] = {"Monitor", "Keyboard", "Mouse", "LAN Cable", "AVR", "Headset", "Webcam", "Printer"};
+    ComputerStore computers;
+    computers.reserve(count);
+    mt19937 rng(1);
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for (int i = 1; i <= count; ++i) {
+        Computer comp;
+        comp.id = i;
+        unsigned mask = rng();
+        for (int p = 0; p < 8; ++p) {
+            if (mask & (1u << p)) {
+                comp.externalComponents += (comp.externalComponents.empty() ? "" : ", ") + string(parts[p]);
+            }
+        }
+        comp.position = "Position " + to_string(i);
+        computers.add(comp);
+    }
+    vector<string> queries = {
+        "has Headset AND has AVR",
+        "has LAN OR has Webcam OR has Printer",
+        "NOT has Monitor AND position 1-" + to_string(count / 2),
+        "has Mouse AND NOT has LAN AND position " + to_string(count / 4) + "-" + to_string(count * 3 / 4),
+        "(has AVR OR has Headset) AND NOT (has Monitor OR has Keyboard)"
+    };
+    cout << "Query benchmark: " << count << " computers, " << queries.size() << " queries, best of " << repeats << endl;
+
+    double fill = chrono::duration<double, milli>(Clock::now() - start).count();
+    cout << fixed << setprecision(3);
+    cout << "fill store and indexes: " << fill << " ms" << endl;
+
+    // Edits swap one part of a random computer for another, which moves it
+    // between two word lists
+    int edits = min(count, 1000);
+    start = Clock::now();
+    for (int i = 0; i < edits; ++i) {
+        Computer comp = *computers.find(static_cast<int>(rng() % count) + 1);
+        const char *part = parts[rng() % 8];
+        size_t at = comp.externalComponents.find(part);
+        if (at == string::npos) {
+            comp.externalComponents += (comp.externalComponents.empty() ? "" : ", ") + string(part);
+        } else {
+            comp.externalComponents.erase(at, strlen(part));
+        }
+        computers.update(comp);
+    }
+    cout << "edit (indexes kept in step): "
+         << chrono::duration<double, micro>(Clock::now() - start).count() / max(edits, 1) << " us" << endl;
+    const ComputerIndex &index = computers.index();
+
+    for (const string &text : queries) {
+        ComputerQuery query;
+        string error;
+        if (!query.parse(text, error)) {
+            cout << text << ": " << error << endl;
+            continue;
+        }
+        double scanBest = 1e18, bitmapBest = 1e18;
+        size_t scanned = 0, indexed = 0;
+        for (int r = 0; r < repeats; ++r) {
+            start = Clock::now();
+            scanned = 0;
+            for (size_t row = 0; row < computers.size(); ++row) {
+                scanned += query.matches(computers[row], row);
+            }
+            scanBest = min(scanBest, chrono::duration<double, milli>(Clock::now() - start).count());
+            start = Clock::now();
+            indexed = query.evaluate(index).count();
+            bitmapBest = min(bitmapBest, chrono::duration<double, milli>(Clock::now() - start).count());
+        }
+        cout << text << endl;
+        cout << "    scan " << scanBest << " ms, bitmaps " << bitmapBest << " ms (" << scanned << "/" << indexed << " found)" << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Usage: program [--bench [computers] [lookups] | --bench-query [computers] [repeats]]
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        int count = argc > 2 ? atoi(argv[2]) : 1000000;
+        int lookups = argc > 3 ? atoi(argv[3]) : 1000;
+        runBenchmark(count > 1 ? count : 2, lookups > 0 ? lookups : 1);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-query") {
+        int count = argc > 2 ? atoi(argv[2]) : 1000000;
+        int repeats = argc > 3 ? atoi(argv[3]) : 5;
+        runQueryBenchmark(count > 0 ? count : 1, repeats > 0 ? repeats : 1);
+        return 0;
+    }
+
+    // Load the saved inventory, or create it on the first run
+    if (!database.load(inventory)) {
+        initializeInventory();
+        database.checkpoint(inventory);
+    }
     int choice;
     while (true) {
         displayInventory();
@@ -123,6 +1262,9 @@ int main() {
                 searchComputer();
                 break;
             case 5:
+                queryComputers();
+                break;
+            case 6:
                 return 0;
             default:
                 cout << "Invalid choice! Please try again." << endl;
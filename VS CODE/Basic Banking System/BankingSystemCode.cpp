@@ -1,87 +1,6089 @@
 #include <iostream>
+#include <fstream>
 #include <unordered_map>
+#include <map>
+#include <deque>
 #include <vector>
+#include <array>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <memory_resource>
+#include <algorithm>
+#include <utility>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <charconv>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+    #include <psapi.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define BANK_SHA_NI
+#endif
 
+// Outcome of a balance-changing operation. The menu turns these into messages.
+enum class TxnStatus : std::uint8_t {
+    Ok,
+    InvalidAmount,
+    InsufficientFunds,
+    AccountNotFound,
+    SameAccount,
+    Overflow,
+    LimitExceeded,
+    ReadOnly,
+    NotDurable
+};
+
+const char* describeStatus(TxnStatus status) {
+    switch (status) {
+        case TxnStatus::Ok: return "OK";
+        case TxnStatus::InvalidAmount: return "Invalid amount.";
+        case TxnStatus::InsufficientFunds: return "Insufficient funds.";
+        case TxnStatus::AccountNotFound: return "Account not found.";
+        case TxnStatus::SameAccount: return "Cannot transfer to the same account.";
+        case TxnStatus::Overflow: return "Amount would overflow the balance.";
+        case TxnStatus::LimitExceeded: return "Velocity limit exceeded; try again later.";
+        case TxnStatus::ReadOnly: return "This is a read-only replica.";
+        case TxnStatus::NotDurable: return "The transaction log could not be written; the change may be lost.";
+    }
+    return "Unknown error.";
+}
+
+// Per-operation call counts, outcome counts and latency histograms.
+// Building with -DBANK_NO_METRICS compiles every probe out.
+//
+// Each thread records into its own shard with plain relaxed loads and
+// stores (a shard has a single writer, so no read-modify-write or shared
+// cache line is needed); report() sums the shards on demand. Every call
+// and outcome is counted, but reading a clock twice costs about as much
+// as a deposit itself, so each thread times only one in SAMPLE_EVERY
+// calls of each operation. Latencies are taken in CPU timestamp-counter
+// ticks where available and scaled to nanoseconds only when reported.
+// Histograms are HDR-style log-linear: 16 linear sub-buckets per power of
+// two, so any recorded latency is known to within 1/16 (6.25%).
+// A thread's shard goes back to a free list when the thread exits and is
+// reused, counts and all, by the next thread that starts recording.
+class Metrics {
+    static const std::size_t SUB_BITS = 4;
+    static const std::size_t SUB_BUCKETS = 1 << SUB_BITS;
+    // Values below 2^40 ticks (minutes at any clock rate) get their own
+    // bucket; the rest share the last one.
+    static const std::size_t MAX_BITS = 40;
+    static const std::size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+    static const std::uint32_t SAMPLE_EVERY = 8;
+
+    struct OpCounters;
+
+public:
+    enum class Op : std::uint8_t {OpenAccount, GetAccount, Deposit, Withdraw, Transfer, ApplyBatch};
+    static const std::size_t OP_COUNT = 6;
+    static const std::size_t STATUS_COUNT = 9;
+
+    // Times one operation from construction to finish() (or destruction,
+    // which counts as TxnStatus::Ok).
+    class Timer {
+    public:
+        explicit Timer(Op op) : counters(localShard().ops[static_cast<std::size_t>(op)]), start(counters.sample() ? ticks() : 0) {}
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        ~Timer() {
+            if (!finished) {
+                finish(TxnStatus::Ok);
+            }
+        }
+
+        TxnStatus finish(TxnStatus status) {
+            bump(counters.statuses[static_cast<std::size_t>(status)], 1);
+            if (start != 0) {
+                std::uint64_t elapsed = ticks() - start;
+                bump(counters.totalTicks, elapsed);
+                bump(counters.buckets[bucketOf(elapsed)], 1);
+            }
+            finished = true;
+            return status;
+        }
+
+    private:
+        OpCounters &counters;
+        std::uint64_t start;
+        bool finished = false;
+    };
+
+    struct OpReport {
+        std::uint64_t calls = 0;
+        std::uint64_t samples = 0;
+        std::uint64_t statuses[STATUS_COUNT] = {};
+        std::uint64_t totalTicks = 0;
+        std::uint64_t buckets[BUCKETS];
+        double nanosPerTick = 1.0;
+
+        OpReport() {
+            std::fill(buckets, buckets + BUCKETS, 0);
+        }
+
+        double meanNanos() const {
+            return samples ? static_cast<double>(totalTicks) * nanosPerTick / static_cast<double>(samples) : 0.0;
+        }
+
+        // Upper bound of the bucket holding the q-th quantile, in ns.
+        std::uint64_t quantile(double q) const {
+            std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(samples));
+            std::uint64_t seen = 0;
+            for (std::size_t b = 0; b < BUCKETS; b++) {
+                seen += buckets[b];
+                if (seen > rank) {
+                    return static_cast<std::uint64_t>(static_cast<double>(bucketLimit(b)) * nanosPerTick);
+                }
+            }
+            return 0;
+        }
+    };
+
+    // Sums every shard into one report per operation.
+    static std::vector<OpReport> report() {
+        std::vector<OpReport> reports(OP_COUNT);
+        double scale = nanosPerTick();
+        for (OpReport &report : reports) {
+            report.nanosPerTick = scale;
+        }
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const std::unique_ptr<Shard> &shard : registry.shards) {
+            for (std::size_t o = 0; o < OP_COUNT; o++) {
+                const OpCounters &counters = shard->ops[o];
+                OpReport &report = reports[o];
+                for (std::size_t s = 0; s < STATUS_COUNT; s++) {
+                    std::uint64_t n = counters.statuses[s].load(std::memory_order_relaxed);
+                    report.statuses[s] += n;
+                    report.calls += n;
+                }
+                report.totalTicks += counters.totalTicks.load(std::memory_order_relaxed);
+                for (std::size_t b = 0; b < BUCKETS; b++) {
+                    std::uint64_t n = counters.buckets[b].load(std::memory_order_relaxed);
+                    report.buckets[b] += n;
+                    report.samples += n;
+                }
+            }
+        }
+        return reports;
+    }
+
+    static void writeText(std::ostream &out) {
+        std::vector<OpReport> reports = report();
+        out << "operation        calls     mean(us)  p50(us)   p99(us)   p99.9(us)  failures" << std::endl;
+        for (std::size_t o = 0; o < OP_COUNT; o++) {
+            const OpReport &r = reports[o];
+            if (r.calls == 0) {
+                continue;
+            }
+            char line[160];
+            if (r.samples == 0) {
+                std::snprintf(line, sizeof(line), "%-14s %7llu %10s %9s %9s %10s ", opName(o),
+                              static_cast<unsigned long long>(r.calls), "-", "-", "-", "-");
+            } else {
+                std::snprintf(line, sizeof(line), "%-14s %7llu %10.2f %9.2f %9.2f %10.2f ", opName(o),
+                              static_cast<unsigned long long>(r.calls), r.meanNanos() / 1000.0,
+                              r.quantile(0.50) / 1000.0, r.quantile(0.99) / 1000.0, r.quantile(0.999) / 1000.0);
+            }
+            out << line;
+            bool any = false;
+            for (std::size_t s = 1; s < STATUS_COUNT; s++) {
+                if (r.statuses[s] != 0) {
+                    out << (any ? ", " : " ") << describeStatus(static_cast<TxnStatus>(s)) << " x" << r.statuses[s];
+                    any = true;
+                }
+            }
+            out << (any ? "" : " none") << std::endl;
+        }
+    }
+
+    static void writeJson(std::ostream &out) {
+        std::vector<OpReport> reports = report();
+        out << "{";
+        for (std::size_t o = 0; o < OP_COUNT; o++) {
+            const OpReport &r = reports[o];
+            out << (o ? "," : "") << "\"" << opName(o) << "\":{\"calls\":" << r.calls
+                << ",\"samples\":" << r.samples << ",\"meanNs\":" << static_cast<std::uint64_t>(r.meanNanos()) << ",\"p50Ns\":" << r.quantile(0.50) << ",\"p90Ns\":" << r.quantile(0.90)
+                << ",\"p99Ns\":" << r.quantile(0.99) << ",\"p999Ns\":" << r.quantile(0.999) << ",\"statuses\":{";
+            for (std::size_t s = 0; s < STATUS_COUNT; s++) {
+                out << (s ? "," : "") << "\"" << statusName(s) << "\":" << r.statuses[s];
+            }
+            out << "}}";
+        }
+        out << "}" << std::endl;
+    }
+
+private:
+    struct OpCounters {
+        std::atomic<std::uint64_t> statuses[STATUS_COUNT] = {};
+        std::atomic<std::uint64_t> totalTicks{0};
+        std::atomic<std::uint64_t> buckets[BUCKETS] = {};
+        // Only ever touched by the owning thread.
+        std::uint32_t untilSample = 1;
+
+        bool sample() {
+            if (--untilSample != 0) {
+                return false;
+            }
+            untilSample = SAMPLE_EVERY;
+            return true;
+        }
+    };
+
+    struct Shard {
+        OpCounters ops[OP_COUNT];
+    };
+
+    struct Registry {
+        std::uint64_t startTicks = ticks();
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::vector<Shard *> freeShards;
+    };
+
+    // Hands a shard to the calling thread and takes it back at thread exit.
+    struct ShardLease {
+        Shard *shard = nullptr;
+
+        ~ShardLease() {
+            if (shard) {
+                Registry &registry = getRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.freeShards.push_back(shard);
+            }
+        }
+    };
+
+    static Registry &getRegistry() {
+        // Never destroyed, so threads that outlive main() can still return
+        // their shards.
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+
+    static Shard &localShard() {
+        // A plain pointer, so the fast path needs no thread_local guard.
+        thread_local Shard *shard = nullptr;
+        if (!shard) {
+            shard = leaseShard();
+        }
+        return *shard;
+    }
+
+    static Shard *leaseShard() {
+        thread_local ShardLease lease;
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.freeShards.empty()) {
+            registry.shards.emplace_back(new Shard());
+            lease.shard = registry.shards.back().get();
+        } else {
+            lease.shard = registry.freeShards.back();
+            registry.freeShards.pop_back();
+        }
+        return lease.shard;
+    }
+
+    static void bump(std::atomic<std::uint64_t> &counter, std::uint64_t by) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    static std::uint64_t ticks() {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        return __builtin_ia32_rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Calibrates ticks against steady_clock over the time since the first
+    // shard was leased, so the estimate sharpens as the process runs.
+    static double nanosPerTick() {
+        Registry &registry = getRegistry();
+        std::uint64_t tickDelta = ticks() - registry.startTicks;
+        std::chrono::nanoseconds clockDelta = std::chrono::steady_clock::now() - registry.startTime;
+        if (tickDelta == 0 || clockDelta.count() <= 0) {
+            return 1.0;
+        }
+        return static_cast<double>(clockDelta.count()) / static_cast<double>(tickDelta);
+    }
+
+    static std::size_t bucketOf(std::uint64_t elapsed) {
+        if (elapsed < SUB_BUCKETS) {
+            return static_cast<std::size_t>(elapsed);
+        }
+        std::size_t exponent = 63 - static_cast<std::size_t>(countLeadingZeros(elapsed));
+        if (exponent >= MAX_BITS) {
+            return BUCKETS - 1;
+        }
+        std::size_t mantissa = static_cast<std::size_t>(elapsed >> (exponent - SUB_BITS));
+        return (exponent - SUB_BITS + 1) * SUB_BUCKETS + (mantissa - SUB_BUCKETS);
+    }
+
+    static std::uint64_t bucketLimit(std::size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        std::size_t exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+        std::uint64_t mantissa = bucket % SUB_BUCKETS + SUB_BUCKETS;
+        return ((mantissa + 1) << (exponent - SUB_BITS)) - 1;
+    }
+
+    static int countLeadingZeros(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_clzll(value);
+#else
+        int zeros = 0;
+        for (std::uint64_t bit = std::uint64_t(1) << 63; !(value & bit); bit >>= 1) {
+            zeros++;
+        }
+        return zeros;
+#endif
+    }
+
+    static const char* opName(std::size_t op) {
+        static const char* const names[OP_COUNT] = {"openAccount", "getAccount", "deposit", "withdraw", "transfer", "applyBatch"};
+        return names[op];
+    }
+
+    static const char* statusName(std::size_t status) {
+        static const char* const names[STATUS_COUNT] = {"ok", "invalidAmount", "insufficientFunds", "accountNotFound", "sameAccount", "overflow", "limitExceeded", "readOnly", "notDurable"};
+        return names[status];
+    }
+};
+
+// BANK_TIMED(Op) starts timing the enclosing function as that operation;
+// BANK_RESULT(status) records the outcome and evaluates to status.
+#ifdef BANK_NO_METRICS
+    #define BANK_TIMED(op)
+    #define BANK_RESULT(status) (status)
+#else
+    #define BANK_TIMED(op) Metrics::Timer metricsTimer(Metrics::Op::op)
+    #define BANK_RESULT(status) metricsTimer.finish(status)
+#endif
+
+// Fixed-point amount of money in minor units (cents). Arithmetic is exact
+// integer arithmetic; the checked operations report overflow instead of
+// wrapping around, and callers turn that into TxnStatus::Overflow.
+class Money {
+public:
+    static const std::int64_t MINOR_PER_MAJOR = 100;
+
+    constexpr Money() : cents(0) {}
+
+    static constexpr Money fromCents(std::int64_t cents) {
+        return Money(cents);
+    }
+
+    constexpr std::int64_t minorUnits() const {
+        return cents;
+    }
+
+    // Parses a decimal amount such as "12", "12.3" or "-0.05". More than two
+    // fraction digits or a value outside the int64 range is rejected.
+    static bool parse(std::string_view text, Money &out) {
+        std::size_t i = 0;
+        bool negative = false;
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            negative = text[i] == '-';
+            i++;
+        }
+        std::int64_t value = 0;
+        int digits = 0;
+        int fractionDigits = -1;
+        for (; i < text.size(); i++) {
+            char c = text[i];
+            if (c == '.' && fractionDigits < 0) {
+                fractionDigits = 0;
+                continue;
+            }
+            if (c < '0' || c > '9' || fractionDigits == 2) {
+                return false;
+            }
+            if (!mulAdd(value, 10, c - '0', value)) {
+                return false;
+            }
+            digits++;
+            if (fractionDigits >= 0) {
+                fractionDigits++;
+            }
+        }
+        if (digits == 0) {
+            return false;
+        }
+        for (int f = fractionDigits < 0 ? 0 : fractionDigits; f < 2; f++) {
+            if (!mulAdd(value, 10, 0, value)) {
+                return false;
+            }
+        }
+        out = Money(negative ? -value : value);
+        return true;
+    }
+
+    std::string toString() const {
+        std::uint64_t magnitude = cents < 0 ? 0 - static_cast<std::uint64_t>(cents) : static_cast<std::uint64_t>(cents);
+        std::string fraction = std::to_string(magnitude % MINOR_PER_MAJOR);
+        return (cents < 0 ? "-" : "") + std::to_string(magnitude / MINOR_PER_MAJOR) + "."
+               + (fraction.size() < 2 ? "0" : "") + fraction;
+    }
+
+    bool checkedAdd(Money other, Money &result) const {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_add_overflow(cents, other.cents, &result.cents);
+#else
+        if ((other.cents > 0 && cents > INT64_MAX - other.cents) || (other.cents < 0 && cents < INT64_MIN - other.cents)) {
+            return false;
+        }
+        result.cents = cents + other.cents;
+        return true;
+#endif
+    }
+
+    bool checkedSub(Money other, Money &result) const {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_sub_overflow(cents, other.cents, &result.cents);
+#else
+        if ((other.cents < 0 && cents > INT64_MAX + other.cents) || (other.cents > 0 && cents < INT64_MIN + other.cents)) {
+            return false;
+        }
+        result.cents = cents - other.cents;
+        return true;
+#endif
+    }
+
+    constexpr bool isPositive() const { return cents > 0; }
+
+    friend constexpr bool operator==(Money a, Money b) { return a.cents == b.cents; }
+    friend constexpr bool operator!=(Money a, Money b) { return a.cents != b.cents; }
+    friend constexpr bool operator<(Money a, Money b) { return a.cents < b.cents; }
+    friend constexpr bool operator<=(Money a, Money b) { return a.cents <= b.cents; }
+    friend constexpr bool operator>(Money a, Money b) { return a.cents > b.cents; }
+    friend constexpr bool operator>=(Money a, Money b) { return a.cents >= b.cents; }
+
+    friend std::ostream &operator<<(std::ostream &out, Money money) {
+        return out << money.toString();
+    }
+
+private:
+    explicit constexpr Money(std::int64_t cents) : cents(cents) {}
+
+    static bool mulAdd(std::int64_t value, std::int64_t factor, std::int64_t addend, std::int64_t &result) {
+        if (value > (INT64_MAX - addend) / factor) {
+            return false;
+        }
+        result = value * factor + addend;
+        return true;
+    }
+
+    std::int64_t cents;
+};
+
+std::int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// SHA-256 (FIPS 180-4), written out here so the build needs no crypto
+// library. On x86 CPUs with the SHA extensions the block function uses
+// them, chosen at run time; elsewhere it falls back to plain C++.
+class Sha256 {
+public:
+    typedef std::array<std::uint8_t, 32> Digest;
+
+    void update(const void *data, std::size_t size) {
+        const std::uint8_t *in = static_cast<const std::uint8_t *>(data);
+        length += size;
+        if (buffered > 0) {
+            std::size_t take = std::min(size, sizeof(buffer) - buffered);
+            std::memcpy(buffer + buffered, in, take);
+            buffered += take;
+            in += take;
+            size -= take;
+            if (buffered < sizeof(buffer)) {
+                return;
+            }
+            compress(state, buffer, 1);
+            buffered = 0;
+        }
+        if (size >= 64) {
+            compress(state, in, size / 64);
+            in += size / 64 * 64;
+            size %= 64;
+        }
+        std::memcpy(buffer, in, size);
+        buffered = size;
+    }
+
+    Digest finish() {
+        std::uint64_t bits = length * 8;
+        std::uint8_t padding[72] = {0x80};
+        std::size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+        for (int i = 0; i < 8; i++) {
+            padding[padLength + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(padding, padLength + 8);
+        return digestOf(state);
+    }
+
+    // Messages of up to 55 bytes, such as a hash chain link, fit in one
+    // padded block and skip the buffering.
+    static Digest hash(const void *data, std::size_t size) {
+        if (size > 55) {
+            Sha256 sha;
+            sha.update(data, size);
+            return sha.finish();
+        }
+        std::uint8_t block[64] = {};
+        std::memcpy(block, data, size);
+        block[size] = 0x80;
+        block[62] = static_cast<std::uint8_t>(size * 8 >> 8);
+        block[63] = static_cast<std::uint8_t>(size * 8);
+        Sha256 sha;
+        compress(sha.state, block, 1);
+        return digestOf(sha.state);
+    }
+
+    static std::string toHex(const Digest &digest) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        for (std::uint8_t byte : digest) {
+            hex += digits[byte >> 4];
+            hex += digits[byte & 15];
+        }
+        return hex;
+    }
+
+private:
+    static constexpr std::uint32_t ROUND_CONSTANTS[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    static void compress(std::uint32_t *state, const std::uint8_t *blocks, std::size_t count) {
+#ifdef BANK_SHA_NI
+        static const bool hasShaExtensions = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+        if (hasShaExtensions) {
+            compressShaNi(state, blocks, count);
+            return;
+        }
+#endif
+        compressPortable(state, blocks, count);
+    }
+
+    static Digest digestOf(const std::uint32_t *state) {
+        Digest digest;
+        for (int i = 0; i < 8; i++) {
+            for (int b = 0; b < 4; b++) {
+                digest[4 * i + b] = static_cast<std::uint8_t>(state[i] >> (24 - 8 * b));
+            }
+        }
+        return digest;
+    }
+
+    static std::uint32_t rotr(std::uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    static void compressPortable(std::uint32_t *state, const std::uint8_t *blocks, std::size_t count) {
+        for (; count > 0; count--, blocks += 64) {
+            std::uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = std::uint32_t(blocks[4 * i]) << 24 | std::uint32_t(blocks[4 * i + 1]) << 16
+                       | std::uint32_t(blocks[4 * i + 2]) << 8 | blocks[4 * i + 3];
+            }
+            for (int i = 16; i < 64; i++) {
+                std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + ROUND_CONSTANTS[i] + w[i];
+                std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+    }
+
+#ifdef BANK_SHA_NI
+    // The SHA extensions keep the state as ABEF and CDGH halves and run two
+    // rounds per instruction; msg[] holds the last 16 schedule words.
+    __attribute__((target("sha,sse4.1")))
+    static void compressShaNi(std::uint32_t *state, const std::uint8_t *blocks, std::size_t count) {
+        const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+        __m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+        __m128i abef = _mm_alignr_epi8(dcba, hgfe, 8);
+        __m128i cdgh = _mm_blend_epi16(hgfe, dcba, 0xF0);
+        for (; count > 0; count--, blocks += 64) {
+            __m128i savedAbef = abef;
+            __m128i savedCdgh = cdgh;
+            __m128i msg[4];
+#pragma GCC unroll 16
+            for (int group = 0; group < 16; group++) {
+                __m128i &words = msg[group & 3];
+                if (group < 4) {
+                    words = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 16 * group)), byteSwap);
+                } else {
+                    const __m128i &previous = msg[(group + 3) & 3];
+                    words = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(words, msg[(group + 1) & 3]),
+                                                               _mm_alignr_epi8(previous, msg[(group + 2) & 3], 4)),
+                                                 previous);
+                }
+                __m128i input = _mm_add_epi32(words, _mm_loadu_si128(reinterpret_cast<const __m128i *>(ROUND_CONSTANTS + 4 * group)));
+                cdgh = _mm_sha256rnds2_epu32(cdgh, abef, input);
+                abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(input, 0x0E));
+            }
+            abef = _mm_add_epi32(abef, savedAbef);
+            cdgh = _mm_add_epi32(cdgh, savedCdgh);
+        }
+        __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+        __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+    }
+#endif
+
+    std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    std::uint8_t buffer[64];
+    std::size_t buffered = 0;
+    std::uint64_t length = 0;
+};
+
+// Memory resource for allocations that live as long as the bank itself:
+// history chunks, which are never freed once written, and owner names too
+// long for the string's inline buffer. It hands out memory by bumping a
+// pointer through BLOCK_SIZE blocks taken from upstream, deallocate() does
+// nothing, and all blocks go back to upstream at once when the arena is
+// destroyed, so millions of small allocations (and as many frees at
+// shutdown) become a few hundred large ones. Each thread bumps through one
+// of STRIPES separately locked blocks, so concurrent writers do not share
+// a lock or a cache line.
+class BankArena : public std::pmr::memory_resource {
+public:
+    explicit BankArena(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) : upstream(upstream) {}
+    BankArena(const BankArena &) = delete;
+    BankArena &operator=(const BankArena &) = delete;
+
+    ~BankArena() override {
+        for (const Block &block : blocks) {
+            upstream->deallocate(block.memory, block.size, block.alignment);
+        }
+    }
+
+    // Bytes taken from upstream so far.
+    std::size_t reserved() const {
+        std::lock_guard<std::mutex> lock(blocksMutex);
+        return reservedBytes;
+    }
+
+private:
+    static const std::size_t BLOCK_SIZE = 1 << 20;
+    static const std::size_t STRIPES = 16;
+
+    struct Block {
+        void *memory;
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::uintptr_t next = 0;
+        std::uintptr_t end = 0;
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        static std::atomic<std::size_t> nextStripe{0};
+        thread_local std::size_t home = nextStripe.fetch_add(1) % STRIPES;
+        // Anything big enough to waste much of a block gets its own.
+        if (bytes > BLOCK_SIZE / 8) {
+            return takeBlock(bytes, alignment);
+        }
+        Stripe &stripe = stripes[home];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        std::uintptr_t start = (stripe.next + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+        if (stripe.next == 0 || start + bytes > stripe.end) {
+            std::uintptr_t block = reinterpret_cast<std::uintptr_t>(takeBlock(BLOCK_SIZE, alignof(std::max_align_t)));
+            stripe.end = block + BLOCK_SIZE;
+            start = (block + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+        }
+        stripe.next = start + bytes;
+        return reinterpret_cast<void *>(start);
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    void *takeBlock(std::size_t size, std::size_t alignment) {
+        alignment = std::max(alignment, alignof(std::max_align_t));
+        void *memory = upstream->allocate(size, alignment);
+        std::lock_guard<std::mutex> lock(blocksMutex);
+        blocks.push_back(Block{memory, size, alignment});
+        reservedBytes += size;
+        return memory;
+    }
+
+    std::pmr::memory_resource *upstream;
+    Stripe stripes[STRIPES];
+    mutable std::mutex blocksMutex;
+    std::vector<Block> blocks;
+    std::size_t reservedBytes = 0;
+};
+
+// Passes everything through to upstream and counts the allocations, so a
+// benchmark can see how many requests actually reach the heap.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource *upstream) : upstream(upstream) {}
+
+    std::size_t allocations() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    std::size_t bytes() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+private:
+    void *do_allocate(std::size_t size, std::size_t alignment) override {
+        count.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(size, std::memory_order_relaxed);
+        return upstream->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *memory, std::size_t size, std::size_t alignment) override {
+        upstream->deallocate(memory, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource *upstream;
+    std::atomic<std::size_t> count{0};
+    std::atomic<std::size_t> total{0};
+};
+
+// Per-account transaction history kept as a packed struct-of-arrays event
+// store: one column each for type, amount, counterparty and timestamp
+// (21 bytes per event). Nothing is formatted until the history is printed.
+//
+// Events live in a chain of chunks whose capacity doubles from 4 up to
+// 1024 events, so short histories stay small, appends never copy existing
+// events, and each chunk is a single allocation holding all four columns,
+// taken from the memory resource the history was created with.
+//
+// Every append also extends a SHA-256 hash chain: the digest after event
+// n is SHA-256(digest after event n-1, event n), starting from a digest of
+// the chain id (the account number), so it commits to the whole history
+// in order. Only the latest digest is kept. A Checkpoint (event count and
+// the digest there) taken once lets verify() check just the events added
+// after it; changing, dropping or reordering any of them breaks the chain.
+class TransactionHistory {
+public:
+    enum class EventType : std::uint8_t {
+        Deposit,
+        Withdraw,
+        TransferOut,
+        TransferIn,
+        Interest,
+        Fee
+    };
+
+    struct Event {
+        EventType type;
+        Money amount;
+        std::int32_t counterparty;
+        std::int64_t timestamp;
+    };
+
+    // A point in the hash chain: the digest after the first events events.
+    struct Checkpoint {
+        std::size_t events = 0;
+        Sha256::Digest digest{};
+    };
+
+    explicit TransactionHistory(std::int32_t chainId = 0, std::pmr::memory_resource *memory = std::pmr::new_delete_resource())
+        : memory(memory), chainId(chainId), lastDigest(genesis().digest) {}
+    TransactionHistory(const TransactionHistory &) = delete;
+    TransactionHistory &operator=(const TransactionHistory &) = delete;
+
+    ~TransactionHistory() {
+        while (head) {
+            Chunk *next = head->next;
+            memory->deallocate(head, chunkBytes(head->capacity), alignof(Chunk));
+            head = next;
+        }
+    }
+
+    void append(EventType type, Money amount, std::int32_t counterparty, std::int64_t timestamp) {
+        appendUnchained(type, amount, counterparty, timestamp);
+        lastDigest = link(lastDigest, Event{type, amount, counterparty, timestamp});
+    }
+
+    // For loading a snapshot, which saves each chain's digest with the
+    // events: append them without hashing, then restoreChain(). The next
+    // audit re-hashes them.
+    void appendUnchained(EventType type, Money amount, std::int32_t counterparty, std::int64_t timestamp) {
+        if (!tail || tail->size == tail->capacity) {
+            addChunk();
+        }
+        std::uint32_t i = tail->size;
+        tail->timestamps()[i] = timestamp;
+        tail->amounts()[i] = amount.minorUnits();
+        tail->counterparties()[i] = counterparty;
+        tail->types()[i] = type;
+        tail->size = i + 1;
+        count++;
+    }
+
+    void restoreChain(const Sha256::Digest &digest) {
+        lastDigest = digest;
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    // Start of the chain, before any event.
+    Checkpoint genesis() const {
+        Checkpoint start;
+        start.digest = Sha256::hash(&chainId, sizeof(chainId));
+        return start;
+    }
+
+    // Where the chain ends now. Appends must be excluded, as for size().
+    Checkpoint checkpoint() const {
+        Checkpoint end;
+        end.events = count;
+        end.digest = lastDigest;
+        return end;
+    }
+
+    // Re-hashes the events between two checkpoints of this history and
+    // reports whether they still lead from one digest to the other. Safe
+    // while another thread appends, like forEachPrefix().
+    bool verify(const Checkpoint &from, const Checkpoint &to) const {
+        if (from.events > to.events) {
+            return false;
+        }
+        Sha256::Digest digest = from.digest;
+        auto extend = [&digest](const Event &event) {
+            digest = link(digest, event);
+        };
+        forEachInRange(from.events, to.events, extend);
+        return digest == to.digest;
+    }
+
+    // Calls fn(const Event &) for every event, oldest first.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const Chunk *chunk = head; chunk; chunk = chunk->next) {
+            for (std::uint32_t i = 0; i < chunk->size; i++) {
+                fn(Event{chunk->types()[i], Money::fromCents(chunk->amounts()[i]), chunk->counterparties()[i], chunk->timestamps()[i]});
+            }
+        }
+    }
+
+    // Calls fn(const Event &) for the first limit events only. Safe while
+    // another thread appends, as long as those limit events were published
+    // to this thread: it relies only on the chunk capacities and links,
+    // which never change once the next chunk is started.
+    template <typename Fn>
+    void forEachPrefix(std::size_t limit, Fn fn) const {
+        forEachInRange(0, limit, fn);
+    }
+
+    // Calls fn(const Event &) for the last n events, oldest first. Cheap
+    // when they are all in the newest chunk, which is the common case of
+    // visiting what a transaction just appended.
+    template <typename Fn>
+    void forEachRecent(std::size_t n, Fn &fn) const {
+        if (n == 0) {
+            return;
+        }
+        if (n > (tail ? tail->size : 0)) {
+            forEachInRange(count - n, count, fn);
+            return;
+        }
+        for (std::uint32_t i = tail->size - static_cast<std::uint32_t>(n); i < tail->size; i++) {
+            fn(Event{tail->types()[i], Money::fromCents(tail->amounts()[i]), tail->counterparties()[i], tail->timestamps()[i]});
+        }
+    }
+
+    // Like forEachPrefix(), but skips the first `first` events.
+    template <typename Fn>
+    void forEachInRange(std::size_t first, std::size_t limit, Fn &fn) const {
+        for (const Chunk *chunk = first < limit ? head : nullptr; chunk; chunk = chunk->next) {
+            std::uint32_t n = static_cast<std::uint32_t>(std::min<std::size_t>(limit, chunk->capacity));
+            for (std::uint32_t i = static_cast<std::uint32_t>(std::min<std::size_t>(first, n)); i < n; i++) {
+                fn(Event{chunk->types()[i], Money::fromCents(chunk->amounts()[i]), chunk->counterparties()[i], chunk->timestamps()[i]});
+            }
+            first -= std::min<std::size_t>(first, n);
+            limit -= n;
+            if (limit == 0) {
+                break;
+            }
+        }
+    }
+
+    // Calls fn(types, amounts, counterparties, timestamps, count) with the
+    // raw columns of each chunk, oldest first.
+    template <typename Fn>
+    void forEachChunk(Fn fn) const {
+        for (const Chunk *chunk = head; chunk; chunk = chunk->next) {
+            fn(chunk->types(), chunk->amounts(), chunk->counterparties(), chunk->timestamps(), chunk->size);
+        }
+    }
+
+    static std::string format(const Event &event) {
+        switch (event.type) {
+            case EventType::Deposit:
+                return "Deposit: $" + event.amount.toString();
+            case EventType::Withdraw:
+                return "Withdraw: $" + event.amount.toString();
+            case EventType::TransferOut:
+                return "Transfer: $" + event.amount.toString() + " to Account " + std::to_string(event.counterparty);
+            case EventType::TransferIn:
+                return "Transfer: $" + event.amount.toString() + " from Account " + std::to_string(event.counterparty);
+            case EventType::Interest:
+                return "Interest: $" + event.amount.toString();
+            case EventType::Fee:
+                return "Fee: $" + event.amount.toString();
+        }
+        return "Unknown";
+    }
+
+private:
+    static const std::uint32_t FIRST_CHUNK_CAPACITY = 4;
+    static const std::uint32_t MAX_CHUNK_CAPACITY = 1024;
+
+    // Header followed by the columns, widest first so each stays aligned.
+    struct Chunk {
+        Chunk *next;
+        std::uint32_t capacity;
+        std::uint32_t size;
+
+        char *columns() { return reinterpret_cast<char *>(this + 1); }
+        const char *columns() const { return reinterpret_cast<const char *>(this + 1); }
+
+        std::int64_t *timestamps() { return reinterpret_cast<std::int64_t *>(columns()); }
+        std::int64_t *amounts() { return reinterpret_cast<std::int64_t *>(columns() + 8 * capacity); }
+        std::int32_t *counterparties() { return reinterpret_cast<std::int32_t *>(columns() + 16 * capacity); }
+        EventType *types() { return reinterpret_cast<EventType *>(columns() + 20 * capacity); }
+
+        const std::int64_t *timestamps() const { return reinterpret_cast<const std::int64_t *>(columns()); }
+        const std::int64_t *amounts() const { return reinterpret_cast<const std::int64_t *>(columns() + 8 * capacity); }
+        const std::int32_t *counterparties() const { return reinterpret_cast<const std::int32_t *>(columns() + 16 * capacity); }
+        const EventType *types() const { return reinterpret_cast<const EventType *>(columns() + 20 * capacity); }
+    };
+
+    void addChunk() {
+        std::uint32_t capacity = tail ? tail->capacity * 2 : FIRST_CHUNK_CAPACITY;
+        if (capacity > MAX_CHUNK_CAPACITY) {
+            capacity = MAX_CHUNK_CAPACITY;
+        }
+        Chunk *chunk = static_cast<Chunk *>(memory->allocate(chunkBytes(capacity), alignof(Chunk)));
+        chunk->next = nullptr;
+        chunk->capacity = capacity;
+        chunk->size = 0;
+        if (tail) {
+            tail->next = chunk;
+        } else {
+            head = chunk;
+        }
+        tail = chunk;
+    }
+
+    static std::size_t chunkBytes(std::uint32_t capacity) {
+        return sizeof(Chunk) + 21 * static_cast<std::size_t>(capacity);
+    }
+
+    // Hashes the previous digest followed by the event's 21 bytes (type,
+    // amount, counterparty, timestamp in host byte order).
+    static Sha256::Digest link(const Sha256::Digest &previous, const Event &event) {
+        std::uint8_t message[32 + 21];
+        std::int64_t amount = event.amount.minorUnits();
+        std::memcpy(message, previous.data(), 32);
+        message[32] = static_cast<std::uint8_t>(event.type);
+        std::memcpy(message + 33, &amount, 8);
+        std::memcpy(message + 41, &event.counterparty, 4);
+        std::memcpy(message + 45, &event.timestamp, 8);
+        return Sha256::hash(message, sizeof(message));
+    }
+
+    std::pmr::memory_resource *memory;
+    Chunk *head = nullptr;
+    Chunk *tail = nullptr;
+    std::size_t count = 0;
+    std::int32_t chainId;
+    Sha256::Digest lastDigest;
+};
+
+// Commit versions and reader registrations behind the multi-version
+// balance reads. Every change to a set of accounts is one commit: while
+// still holding the account locks, the writer publishes a new balance
+// version on each account it touched, marked pending, then takes the next
+// commit version and stamps it on all of them. A ReadView pins the latest
+// commit version taken, so it sees each commit entirely or not at all
+// without taking any lock; only if it meets a version that is still
+// pending does it wait for the stamp, which is never more than a few
+// instructions away. Writers never wait for readers, and they trim old
+// balance versions only behind the oldest pinned view.
+//
+// A commit over so many accounts that publishing them takes a while (the
+// interest sweep) publishes them as staged instead, which readers simply
+// skip, and marks them all pending only right before taking its version.
+// A view that finds a staged version was opened before that, so the
+// version it will get is newer than the view.
+class VersionClock {
+public:
+    static const std::uint64_t PENDING = UINT64_MAX;
+    static const std::uint64_t STAGED = UINT64_MAX - 1;
+
+    class ReadView {
+    public:
+        explicit ReadView(const VersionClock &clock) : clock(clock), slot(clock.enterReader(snapshot)) {}
+        ReadView(const ReadView &) = delete;
+        ReadView &operator=(const ReadView &) = delete;
+
+        ~ReadView() {
+            clock.slots[slot].version.store(NO_READER);
+            clock.readers.fetch_sub(1);
+        }
+
+        std::uint64_t version() const {
+            return snapshot;
+        }
+
+    private:
+        const VersionClock &clock;
+        std::uint64_t snapshot;
+        std::size_t slot;
+    };
+
+    // Called once the commit's versions are published as pending.
+    std::uint64_t takeVersion() {
+        return next.fetch_add(1) + 1;
+    }
+
+    bool hasReaders() const {
+        return readers.load(std::memory_order_relaxed) != 0;
+    }
+
+    // No view older than this exists or can be opened from now on.
+    std::uint64_t oldestReader() const {
+        std::uint64_t oldest = next.load();
+        if (readers.load() == 0) {
+            return oldest;
+        }
+        for (const Slot &slot : slots) {
+            oldest = std::min(oldest, slot.version.load());
+        }
+        return oldest;
+    }
+
+private:
+    static const std::uint64_t NO_READER = UINT64_MAX;
+    static const std::size_t SLOTS = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> version{NO_READER};
+    };
+
+    // Claims a free slot, preferring this thread's own. The reader count
+    // and then the slot (holding 0, which blocks all trimming) are set
+    // before the snapshot is read, so a writer that missed them read its
+    // bound before the snapshot was taken.
+    std::size_t enterReader(std::uint64_t &snapshot) const {
+        readers.fetch_add(1);
+        static std::atomic<std::size_t> nextSlot{0};
+        thread_local std::size_t home = nextSlot.fetch_add(1) % SLOTS;
+        for (std::size_t tries = 0;; tries++) {
+            std::size_t s = (home + tries) % SLOTS;
+            std::uint64_t expected = NO_READER;
+            if (slots[s].version.compare_exchange_strong(expected, 0)) {
+                snapshot = next.load();
+                slots[s].version.store(snapshot);
+                return s;
+            }
+            if (tries % SLOTS == SLOTS - 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    mutable Slot slots[SLOTS];
+    // Open views; lets writers skip the slot scan when there are none.
+    mutable std::atomic<int> readers{0};
+    std::atomic<std::uint64_t> next{0};
+};
+
+// Limit on how much an account may be debited within a sliding window,
+// e.g. "at most 5 withdrawals per hour" or "at most $10,000 transferred
+// out per day". types has one bit per TransactionHistory::EventType and
+// may name Withdraw and TransferOut; a zero maxCount or maxAmount means
+// that part is not limited.
+struct VelocityRule {
+    std::uint8_t types = 0;
+    std::int64_t windowMicros = 0;
+    std::uint32_t maxCount = 0;
+    Money maxAmount;
+
+    static std::uint8_t typeBit(TransactionHistory::EventType type) {
+        return static_cast<std::uint8_t>(1u << static_cast<unsigned>(type));
+    }
+
+    bool isValid() const {
+        const std::uint8_t debits = typeBit(TransactionHistory::EventType::Withdraw) | typeBit(TransactionHistory::EventType::TransferOut);
+        return types != 0 && (types & ~debits) == 0 && windowMicros > 0 && !(maxAmount < Money())
+               && (maxCount > 0 || maxAmount.isPositive());
+    }
+};
+
+// A rule list compiled for the transaction path. compile() lists, for
+// each event type, the rules that cover it, so a debit only looks at its
+// own rules, and fixes where each rule keeps its counters.
+//
+// The per-account state is a Window holding, for every rule, a ring of
+// BUCKETS buckets that each count the debits of one eighth of the rule's
+// window: the newest bucket's slot number (timestamp / bucket width),
+// then a count per bucket if the rule limits counts and an amount per
+// bucket if it limits amounts. Checking or counting a debit first moves
+// each ring up to its timestamp, emptying the buckets that slid out of the
+// window, so a check just sums the whole ring: the window slides in steps
+// of one bucket (it remembers between seven and eight eighths of it), and
+// each rule costs a multiply and a few adds with no allocation or lock
+// beyond the account's own. Windows belong to the rule set that made
+// them: one left from an earlier set counts as empty.
+class VelocityLimits {
+public:
+    static const std::size_t BUCKETS = 8;
+    static const std::size_t MAX_RULES = 64;
+    // Ring bytes an account keeps inline: four rules that limit counts or
+    // amounts, or two that limit both.
+    static const std::size_t INLINE_BYTES = 256;
+
+    struct Window;
+    struct InlineWindow;
+
+    // Null if there are too many rules or one is invalid.
+    static std::unique_ptr<VelocityLimits> compile(const std::vector<VelocityRule> &rules, std::uint64_t generation) {
+        if (rules.size() > MAX_RULES) {
+            return nullptr;
+        }
+        std::unique_ptr<VelocityLimits> limits(new VelocityLimits(generation));
+        for (const VelocityRule &rule : rules) {
+            if (!rule.isValid()) {
+                return nullptr;
+            }
+            Compiled compiled;
+            compiled.bucketsPerMicro = static_cast<double>(BUCKETS) / static_cast<double>(rule.windowMicros);
+            compiled.maxCount = rule.maxCount;
+            compiled.maxAmount = rule.maxAmount.minorUnits();
+            compiled.offset = limits->windowBytes;
+            compiled.amounts = compiled.maxCount != 0 ? 8 + 4 * BUCKETS : 8;
+            limits->windowBytes += compiled.amounts + (compiled.maxAmount != 0 ? 8 * BUCKETS : 0);
+            limits->rules.push_back(compiled);
+        }
+        for (std::size_t type = 0; type < TYPES; type++) {
+            limits->first[type] = static_cast<std::uint8_t>(limits->order.size());
+            for (std::size_t i = 0; i < rules.size(); i++) {
+                if (rules[i].types & (1u << type)) {
+                    limits->order.push_back(static_cast<std::uint8_t>(i));
+                }
+            }
+        }
+        limits->first[TYPES] = static_cast<std::uint8_t>(limits->order.size());
+        return limits;
+    }
+
+    bool covers(TransactionHistory::EventType type) const {
+        std::size_t t = static_cast<std::size_t>(type);
+        return first[t] != first[t + 1];
+    }
+
+    // Whether one more debit of amount at timestamp keeps every rule
+    // covering type within its limits. window may be null.
+    bool allows(Window *window, TransactionHistory::EventType type, Money amount, std::int64_t timestamp) const {
+        char *data = window && window->generation == generation ? window->data() : nullptr;
+        std::size_t t = static_cast<std::size_t>(type);
+        for (std::size_t i = first[t]; i < first[t + 1]; i++) {
+            const Compiled &rule = rules[order[i]];
+            std::uint64_t count = 1;
+            std::int64_t total = amount.minorUnits();
+            if (data) {
+                char *ring = data + rule.offset;
+                advance(rule, ring, timestamp);
+                if (rule.maxCount != 0) {
+                    const std::uint32_t *counts = reinterpret_cast<const std::uint32_t *>(ring + 8);
+                    for (std::size_t b = 0; b < BUCKETS; b++) {
+                        count += counts[b];
+                    }
+                }
+                if (rule.maxAmount != 0) {
+                    const std::int64_t *amounts = reinterpret_cast<const std::int64_t *>(ring + rule.amounts);
+                    for (std::size_t b = 0; b < BUCKETS; b++) {
+                        total += amounts[b];
+                    }
+                }
+            }
+            if ((rule.maxCount != 0 && count > rule.maxCount) || (rule.maxAmount != 0 && total > rule.maxAmount)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Counts a debit that went through. Replaces window if it is null or
+    // from another rule set, with spare if the rings fit in it and else
+    // with one allocated from memory.
+    void record(Window *&window, TransactionHistory::EventType type, Money amount, std::int64_t timestamp,
+                std::pmr::memory_resource *memory, InlineWindow *spare = nullptr) const {
+        if (!window || window->generation != generation) {
+            release(window);
+            if (spare && windowBytes <= INLINE_BYTES) {
+                window = &spare->header;
+                memory = nullptr;
+            } else {
+                window = static_cast<Window *>(memory->allocate(sizeof(Window) + windowBytes, alignof(Window)));
+            }
+            window->generation = generation;
+            window->memory = memory;
+            window->bytes = windowBytes;
+            std::memset(static_cast<void *>(window->data()), 0, windowBytes);
+            for (const Compiled &rule : rules) {
+                *reinterpret_cast<std::int64_t *>(window->data() + rule.offset) = slotAt(rule, timestamp);
+            }
+        }
+        std::size_t t = static_cast<std::size_t>(type);
+        for (std::size_t i = first[t]; i < first[t + 1]; i++) {
+            const Compiled &rule = rules[order[i]];
+            char *ring = window->data() + rule.offset;
+            std::size_t b = advance(rule, ring, timestamp);
+            if (rule.maxCount != 0) {
+                reinterpret_cast<std::uint32_t *>(ring + 8)[b]++;
+            }
+            if (rule.maxAmount != 0) {
+                reinterpret_cast<std::int64_t *>(ring + rule.amounts)[b] += amount.minorUnits();
+            }
+        }
+    }
+
+    static void release(Window *&window) {
+        if (window && window->memory) {
+            window->memory->deallocate(window, sizeof(Window) + window->bytes, alignof(Window));
+        }
+        window = nullptr;
+    }
+
+    // Header followed by each rule's ring; memory is null for an inline one.
+    struct Window {
+        std::uint64_t generation;
+        std::pmr::memory_resource *memory;
+        std::size_t bytes;
+
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+        const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+    };
+
+    // Room for a window inside the account it belongs to, so checking a
+    // debit touches no memory beyond the account's own.
+    struct InlineWindow {
+        Window header;
+        alignas(8) char rings[INLINE_BYTES];
+    };
+
+private:
+    static const std::size_t TYPES = static_cast<std::size_t>(TransactionHistory::EventType::Fee) + 1;
+
+    struct Compiled {
+        double bucketsPerMicro;
+        std::uint32_t maxCount;
+        std::int64_t maxAmount;
+        // Byte offsets of the ring in the window and of its amounts in the
+        // ring; counts, if any, follow the slot number at 8.
+        std::size_t offset;
+        std::size_t amounts;
+    };
+
+    explicit VelocityLimits(std::uint64_t generation) : generation(generation) {}
+
+    // Moves the ring's newest slot up to timestamp, emptying the buckets
+    // that slid out of the window, and returns the bucket to count in. A
+    // clock stepping back counts in the newest bucket.
+    static std::size_t advance(const Compiled &rule, char *ring, std::int64_t timestamp) {
+        std::int64_t &newest = *reinterpret_cast<std::int64_t *>(ring);
+        std::int64_t now = slotAt(rule, timestamp);
+        if (now > newest) {
+            for (std::int64_t slot = std::max(newest + 1, now - static_cast<std::int64_t>(BUCKETS) + 1); slot <= now; slot++) {
+                std::size_t b = static_cast<std::size_t>(slot) % BUCKETS;
+                if (rule.maxCount != 0) {
+                    reinterpret_cast<std::uint32_t *>(ring + 8)[b] = 0;
+                }
+                if (rule.maxAmount != 0) {
+                    reinterpret_cast<std::int64_t *>(ring + rule.amounts)[b] = 0;
+                }
+            }
+            newest = now;
+        }
+        return static_cast<std::size_t>(newest) % BUCKETS;
+    }
+
+    // Multiplying rather than dividing keeps the slot cheap; rounding can
+    // only move a debit that lands exactly on a bucket boundary.
+    static std::int64_t slotAt(const Compiled &rule, std::int64_t timestamp) {
+        return static_cast<std::int64_t>(static_cast<double>(timestamp) * rule.bucketsPerMicro);
+    }
+
+    std::uint64_t generation;
+    std::vector<Compiled> rules;
+    std::vector<std::uint8_t> order;
+    std::array<std::uint8_t, TYPES + 1> first{};
+    std::size_t windowBytes = 0;
+};
+
+// Every account carries its own mutex so operations on different accounts
+// never contend with each other. The balance-changing methods expect the
+// caller to hold the lock (see lock() and lockWith()); BankingSystem does
+// this so that the write-ahead log append happens in the same critical
+// section as the change it describes.
 class Account {
 public:
-    Account() : owner(""), accountNumber(0), balance(0) {}
+    Account() : owner(""), accountNumber(0), clock(nullptr) {}
+
+    // The owner name and history are allocated from memory.
+    Account(const std::string &owner, int accountNumber, const VersionClock &clock,
+            std::pmr::memory_resource *memory = std::pmr::new_delete_resource())
+        : owner(owner.data(), owner.size(), memory), accountNumber(accountNumber), history(accountNumber, memory), clock(&clock) {}
+
+    Account(const Account &) = delete;
+    Account &operator=(const Account &) = delete;
+
+    ~Account() {
+        freeVersions(latest.load());
+        freeVersions(spareVersions);
+        VelocityLimits::release(velocity);
+    }
+
+    std::unique_lock<std::mutex> lock() const {
+        return std::unique_lock<std::mutex>(mutex);
+    }
+
+    // Locks this account and another one in ascending account-number order,
+    // so two opposite transfers between the same pair can never deadlock.
+    std::pair<std::unique_lock<std::mutex>, std::unique_lock<std::mutex>> lockWith(const Account &other) const {
+        const Account &first = accountNumber < other.accountNumber ? *this : other;
+        const Account &second = accountNumber < other.accountNumber ? other : *this;
+        std::unique_lock<std::mutex> firstLock(first.mutex);
+        std::unique_lock<std::mutex> secondLock(second.mutex);
+        return {std::move(firstLock), std::move(secondLock)};
+    }
+
+    TxnStatus deposit(Money amount, std::int64_t timestamp) {
+        if (!amount.isPositive()) {
+            return TxnStatus::InvalidAmount;
+        }
+        if (!balance.checkedAdd(amount, balance)) {
+            return TxnStatus::Overflow;
+        }
+        history.append(TransactionHistory::EventType::Deposit, amount, 0, timestamp);
+        return TxnStatus::Ok;
+    }
+
+    TxnStatus withdraw(Money amount, std::int64_t timestamp) {
+        if (!amount.isPositive()) {
+            return TxnStatus::InvalidAmount;
+        }
+        if (amount > balance) {
+            return TxnStatus::InsufficientFunds;
+        }
+        balance.checkedSub(amount, balance);
+        history.append(TransactionHistory::EventType::Withdraw, amount, 0, timestamp);
+        return TxnStatus::Ok;
+    }
+
+    // Velocity counters for limits (see VelocityLimits); the account must
+    // be locked, except for prefetchLimits(), which only starts loading
+    // them so that the cache misses overlap with taking the lock.
+    void prefetchLimits() const {
+#if defined(__GNUC__)
+        const char *window = reinterpret_cast<const char *>(&inlineVelocity);
+        for (std::size_t offset = 0; offset < sizeof(inlineVelocity); offset += 64) {
+            __builtin_prefetch(window + offset, 1);
+        }
+#endif
+    }
+
+    bool withinLimits(const VelocityLimits &limits, TransactionHistory::EventType type, Money amount, std::int64_t timestamp) {
+        return limits.allows(velocity, type, amount, timestamp);
+    }
+
+    void countDebit(const VelocityLimits &limits, TransactionHistory::EventType type, Money amount, std::int64_t timestamp,
+                    std::pmr::memory_resource *memory) {
+        limits.record(velocity, type, amount, timestamp, memory, &inlineVelocity);
+    }
+
+    // Both accounts must be locked, e.g. through lockWith().
+    TxnStatus transfer(Account &toAccount, Money amount, std::int64_t timestamp) {
+        if (!amount.isPositive()) {
+            return TxnStatus::InvalidAmount;
+        }
+        if (&toAccount == this) {
+            return TxnStatus::SameAccount;
+        }
+        if (amount > balance) {
+            return TxnStatus::InsufficientFunds;
+        }
+        Money credited;
+        if (!toAccount.balance.checkedAdd(amount, credited)) {
+            return TxnStatus::Overflow;
+        }
+        balance.checkedSub(amount, balance);
+        toAccount.balance = credited;
+        toAccount.history.append(TransactionHistory::EventType::TransferIn, amount, accountNumber, timestamp);
+        history.append(TransactionHistory::EventType::TransferOut, amount, toAccount.accountNumber, timestamp);
+        return TxnStatus::Ok;
+    }
+
+    // Balance as of the view's commit, without taking the account lock.
+    Money getBalance(const VersionClock::ReadView &view) const {
+        return versionAt(view)->balance;
+    }
+
+    Money getBalance() const {
+        if (!clock) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return balance;
+        }
+        VersionClock::ReadView view(*clock);
+        return getBalance(view);
+    }
+
+    int getAccountNumber() const {
+        return accountNumber;
+    }
+
+    // Prints the history as of the view's commit, without taking the
+    // account lock.
+    void printTransactionHistory(const VersionClock::ReadView &view) const {
+        printEvents(versionAt(view)->events);
+    }
+
+    void printTransactionHistory() const {
+        if (!clock) {
+            std::lock_guard<std::mutex> lock(mutex);
+            printEvents(history.size());
+            return;
+        }
+        VersionClock::ReadView view(*clock);
+        printTransactionHistory(view);
+    }
+
+private:
+    friend class BankingSystem;
+
+    // What readers see of the account as of one commit. Versions are
+    // linked newest first.
+    struct BalanceVersion {
+        Money balance;
+        std::size_t events = 0;
+        std::atomic<std::uint64_t> version{0};
+        std::atomic<BalanceVersion *> older{nullptr};
+    };
+
+    // Chain length at which publish() trims while views are open.
+    static const int MAX_VERSIONS = 4;
+
+    // Publishes the current balance and history as a pending (or staged)
+    // version for the caller to stamp. The account must be locked (or not
+    // yet shared).
+    BalanceVersion *publish(std::uint64_t state = VersionClock::PENDING) {
+        // Recycle first. With no view open, everything behind the newest
+        // version goes, so the account just alternates between two; while
+        // views pin the chain, back off instead of scanning the reader
+        // slots on every publish.
+        if (clock && (versionCount >= trimAt || !clock->hasReaders())) {
+            trimVersions(clock->oldestReader());
+            trimAt = versionCount >= MAX_VERSIONS ? 2 * versionCount : MAX_VERSIONS;
+        }
+        BalanceVersion *node = spareVersions;
+        if (node) {
+            spareVersions = node->older.load(std::memory_order_relaxed);
+        } else {
+            node = new BalanceVersion();
+        }
+        node->balance = balance;
+        node->events = history.size();
+        node->version.store(state, std::memory_order_relaxed);
+        node->older.store(latest.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        latest.store(node, std::memory_order_release);
+        versionCount++;
+        return node;
+    }
+
+    // Keeps every version newer than oldest plus the newest one at or
+    // before it; no view can reach past that one. The rest are recycled
+    // straight away.
+    void trimVersions(std::uint64_t oldest) {
+        BalanceVersion *keep = latest.load(std::memory_order_relaxed);
+        while (keep->version.load(std::memory_order_relaxed) > oldest && keep->older.load(std::memory_order_relaxed)) {
+            keep = keep->older.load(std::memory_order_relaxed);
+        }
+        BalanceVersion *dead = keep->older.exchange(nullptr, std::memory_order_relaxed);
+        while (dead) {
+            BalanceVersion *older = dead->older.load(std::memory_order_relaxed);
+            dead->older.store(spareVersions, std::memory_order_relaxed);
+            spareVersions = dead;
+            versionCount--;
+            dead = older;
+        }
+    }
+
+    // Staged versions compare newer than any view and are skipped. The
+    // load is sequentially consistent so that one seen staged here was
+    // marked pending, and so numbered, after the view's snapshot was read.
+    const BalanceVersion *versionAt(const VersionClock::ReadView &view) const {
+        const BalanceVersion *node = latest.load(std::memory_order_acquire);
+        while (true) {
+            std::uint64_t version;
+            while ((version = node->version.load()) == VersionClock::PENDING) {
+                std::this_thread::yield();
+            }
+            if (version <= view.version()) {
+                return node;
+            }
+            node = node->older.load(std::memory_order_acquire);
+        }
+    }
+
+    void printEvents(std::size_t count) const {
+        std::cout << "Transaction history for account " << accountNumber << ":" << std::endl;
+        history.forEachPrefix(count, [](const TransactionHistory::Event &event) {
+            std::cout << TransactionHistory::format(event) << std::endl;
+        });
+    }
+
+    void freeVersions(BalanceVersion *node) {
+        while (node) {
+            BalanceVersion *older = node->older.load(std::memory_order_relaxed);
+            if (node != &inlineVersions[0] && node != &inlineVersions[1]) {
+                delete node;
+            }
+            node = older;
+        }
+    }
+
+    std::pmr::string owner;
+    int accountNumber;
+    Money balance;
+    TransactionHistory history;
+    mutable std::mutex mutex;
+    // Set up on the first debit under a set of velocity limits, in
+    // inlineVelocity unless the rule set's rings are too big for it.
+    VelocityLimits::Window *velocity = nullptr;
+    VelocityLimits::InlineWindow inlineVelocity;
+
+    const VersionClock *clock;
+    // The first two versions live inside the account, which is all an
+    // account needs while no view holds older ones; it starts as an empty
+    // version 0 so every view finds one.
+    BalanceVersion inlineVersions[2];
+    std::atomic<BalanceVersion *> latest{&inlineVersions[0]};
+    BalanceVersion *spareVersions = &inlineVersions[1];
+    int versionCount = 1;
+    int trimAt = MAX_VERSIONS;
+
+    // How far the last clean BankingSystem::auditHistories() got; events
+    // == 0 means from the genesis.
+    TransactionHistory::Checkpoint audited;
+};
+
+// CRC-32 (IEEE) of data; pass the previous result as crc to checksum data
+// that arrives in pieces.
+std::uint32_t crc32(const char *data, std::size_t size, std::uint32_t crc = 0) {
+    static const std::vector<std::uint32_t> table = []() {
+        std::vector<std::uint32_t> entries(256);
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Writes all of data to fd, retrying short writes.
+bool writeFully(int fd, const char *data, std::size_t size) {
+    std::size_t written = 0;
+    while (written < size) {
+#ifdef _WIN32
+        int n = _write(fd, data + written, static_cast<unsigned>(size - written));
+#else
+        ssize_t n = ::write(fd, data + written, size - written);
+#endif
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool syncFile(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+// Raw host-byte-order encoding used by the log and snapshot formats.
+template <typename T>
+void putPod(std::vector<char> &out, T value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T getPod(const char *&in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+// Read-only memory mapping of a whole file, so bulk loaders can parse it in
+// place without copying it through stream buffers.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            return;
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        opened = true;
+        if (size == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        opened = data != nullptr;
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            return;
+        }
+        size = static_cast<std::size_t>(info.st_size);
+        opened = true;
+        if (size == 0) {
+            return;
+        }
+        void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            opened = false;
+            return;
+        }
+        madvise(address, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(address);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data) {
+            munmap(const_cast<char *>(data), size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    std::string_view contents() const {
+        return data ? std::string_view(data, size) : std::string_view();
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    const char *data = nullptr;
+    std::size_t size = 0;
+    bool opened = false;
+};
+
+// Append-only binary write-ahead log with group commit.
+//
+// Writers encode their record into a shared in-memory buffer and get back a
+// log sequence number (LSN). A single flusher thread repeatedly takes
+// whatever has accumulated, writes it with one write() and makes it durable
+// with one fsync, so the cost of a disk flush is shared by every
+// transaction that arrived while the previous flush was in progress.
+//
+// On-disk record: u32 payload length, u32 CRC-32 of the payload, payload.
+// Payload: u64 lsn, u8 type, i32 account, i32 counterparty, i64 amount in
+// cents, i64 timestamp (microseconds since the epoch), u16 owner length,
+// owner bytes. Integers are stored in host byte order.
+// A record with a bad length or checksum marks a torn tail and ends replay.
+// A BatchBegin record (counterparty = number of records that follow) makes
+// the next records one unit: replay applies all of them or, when the batch
+// was torn, none of them. A Sweep record (account = interest basis points,
+// amount = monthly fee, owner = the i64 fee-waiver balance in cents) runs
+// the interest sweep over every account again.
+class TransactionLog {
+public:
+    enum class RecordType : std::uint8_t {
+        CreateAccount = 1,
+        Deposit = 2,
+        Withdraw = 3,
+        Transfer = 4,
+        BatchBegin = 5,
+        Sweep = 6
+    };
+
+    struct Entry {
+        RecordType type;
+        std::int32_t account;
+        std::int32_t counterparty;
+        Money amount;
+        std::int64_t timestamp;
+        std::string_view owner;
+    };
+
+    struct Record {
+        std::uint64_t lsn;
+        RecordType type;
+        std::int32_t account;
+        std::int32_t counterparty;
+        Money amount;
+        std::int64_t timestamp;
+        std::string owner;
+    };
+
+    TransactionLog() = default;
+    TransactionLog(const TransactionLog &) = delete;
+    TransactionLog &operator=(const TransactionLog &) = delete;
+
+    ~TransactionLog() {
+        close();
+    }
+
+    // Replays every intact record in the file through the callback, cuts off
+    // a torn tail if there is one, and starts accepting appends.
+    //
+    // After a snapshot, pass the LSN and byte offset it was taken at: only
+    // records after it are replayed, and reading starts directly at the
+    // offset when the record found there continues the snapshot.
+    bool open(const std::string &path, const std::function<void(const Record &)> &replay,
+              std::uint64_t startLsn = 0, std::uint64_t startOffset = 0) {
+        std::uint64_t validLength = 0;
+        lastLsn = startLsn;
+        {
+            MappedFile file(path);
+            std::string_view data = file.contents();
+            Record record;
+            std::size_t offset = 0;
+            std::size_t probe = startOffset;
+            if (startLsn > 0 && (startOffset == data.size()
+                                 || (startOffset < data.size() && decode(data, probe, record) && record.lsn == startLsn + 1))) {
+                offset = startOffset;
+            }
+            validLength = offset;
+            std::vector<Record> batch;
+            std::int32_t batchRemaining = 0;
+            while (decode(data, offset, record)) {
+                if (record.lsn <= startLsn) {
+                    validLength = offset;
+                    continue;
+                }
+                if (record.type == RecordType::BatchBegin) {
+                    batchRemaining = record.counterparty;
+                    batch.clear();
+                    continue;
+                }
+                if (batchRemaining > 0) {
+                    batch.push_back(record);
+                    if (--batchRemaining > 0) {
+                        continue;
+                    }
+                    for (const Record &batched : batch) {
+                        replay(batched);
+                    }
+                } else {
+                    replay(record);
+                }
+                lastLsn = record.lsn;
+                validLength = offset;
+            }
+        }
+
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY, 0644);
+        if (fd < 0 || _chsize_s(fd, static_cast<__int64>(validLength)) != 0 || _lseeki64(fd, 0, SEEK_END) < 0) {
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(validLength)) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+#endif
+            std::cerr << "Cannot open transaction log " << path << std::endl;
+            if (fd >= 0) {
+#ifdef _WIN32
+                _close(fd);
+#else
+                ::close(fd);
+#endif
+                fd = -1;
+            }
+            return false;
+        }
+        durableLsn = lastLsn;
+        appendedBytes = validLength;
+        stopping = false;
+        flusher = std::thread(&TransactionLog::flushLoop, this);
+        return true;
+    }
+
+    void close() {
+        if (!flusher.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        appendCv.notify_one();
+        flusher.join();
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    // LSN of the last record appended and the log length including it.
+    std::pair<std::uint64_t, std::uint64_t> position() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {lastLsn, appendedBytes};
+    }
+
+    // Queues a record and returns its LSN. Nothing has reached the disk yet;
+    // call waitDurable(lsn) before acknowledging the transaction.
+    std::uint64_t append(RecordType type, std::int32_t account, std::int32_t counterparty, Money amount,
+                         std::int64_t timestamp, std::string_view owner = {}) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool wasEmpty = pending.empty();
+        std::size_t before = pending.size();
+        encode(pending, ++lastLsn, type, account, counterparty, amount, timestamp, owner);
+        appendedBytes += pending.size() - before;
+        if (wasEmpty) {
+            appendCv.notify_one();
+        }
+        return lastLsn;
+    }
+
+    // Queues several records as one batch that recovery replays atomically,
+    // and returns the LSN of the last one.
+    std::uint64_t appendBatch(const Entry *entries, std::size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool wasEmpty = pending.empty();
+        std::size_t before = pending.size();
+        if (count > 1) {
+            encode(pending, ++lastLsn, RecordType::BatchBegin, 0, static_cast<std::int32_t>(count), Money(), 0, {});
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            const Entry &entry = entries[i];
+            encode(pending, ++lastLsn, entry.type, entry.account, entry.counterparty, entry.amount, entry.timestamp, entry.owner);
+        }
+        appendedBytes += pending.size() - before;
+        if (wasEmpty) {
+            appendCv.notify_one();
+        }
+        return lastLsn;
+    }
+
+    // Queues records received from a replication leader under their own
+    // LSNs, which must continue this log's, so a follower keeps a copy of
+    // the leader's log it can carry on from once promoted.
+    bool appendReplicated(const Record *records, std::size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0 || records[0].lsn != lastLsn + 1) {
+            return count == 0;
+        }
+        bool wasEmpty = pending.empty();
+        std::size_t before = pending.size();
+        for (std::size_t i = 0; i < count; i++) {
+            const Record &record = records[i];
+            encode(pending, record.lsn, record.type, record.account, record.counterparty, record.amount, record.timestamp, record.owner);
+        }
+        lastLsn = records[count - 1].lsn;
+        appendedBytes += pending.size() - before;
+        if (wasEmpty) {
+            appendCv.notify_one();
+        }
+        return true;
+    }
+
+    // listener(bytes, lastLsn) is called by the flusher with every batch of
+    // whole records once it is durable, in log order; replication ships
+    // them from there. Pass an empty function to stop.
+    void setListener(std::function<void(std::string_view, std::uint64_t)> listener) {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        durableListener = std::move(listener);
+    }
+
+    // Decodes the record at offset and advances past it; returns false at the
+    // end of the data or at the first damaged record.
+    static bool decode(std::string_view data, std::size_t &offset, Record &record) {
+        if (data.size() - offset < HEADER_SIZE) {
+            return false;
+        }
+        const char *in = data.data() + offset;
+        std::uint32_t payloadLength = getPod<std::uint32_t>(in);
+        std::uint32_t checksum = getPod<std::uint32_t>(in);
+        if (payloadLength < FIXED_PAYLOAD_SIZE || data.size() - offset - HEADER_SIZE < payloadLength
+            || crc32(in, payloadLength) != checksum) {
+            return false;
+        }
+        record.lsn = getPod<std::uint64_t>(in);
+        record.type = static_cast<RecordType>(getPod<std::uint8_t>(in));
+        record.account = getPod<std::int32_t>(in);
+        record.counterparty = getPod<std::int32_t>(in);
+        record.amount = Money::fromCents(getPod<std::int64_t>(in));
+        record.timestamp = getPod<std::int64_t>(in);
+        std::uint16_t ownerLength = getPod<std::uint16_t>(in);
+        if (FIXED_PAYLOAD_SIZE + ownerLength != payloadLength) {
+            return false;
+        }
+        record.owner.assign(in, ownerLength);
+        offset += HEADER_SIZE + payloadLength;
+        return true;
+    }
+
+    // Blocks until every record up to and including lsn is on stable storage.
+    bool waitDurable(std::uint64_t lsn) {
+        if (durableLsn.load(std::memory_order_acquire) >= lsn) {
+            return !failed;
+        }
+        std::unique_lock<std::mutex> lock(durableMutex);
+        durableCv.wait(lock, [this, lsn]() { return durableLsn.load() >= lsn || failed; });
+        return !failed;
+    }
+
+private:
+    static const std::size_t HEADER_SIZE = 8;
+    static const std::size_t FIXED_PAYLOAD_SIZE = 8 + 1 + 4 + 4 + 8 + 8 + 2;
+
+    static void encode(std::vector<char> &out, std::uint64_t lsn, RecordType type, std::int32_t account,
+                       std::int32_t counterparty, Money amount, std::int64_t timestamp, std::string_view owner) {
+        std::uint16_t ownerLength = static_cast<std::uint16_t>(owner.size() < 0xFFFF ? owner.size() : 0xFFFF);
+        std::size_t headerAt = out.size();
+        out.resize(headerAt + HEADER_SIZE);
+        putPod(out, lsn);
+        putPod(out, static_cast<std::uint8_t>(type));
+        putPod(out, account);
+        putPod(out, counterparty);
+        putPod(out, amount.minorUnits());
+        putPod(out, timestamp);
+        putPod(out, ownerLength);
+        out.insert(out.end(), owner.data(), owner.data() + ownerLength);
+
+        std::uint32_t payloadLength = static_cast<std::uint32_t>(out.size() - headerAt - HEADER_SIZE);
+        std::uint32_t checksum = crc32(out.data() + headerAt + HEADER_SIZE, payloadLength);
+        std::memcpy(out.data() + headerAt, &payloadLength, 4);
+        std::memcpy(out.data() + headerAt + 4, &checksum, 4);
+    }
+
+    void flushLoop() {
+        std::vector<char> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            appendCv.wait(lock, [this]() { return !pending.empty() || stopping; });
+            if (pending.empty()) {
+                break;
+            }
+            batch.swap(pending);
+            std::uint64_t batchLsn = lastLsn;
+            lock.unlock();
+
+            bool ok = writeFully(fd, batch.data(), batch.size()) && syncFile(fd);
+            if (ok) {
+                std::lock_guard<std::mutex> listenerLock(listenerMutex);
+                if (durableListener) {
+                    durableListener(std::string_view(batch.data(), batch.size()), batchLsn);
+                }
+            }
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> durableLock(durableMutex);
+                if (ok) {
+                    durableLsn.store(batchLsn, std::memory_order_release);
+                } else if (!failed) {
+                    failed = true;
+                    std::cerr << "Transaction log write failed; transactions are no longer durable." << std::endl;
+                }
+            }
+            durableCv.notify_all();
+            lock.lock();
+        }
+    }
+
+    int fd = -1;
+    std::thread flusher;
+
+    std::mutex mutex;
+    std::condition_variable appendCv;
+    std::vector<char> pending;
+    std::uint64_t lastLsn = 0;
+    std::uint64_t appendedBytes = 0;
+    bool stopping = false;
+
+    std::mutex durableMutex;
+    std::condition_variable durableCv;
+    std::atomic<std::uint64_t> durableLsn{0};
+    std::atomic<bool> failed{false};
+
+    std::mutex listenerMutex;
+    std::function<void(std::string_view, std::uint64_t)> durableListener;
+};
+
+// Index of objects keyed by dense integer ids, such as account numbers,
+// which are handed out one after another from 1000. An id maps straight to
+// a slot: directory[(id - base) / CHUNK_SIZE] points at a chunk of
+// CHUNK_SIZE slots. A lookup is two dependent loads with no hashing and no
+// lock; inserts serialize on a mutex. Objects are built in place and never
+// move, so pointers to them stay valid. The dense range covers 2^28 ids
+// above base; ids outside it go to a sparse fallback map.
+template <typename T>
+class DenseIndex {
+public:
+    static const int CHUNK_BITS = 12;
+    static const std::size_t CHUNK_SIZE = std::size_t(1) << CHUNK_BITS;
+    static const std::size_t MAX_CHUNKS = std::size_t(1) << 16;
+
+    explicit DenseIndex(int base = 1000)
+        : base(base), directory(new std::atomic<Chunk*>[MAX_CHUNKS]()) {}
+
+    DenseIndex(const DenseIndex &) = delete;
+    DenseIndex &operator=(const DenseIndex &) = delete;
+
+    ~DenseIndex() {
+        for (std::size_t c = 0; c < MAX_CHUNKS; c++) {
+            Chunk* chunk = directory[c].load();
+            if (!chunk) {
+                continue;
+            }
+            for (std::size_t slot = 0; slot < CHUNK_SIZE; slot++) {
+                if (chunk->present[slot].load()) {
+                    chunk->at(slot)->~T();
+                }
+            }
+            delete chunk;
+        }
+    }
+
+    T* find(int key) const {
+        std::uint64_t offset = denseOffset(key);
+        if (offset < MAX_CHUNKS * CHUNK_SIZE) {
+            Chunk* chunk = directory[offset >> CHUNK_BITS].load(std::memory_order_acquire);
+            std::size_t slot = offset & (CHUNK_SIZE - 1);
+            return chunk && chunk->present[slot].load(std::memory_order_acquire) ? chunk->at(slot) : nullptr;
+        }
+        std::shared_lock<std::shared_mutex> lock(sparseMutex);
+        auto it = sparse.find(key);
+        return it != sparse.end() ? it->second.get() : nullptr;
+    }
+
+    // Builds a T from args under key unless the key is taken. Returns the
+    // object stored under key and whether it was inserted.
+    template <typename... Args>
+    std::pair<T*, bool> emplace(int key, Args &&...args) {
+        std::uint64_t offset = denseOffset(key);
+        if (offset >= MAX_CHUNKS * CHUNK_SIZE) {
+            std::unique_lock<std::shared_mutex> lock(sparseMutex);
+            auto it = sparse.find(key);
+            if (it != sparse.end()) {
+                return {it->second.get(), false};
+            }
+            T* object = sparse.emplace(key, std::make_unique<T>(std::forward<Args>(args)...)).first->second.get();
+            count++;
+            return {object, true};
+        }
+
+        std::lock_guard<std::mutex> lock(insertMutex);
+        std::atomic<Chunk*> &entry = directory[offset >> CHUNK_BITS];
+        Chunk* chunk = entry.load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new Chunk();
+            entry.store(chunk, std::memory_order_release);
+            std::size_t limit = (offset >> CHUNK_BITS) + 1;
+            if (limit > chunkLimit.load(std::memory_order_relaxed)) {
+                chunkLimit.store(limit, std::memory_order_release);
+            }
+        }
+        std::size_t slot = offset & (CHUNK_SIZE - 1);
+        if (chunk->present[slot].load(std::memory_order_relaxed)) {
+            return {chunk->at(slot), false};
+        }
+        T* object = new (chunk->at(slot)) T(std::forward<Args>(args)...);
+        chunk->present[slot].store(1, std::memory_order_release);
+        count++;
+        return {object, true};
+    }
+
+    std::size_t size() const {
+        return count.load();
+    }
+
+    // Calls fn(int key, T &object) for every object, dense ids in order.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        std::size_t limit = chunkCount();
+        for (std::size_t c = 0; c < limit; c++) {
+            forEachInChunk(c, fn);
+        }
+        forEachSparse(fn);
+    }
+
+    // Number of dense chunks a scan has to cover. Chunk c holds ids
+    // base + c * CHUNK_SIZE upwards, so splitting a scan by chunk gives
+    // each part a contiguous run of objects.
+    std::size_t chunkCount() const {
+        return chunkLimit.load(std::memory_order_acquire);
+    }
+
+    // Calls fn(int key, T &object) for every object in dense chunk c, in
+    // id order.
+    template <typename Fn>
+    void forEachInChunk(std::size_t c, Fn &fn) const {
+        Chunk* chunk = directory[c].load(std::memory_order_acquire);
+        if (!chunk) {
+            return;
+        }
+        for (std::size_t slot = 0; slot < CHUNK_SIZE; slot++) {
+            if (chunk->present[slot].load(std::memory_order_acquire)) {
+                fn(static_cast<int>(base + static_cast<std::int64_t>((c << CHUNK_BITS) + slot)), *chunk->at(slot));
+            }
+        }
+    }
+
+    // Calls fn(int key, T &object) for every object outside the dense
+    // range, in no particular order.
+    template <typename Fn>
+    void forEachSparse(Fn &fn) const {
+        std::shared_lock<std::shared_mutex> lock(sparseMutex);
+        for (const auto &entry : sparse) {
+            fn(entry.first, *entry.second);
+        }
+    }
+
+private:
+    struct Chunk {
+        std::atomic<std::uint8_t> present[CHUNK_SIZE];
+        alignas(T) unsigned char storage[CHUNK_SIZE * sizeof(T)];
+
+        T* at(std::size_t slot) {
+            return reinterpret_cast<T*>(storage + slot * sizeof(T));
+        }
+    };
+
+    std::uint64_t denseOffset(int key) const {
+        return static_cast<std::uint64_t>(static_cast<std::int64_t>(key) - base);
+    }
+
+    std::int64_t base;
+    std::unique_ptr<std::atomic<Chunk*>[]> directory;
+    std::mutex insertMutex;
+    std::atomic<std::size_t> count{0};
+    // One past the highest directory entry ever filled, so scans can stop
+    // there instead of walking the whole directory.
+    std::atomic<std::size_t> chunkLimit{0};
+
+    mutable std::shared_mutex sparseMutex;
+    std::unordered_map<int, std::unique_ptr<T>> sparse;
+};
+
+// Lets any number of writer threads through at once, and lets one thread
+// briefly stop them all at a point where no transaction is half applied,
+// e.g. to take a snapshot. Each thread counts itself in on one of STRIPES
+// cache-line-sized counters, so passing the gate costs two uncontended
+// atomic operations rather than a shared reader-lock cache line.
+// Passes must not nest on one thread.
+class CheckpointGate {
+public:
+    class Pass {
+    public:
+        explicit Pass(CheckpointGate &gate) : gate(gate), stripe(gate.enter()) {}
+        Pass(const Pass &) = delete;
+        Pass &operator=(const Pass &) = delete;
+        ~Pass() { gate.leave(stripe); }
+
+    private:
+        CheckpointGate &gate;
+        std::size_t stripe;
+    };
+
+    // Returns once every writer has left; new writers wait until resume().
+    void pause() {
+        pauseMutex.lock();
+        paused.store(true);
+        for (Stripe &stripe : stripes) {
+            while (stripe.count.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void resume() {
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            paused.store(false);
+        }
+        waitCv.notify_all();
+        pauseMutex.unlock();
+    }
+
+private:
+    static const std::size_t STRIPES = 64;
+
+    struct alignas(64) Stripe {
+        std::atomic<int> count{0};
+    };
+
+    std::size_t enter() {
+        static std::atomic<std::size_t> nextStripe{0};
+        thread_local std::size_t stripe = nextStripe.fetch_add(1) % STRIPES;
+        while (true) {
+            stripes[stripe].count.fetch_add(1);
+            if (!paused.load()) {
+                return stripe;
+            }
+            stripes[stripe].count.fetch_sub(1);
+            std::unique_lock<std::mutex> lock(waitMutex);
+            waitCv.wait(lock, [this]() { return !paused.load(); });
+        }
+    }
+
+    void leave(std::size_t stripe) {
+        stripes[stripe].count.fetch_sub(1);
+    }
+
+    Stripe stripes[STRIPES];
+    std::atomic<bool> paused{false};
+    std::mutex pauseMutex;
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+};
+
+// Bank-wide secondary index over transaction history, for questions such
+// as "all transfers to account X between T1 and T2" or "the largest
+// withdrawals this week" that would otherwise mean reading every account.
+//
+// Events are copied into time-partitioned blocks, one per blockMicros of
+// event time, so a query only visits the blocks its range overlaps. Each
+// block is split into STRIPES by account number, each with its own mutex,
+// so concurrent writers rarely meet, and keeps its rows as columns in
+// chunks of CHUNK_ROWS like TransactionHistory. Transfer rows are also
+// listed by counterparty in a sorted inverted index, built the first time
+// a query needs it and merged forward as new rows arrive.
+class HistoryIndex {
+public:
+    typedef TransactionHistory::EventType EventType;
+
+    // A query matches events with from <= timestamp < to whose type is in
+    // types (see typeBit()), of the given account and counterparty when
+    // those are nonzero.
+    struct Query {
+        std::int64_t from = INT64_MIN;
+        std::int64_t to = INT64_MAX;
+        std::uint32_t types = ~0u;
+        int account = 0;
+        int counterparty = 0;
+    };
+
+    struct Row {
+        int account;
+        TransactionHistory::Event event;
+    };
+
+    static std::uint32_t typeBit(EventType type) {
+        return 1u << static_cast<unsigned>(type);
+    }
+
+    explicit HistoryIndex(std::int64_t blockMicros = 3600LL * 1000000) : blockMicros(blockMicros) {}
+
+    HistoryIndex(const HistoryIndex &) = delete;
+    HistoryIndex &operator=(const HistoryIndex &) = delete;
+
+    void add(int account, const TransactionHistory::Event &event) {
+        Stripe &stripe = blockFor(event.timestamp).stripes[static_cast<std::uint32_t>(account) % STRIPES];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        if (stripe.rows % CHUNK_ROWS == 0) {
+            stripe.chunks.emplace_back(new RowChunk());
+        }
+        RowChunk &chunk = *stripe.chunks.back();
+        std::size_t i = stripe.rows % CHUNK_ROWS;
+        chunk.timestamps[i] = event.timestamp;
+        chunk.amounts[i] = event.amount.minorUnits();
+        chunk.accounts[i] = account;
+        chunk.counterparties[i] = event.counterparty;
+        chunk.types[i] = event.type;
+        stripe.rows++;
+        rowCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::size_t size() const {
+        return rowCount.load(std::memory_order_relaxed);
+    }
+
+    // Matching events in timestamp order, at most limit of them (the
+    // earliest).
+    std::vector<Row> find(const Query &query, std::size_t limit = SIZE_MAX) const {
+        std::vector<Row> rows;
+        forEachMatch(query, [&rows](const Row &row) {
+            rows.push_back(row);
+        });
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return a.event.timestamp < b.event.timestamp;
+        });
+        if (rows.size() > limit) {
+            rows.resize(limit);
+        }
+        return rows;
+    }
+
+    // The n matching events with the largest amounts, largest first.
+    std::vector<Row> largest(const Query &query, std::size_t n) const {
+        auto larger = [](const Row &a, const Row &b) {
+            return a.event.amount > b.event.amount;
+        };
+        std::vector<Row> heap;
+        if (n == 0) {
+            return heap;
+        }
+        forEachMatch(query, [&](const Row &row) {
+            if (heap.size() < n) {
+                heap.push_back(row);
+                std::push_heap(heap.begin(), heap.end(), larger);
+            } else if (row.event.amount > heap.front().event.amount) {
+                std::pop_heap(heap.begin(), heap.end(), larger);
+                heap.back() = row;
+                std::push_heap(heap.begin(), heap.end(), larger);
+            }
+        });
+        std::sort_heap(heap.begin(), heap.end(), larger);
+        return heap;
+    }
+
+    // Calls fn(const Row &) for every matching row, in no particular order.
+    template <typename Fn>
+    void forEachMatch(const Query &query, Fn fn) const {
+        std::vector<Block *> overlapping;
+        {
+            std::shared_lock<std::shared_mutex> lock(blocksMutex);
+            auto it = blocks.upper_bound(query.from);
+            if (it != blocks.begin()) {
+                --it;
+            }
+            for (; it != blocks.end() && it->first < query.to; ++it) {
+                overlapping.push_back(it->second.get());
+            }
+        }
+        for (Block *block : overlapping) {
+            for (Stripe &stripe : block->stripes) {
+                std::lock_guard<std::mutex> lock(stripe.mutex);
+                auto visit = [&](std::size_t r) {
+                    const RowChunk &chunk = *stripe.chunks[r / CHUNK_ROWS];
+                    std::size_t i = r % CHUNK_ROWS;
+                    if (chunk.timestamps[i] < query.from || chunk.timestamps[i] >= query.to
+                        || !(query.types & typeBit(chunk.types[i]))
+                        || (query.account != 0 && chunk.accounts[i] != query.account)
+                        || (query.counterparty != 0 && chunk.counterparties[i] != query.counterparty)) {
+                        return;
+                    }
+                    fn(Row{chunk.accounts[i], TransactionHistory::Event{chunk.types[i], Money::fromCents(chunk.amounts[i]),
+                                                                        chunk.counterparties[i], chunk.timestamps[i]}});
+                };
+                if (query.counterparty == 0) {
+                    for (std::size_t r = 0; r < stripe.rows; r++) {
+                        visit(r);
+                    }
+                    continue;
+                }
+                if (stripe.rows - stripe.indexedRows >= MERGE_AFTER) {
+                    mergeCounterparties(stripe);
+                }
+                auto first = std::lower_bound(stripe.byCounterparty.begin(), stripe.byCounterparty.end(),
+                                              std::make_pair(static_cast<std::int32_t>(query.counterparty), std::uint32_t(0)));
+                for (auto it = first; it != stripe.byCounterparty.end() && it->first == query.counterparty; ++it) {
+                    visit(it->second);
+                }
+                for (std::size_t r = stripe.indexedRows; r < stripe.rows; r++) {
+                    visit(r);
+                }
+            }
+        }
+    }
+
+private:
+    static const std::size_t STRIPES = 8;
+    static const std::size_t CHUNK_ROWS = 1024;
+    // Unindexed transfer rows a counterparty query scans before it merges
+    // them into the inverted index.
+    static const std::size_t MERGE_AFTER = 1024;
+
+    struct RowChunk {
+        std::int64_t timestamps[CHUNK_ROWS];
+        std::int64_t amounts[CHUNK_ROWS];
+        std::int32_t accounts[CHUNK_ROWS];
+        std::int32_t counterparties[CHUNK_ROWS];
+        EventType types[CHUNK_ROWS];
+    };
+
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<RowChunk>> chunks;
+        std::size_t rows = 0;
+        // (counterparty, row) for every transfer among the first
+        // indexedRows rows, sorted.
+        std::vector<std::pair<std::int32_t, std::uint32_t>> byCounterparty;
+        std::size_t indexedRows = 0;
+    };
+
+    struct Block {
+        std::int64_t start;
+        Stripe stripes[STRIPES];
+    };
+
+    Block &blockFor(std::int64_t timestamp) {
+        std::int64_t start = timestamp - ((timestamp % blockMicros) + blockMicros) % blockMicros;
+        Block *block = latest.load(std::memory_order_acquire);
+        if (block && block->start == start) {
+            return *block;
+        }
+        {
+            std::shared_lock<std::shared_mutex> lock(blocksMutex);
+            auto it = blocks.find(start);
+            if (it != blocks.end()) {
+                return *it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(blocksMutex);
+        std::unique_ptr<Block> &slot = blocks[start];
+        if (!slot) {
+            slot.reset(new Block());
+            slot->start = start;
+            if (!block || start > block->start) {
+                latest.store(slot.get(), std::memory_order_release);
+            }
+        }
+        return *slot;
+    }
+
+    // Sorts the transfer rows added since the last merge and merges them
+    // into the stripe's inverted index. The stripe must be locked.
+    static void mergeCounterparties(Stripe &stripe) {
+        std::size_t middle = stripe.byCounterparty.size();
+        for (std::size_t r = stripe.indexedRows; r < stripe.rows; r++) {
+            const RowChunk &chunk = *stripe.chunks[r / CHUNK_ROWS];
+            std::size_t i = r % CHUNK_ROWS;
+            if (chunk.types[i] == EventType::TransferOut || chunk.types[i] == EventType::TransferIn) {
+                stripe.byCounterparty.emplace_back(chunk.counterparties[i], static_cast<std::uint32_t>(r));
+            }
+        }
+        std::sort(stripe.byCounterparty.begin() + middle, stripe.byCounterparty.end());
+        std::inplace_merge(stripe.byCounterparty.begin(), stripe.byCounterparty.begin() + middle, stripe.byCounterparty.end());
+        stripe.indexedRows = stripe.rows;
+    }
+
+    std::int64_t blockMicros;
+    mutable std::shared_mutex blocksMutex;
+    std::map<std::int64_t, std::unique_ptr<Block>> blocks;
+    std::atomic<Block *> latest{nullptr};
+    std::atomic<std::size_t> rowCount{0};
+};
+
+// Fixed set of threads for splitting a bulk job over all accounts. run()
+// hands out task numbers from a shared counter, so threads that finish
+// early take on more, and the calling thread works through tasks too.
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads) {
+        for (unsigned i = 1; i < threads; i++) {
+            workers.emplace_back(&WorkerPool::workLoop, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        startCv.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Threads run() spreads work over, the caller included.
+    std::size_t size() const {
+        return workers.size() + 1;
+    }
+
+    // Calls fn(task) once for every task in [0, tasks) and returns when
+    // all of them have finished. One run() at a time.
+    void run(std::size_t tasks, const std::function<void(std::size_t)> &fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            taskCount = tasks;
+            nextTask.store(0);
+            busy = workers.size();
+            generation++;
+        }
+        startCv.notify_all();
+        work(fn, tasks);
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCv.wait(lock, [this]() { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    void work(const std::function<void(std::size_t)> &fn, std::size_t tasks) {
+        for (std::size_t task = nextTask.fetch_add(1); task < tasks; task = nextTask.fetch_add(1)) {
+            fn(task);
+        }
+    }
+
+    void workLoop() {
+        std::uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            startCv.wait(lock, [this, &seen]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            const std::function<void(std::size_t)> *fn = job;
+            std::size_t tasks = taskCount;
+            lock.unlock();
+            work(*fn, tasks);
+            lock.lock();
+            if (--busy == 0) {
+                doneCv.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCv;
+    std::condition_variable doneCv;
+    const std::function<void(std::size_t)> *job = nullptr;
+    std::size_t taskCount = 0;
+    std::atomic<std::size_t> nextTask{0};
+    std::size_t busy = 0;
+    std::uint64_t generation = 0;
+    bool stopping = false;
+};
+
+// One row of a batch handed to BankingSystem::applyBatch().
+struct Txn {
+    enum class Kind : std::uint8_t {
+        Deposit,
+        Withdraw,
+        Transfer
+    };
+
+    Kind kind;
+    int account;
+    int counterparty;  // recipient of a transfer, unused otherwise
+    Money amount;
+};
+
+// Counts reported by BankingSystem::importFile().
+struct ImportResult {
+    bool ok = true;
+    bool durable = true;  // false if the log could not be written
+    std::size_t accounts = 0;
+    std::size_t transactions = 0;
+    std::size_t rejected = 0;
+};
+
+// Outcome of BankingSystem::auditHistories().
+struct AuditResult {
+    std::size_t accounts = 0;
+    std::size_t events = 0;   // events re-hashed
+    std::vector<int> failed;  // accounts whose history no longer matches its chain
+};
+
+// Terms of a periodic run over every account (BankingSystem::sweep()).
+// Positive balances earn interestBasisPoints / 10000 of themselves,
+// rounded half up to the cent; then monthlyFee is charged, capped at what
+// the account holds, to accounts whose balance before interest is below
+// feeWaiverBalance.
+struct SweepRule {
+    std::int32_t interestBasisPoints = 0;
+    Money monthlyFee;
+    Money feeWaiverBalance;
+
+    bool isValid() const {
+        return interestBasisPoints >= 0 && interestBasisPoints <= 10000 && !(monthlyFee < Money());
+    }
+};
+
+// Totals reported by BankingSystem::sweep().
+struct SweepResult {
+    bool ok = true;
+    bool durable = true;  // false if the log could not be written
+    std::size_t accounts = 0;  // accounts whose balance changed
+    Money interestPaid;
+    Money feesCharged;
+};
+
+// Interest and fee for n balances laid out contiguously, written to the
+// matching slots of interest and fees. The loop has no branches and no
+// calls, so the compiler is free to vectorize it.
+void sweepKernel(const SweepRule &rule, const std::int64_t *balances, std::int64_t *interest, std::int64_t *fees,
+                 std::size_t n) {
+    const std::int64_t rate = rule.interestBasisPoints;
+    const std::int64_t fee = rule.monthlyFee.minorUnits();
+    const std::int64_t waiver = rule.feeWaiverBalance.minorUnits();
+    for (std::size_t i = 0; i < n; i++) {
+        std::int64_t balance = balances[i];
+        std::int64_t positive = balance > 0 ? balance : 0;
+        std::int64_t earned = positive / 10000 * rate + (positive % 10000 * rate + 5000) / 10000;
+        std::int64_t headroom = INT64_MAX - positive;
+        earned = earned < headroom ? earned : headroom;
+        std::int64_t available = balance + earned;
+        std::int64_t charge = fee < available ? fee : available;
+        charge = charge > 0 && balance < waiver ? charge : 0;
+        interest[i] = earned;
+        fees[i] = charge;
+    }
+}
+
+// Accounts live in a DenseIndex keyed by account number, so finding one
+// is lock-free and an Account* stays valid for the life of the system.
+// Balances are guarded by the per-account mutex.
+//
+// When a transaction log is attached every successful change is appended
+// while the affected accounts are still locked, so the log order matches
+// the order in which changes were applied, and the call returns only once
+// its record is durable.
+class BankingSystem {
+public:
+    // Account records' names and histories come from memory, or from an
+    // arena owned by the bank (released in one go with it) if none is given.
+    explicit BankingSystem(std::pmr::memory_resource *memory = nullptr)
+        : memory(memory ? memory : &arena), accounts(FIRST_ACCOUNT_NUMBER) {}
+
+    // Rebuilds the accounts from an existing log (only the part after a
+    // loaded snapshot), then logs every further change to it. Returns the number of records replayed, or -1 on error.
+    long long openLog(const std::string &path) {
+        long long replayed = 0;
+        bool ok = log.open(path, [this, &replayed](const TransactionLog::Record &record) {
+            replay(record);
+            replayed++;
+        }, snapshotLsn, snapshotOffset);
+        commitAll();
+        if (ok) {
+            logPath = path;
+        }
+        return ok ? replayed : -1;
+    }
+
+    const std::string &logFile() const {
+        return logPath;
+    }
+
+    // A replication follower is read-only until promoted: every change
+    // other than applyReplicated() fails with TxnStatus::ReadOnly (and
+    // openAccount() returns -1 and reports it through status).
+    void setReadOnly(bool value) {
+        readOnly.store(value);
+    }
+
+    bool isReadOnly() const {
+        return readOnly.load(std::memory_order_relaxed);
+    }
+
+    // LSN of the last change this system holds, logged or replicated.
+    std::uint64_t lastLsn() {
+        return log.isOpen() ? log.position().first : replicatedLsn.load();
+    }
+
+    // Calls listener(bytes, lastLsn) with each batch of whole log records
+    // once it is durable; see TransactionLog::setListener().
+    void setLogListener(std::function<void(std::string_view, std::uint64_t)> listener) {
+        log.setListener(std::move(listener));
+    }
+
+    // Follower side of replication: applies records streamed from the
+    // leader, which must carry on from lastLsn() (older ones are skipped),
+    // appending them to this system's own log first if it has one. Batches
+    // must arrive whole. Readers see each call's changes all at once.
+    // Returns false, applying nothing, if records would leave a gap.
+    bool applyReplicated(const TransactionLog::Record *records, std::size_t count) {
+        std::lock_guard<std::mutex> bulkLock(bulkMutex);
+        std::uint64_t last = lastLsn();
+        std::size_t first = 0;
+        while (first < count && records[first].lsn <= last) {
+            first++;
+        }
+        if (first == count) {
+            return true;
+        }
+        if (records[first].lsn != last + 1 || (log.isOpen() && !log.appendReplicated(records + first, count - first))) {
+            return false;
+        }
+        std::unique_ptr<CheckpointGate::Pass> pass(new CheckpointGate::Pass(gate));
+        std::vector<Account*> touched;
+        auto commitTouched = [this, &touched]() {
+            // Locked in ascending account-number order, like transfer().
+            std::sort(touched.begin(), touched.end(), [](const Account *a, const Account *b) {
+                return a->accountNumber < b->accountNumber;
+            });
+            touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+            std::vector<std::unique_lock<std::mutex>> locks;
+            locks.reserve(touched.size());
+            for (Account* account : touched) {
+                locks.push_back(account->lock());
+            }
+            if (!touched.empty()) {
+                commit(touched.data(), touched.size());
+            }
+            touched.clear();
+        };
+        for (std::size_t i = first; i < count; i++) {
+            const TransactionLog::Record &record = records[i];
+            if (record.type == TransactionLog::RecordType::Sweep) {
+                // The sweep commits every account itself, and like sweep()
+                // runs with everything that passes the gate held back.
+                commitTouched();
+                pass.reset();
+                gate.pause();
+                replay(record);
+                gate.resume();
+                pass.reset(new CheckpointGate::Pass(gate));
+                continue;
+            }
+            replay(record);
+            if (record.type == TransactionLog::RecordType::Deposit || record.type == TransactionLog::RecordType::Withdraw
+                || record.type == TransactionLog::RecordType::Transfer) {
+                if (Account* account = findAccount(record.account)) {
+                    touched.push_back(account);
+                }
+                if (record.type == TransactionLog::RecordType::Transfer) {
+                    if (Account* toAccount = findAccount(record.counterparty)) {
+                        touched.push_back(toAccount);
+                    }
+                }
+            }
+        }
+        commitTouched();
+        replicatedLsn.store(records[count - 1].lsn);
+        return true;
+    }
+
+    // Pins the current state for consistent lock-free reads across any
+    // number of accounts (see Account::getBalance(view)).
+    VersionClock::ReadView readView() const {
+        return VersionClock::ReadView(versions);
+    }
+
+    // Sum of all balances as of the view's commit.
+    Money totalBalance(const VersionClock::ReadView &view) const {
+        Money total;
+        accounts.forEach([&total, &view](int, const Account &account) {
+            total.checkedAdd(account.getBalance(view), total);
+        });
+        return total;
+    }
+
+    // Returns the new account number, or -1 with the reason in status.
+    int openAccount(const std::string &owner, TxnStatus *status = nullptr) {
+        BANK_TIMED(OpenAccount);
+        TxnStatus ignored;
+        TxnStatus &outcome = status ? *status : ignored;
+        if (isReadOnly()) {
+            outcome = TxnStatus::ReadOnly;
+            return -1;
+        }
+        // Nobody can reach the new number before it is inserted, so logging
+        // the creation first keeps it ahead of every later record for the
+        // account. A number already taken by an import is skipped; replay
+        // ignores the duplicate creation.
+        // The insert happens under the same gate pass as the log record, so
+        // a snapshot never sees the creation logged without the account.
+        int accountNumber;
+        std::uint64_t lsn = 0;
+        bool inserted;
+        do {
+            CheckpointGate::Pass pass(gate);
+            accountNumber = nextAccountNumber.fetch_add(1);
+            if (log.isOpen()) {
+                lsn = log.append(TransactionLog::RecordType::CreateAccount, accountNumber, 0, Money(), nowMicros(), owner);
+            }
+            inserted = accounts.emplace(accountNumber, owner, accountNumber, versions, memory).second;
+        } while (!inserted);
+        if (!waitDurable(lsn)) {
+            outcome = TxnStatus::NotDurable;
+            return -1;
+        }
+        outcome = TxnStatus::Ok;
+        return accountNumber;
+    }
+
+    void createAccount(const std::string &owner) {
+        TxnStatus status;
+        int accountNumber = openAccount(owner, &status);
+        if (accountNumber < 0) {
+            std::cout << describeStatus(status) << std::endl;
+            return;
+        }
+        std::cout << "Account created for " << owner << " with account number " << accountNumber << std::endl;
+    }
+
+    // Quiet lookup for callers that handle a missing account themselves.
+    Account* findAccount(int accountNumber) {
+        return accounts.find(accountNumber);
+    }
+
+    Account* getAccount(int accountNumber) {
+        BANK_TIMED(GetAccount);
+        if (Account* account = findAccount(accountNumber)) {
+            return account;
+        } else {
+            static_cast<void>(BANK_RESULT(TxnStatus::AccountNotFound));
+            std::cout << "Account not found." << std::endl;
+            return nullptr;
+        }
+    }
+
+    TxnStatus deposit(int accountNumber, Money amount) {
+        BANK_TIMED(Deposit);
+        if (isReadOnly()) {
+            return BANK_RESULT(TxnStatus::ReadOnly);
+        }
+        Account* account = findAccount(accountNumber);
+        if (!account) {
+            return BANK_RESULT(TxnStatus::AccountNotFound);
+        }
+        std::uint64_t lsn = 0;
+        TxnStatus status;
+        {
+            CheckpointGate::Pass pass(gate);
+            auto lock = account->lock();
+            std::int64_t timestamp = nowMicros();
+            status = account->deposit(amount, timestamp);
+            if (status == TxnStatus::Ok) {
+                commit(&account, 1);
+            }
+            if (status == TxnStatus::Ok && log.isOpen()) {
+                lsn = log.append(TransactionLog::RecordType::Deposit, accountNumber, 0, amount, timestamp);
+            }
+        }
+        if (!waitDurable(lsn)) {
+            status = TxnStatus::NotDurable;
+        }
+        return BANK_RESULT(status);
+    }
+
+    TxnStatus withdraw(int accountNumber, Money amount) {
+        BANK_TIMED(Withdraw);
+        if (isReadOnly()) {
+            return BANK_RESULT(TxnStatus::ReadOnly);
+        }
+        Account* account = findAccount(accountNumber);
+        if (!account) {
+            return BANK_RESULT(TxnStatus::AccountNotFound);
+        }
+        std::uint64_t lsn = 0;
+        TxnStatus status;
+        {
+            CheckpointGate::Pass pass(gate);
+            if (limits) {
+                account->prefetchLimits();
+            }
+            auto lock = account->lock();
+            std::int64_t timestamp = nowMicros();
+            status = limitedDebit(*account, TransactionHistory::EventType::Withdraw, amount, timestamp,
+                                  [&]() { return account->withdraw(amount, timestamp); });
+            if (status == TxnStatus::Ok) {
+                commit(&account, 1);
+            }
+            if (status == TxnStatus::Ok && log.isOpen()) {
+                lsn = log.append(TransactionLog::RecordType::Withdraw, accountNumber, 0, amount, timestamp);
+            }
+        }
+        if (!waitDurable(lsn)) {
+            status = TxnStatus::NotDurable;
+        }
+        return BANK_RESULT(status);
+    }
+
+    TxnStatus transfer(int fromAccountNumber, int toAccountNumber, Money amount) {
+        BANK_TIMED(Transfer);
+        if (isReadOnly()) {
+            return BANK_RESULT(TxnStatus::ReadOnly);
+        }
+        Account* fromAccount = findAccount(fromAccountNumber);
+        Account* toAccount = findAccount(toAccountNumber);
+        if (!fromAccount || !toAccount) {
+            return BANK_RESULT(TxnStatus::AccountNotFound);
+        }
+        if (fromAccount == toAccount) {
+            return BANK_RESULT(TxnStatus::SameAccount);
+        }
+        std::uint64_t lsn = 0;
+        TxnStatus status;
+        {
+            CheckpointGate::Pass pass(gate);
+            if (limits) {
+                fromAccount->prefetchLimits();
+            }
+            auto locks = fromAccount->lockWith(*toAccount);
+            std::int64_t timestamp = nowMicros();
+            status = limitedDebit(*fromAccount, TransactionHistory::EventType::TransferOut, amount, timestamp,
+                                  [&]() { return fromAccount->transfer(*toAccount, amount, timestamp); });
+            if (status == TxnStatus::Ok) {
+                Account* touched[2] = {fromAccount, toAccount};
+                commit(touched, 2);
+            }
+            if (status == TxnStatus::Ok && log.isOpen()) {
+                lsn = log.append(TransactionLog::RecordType::Transfer, fromAccountNumber, toAccountNumber, amount, timestamp);
+            }
+        }
+        if (!waitDurable(lsn)) {
+            status = TxnStatus::NotDurable;
+        }
+        return BANK_RESULT(status);
+    }
+
+    // Validates and applies a whole batch with one lookup per distinct
+    // account and one log flush. Every account the batch touches is locked,
+    // in ascending account-number order like transfer(), for the whole
+    // apply, so other threads see none or all of the batch; the log frames
+    // it so recovery does the same. Rows are applied in order and
+    // statuses[i] reports row i; failed rows change nothing. Metrics time
+    // the batch as a single applyBatch call.
+    std::vector<TxnStatus> applyBatch(const Txn *txns, std::size_t count) {
+        BANK_TIMED(ApplyBatch);
+        if (isReadOnly()) {
+            return std::vector<TxnStatus>(count, TxnStatus::ReadOnly);
+        }
+        std::vector<TxnStatus> statuses(count, TxnStatus::Ok);
+
+        std::vector<int> keys;
+        keys.reserve(count * 2);
+        for (std::size_t i = 0; i < count; i++) {
+            keys.push_back(txns[i].account);
+            if (txns[i].kind == Txn::Kind::Transfer) {
+                keys.push_back(txns[i].counterparty);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<Account*> resolved(keys.size());
+        for (std::size_t k = 0; k < keys.size(); k++) {
+            resolved[k] = findAccount(keys[k]);
+        }
+        auto lookup = [&keys, &resolved](int accountNumber) {
+            return resolved[std::lower_bound(keys.begin(), keys.end(), accountNumber) - keys.begin()];
+        };
+
+        std::vector<std::pair<Account*, Account*>> rows(count);
+        for (std::size_t i = 0; i < count; i++) {
+            const Txn &txn = txns[i];
+            Account* account = lookup(txn.account);
+            Account* toAccount = txn.kind == Txn::Kind::Transfer ? lookup(txn.counterparty) : nullptr;
+            if (!txn.amount.isPositive()) {
+                statuses[i] = TxnStatus::InvalidAmount;
+            } else if (!account || (txn.kind == Txn::Kind::Transfer && !toAccount)) {
+                statuses[i] = TxnStatus::AccountNotFound;
+            } else if (account == toAccount) {
+                statuses[i] = TxnStatus::SameAccount;
+            }
+            rows[i] = {account, toAccount};
+        }
+
+        std::unique_ptr<CheckpointGate::Pass> pass(new CheckpointGate::Pass(gate));
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(resolved.size());
+        for (Account* account : resolved) {
+            if (account) {
+                locks.push_back(account->lock());
+            }
+        }
+
+        std::int64_t timestamp = nowMicros();
+        std::vector<TransactionLog::Entry> entries;
+        std::vector<Account*> changed;
+        for (std::size_t i = 0; i < count; i++) {
+            if (statuses[i] != TxnStatus::Ok) {
+                continue;
+            }
+            const Txn &txn = txns[i];
+            TransactionLog::RecordType type;
+            switch (txn.kind) {
+                case Txn::Kind::Deposit:
+                    statuses[i] = rows[i].first->deposit(txn.amount, timestamp);
+                    type = TransactionLog::RecordType::Deposit;
+                    break;
+                case Txn::Kind::Withdraw:
+                    statuses[i] = limitedDebit(*rows[i].first, TransactionHistory::EventType::Withdraw, txn.amount, timestamp,
+                                               [&]() { return rows[i].first->withdraw(txn.amount, timestamp); });
+                    type = TransactionLog::RecordType::Withdraw;
+                    break;
+                default:
+                    statuses[i] = limitedDebit(*rows[i].first, TransactionHistory::EventType::TransferOut, txn.amount, timestamp,
+                                               [&]() { return rows[i].first->transfer(*rows[i].second, txn.amount, timestamp); });
+                    type = TransactionLog::RecordType::Transfer;
+                    break;
+            }
+            if (statuses[i] != TxnStatus::Ok) {
+                continue;
+            }
+            changed.push_back(rows[i].first);
+            if (rows[i].second) {
+                changed.push_back(rows[i].second);
+            }
+            if (log.isOpen()) {
+                entries.push_back({type, txn.account, txn.kind == Txn::Kind::Transfer ? txn.counterparty : 0, txn.amount, timestamp, {}});
+            }
+        }
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        if (!changed.empty()) {
+            commit(changed.data(), changed.size());
+        }
+        std::uint64_t lsn = entries.empty() ? 0 : log.appendBatch(entries.data(), entries.size());
+        locks.clear();
+        pass.reset();
+        if (!waitDurable(lsn)) {
+            for (TxnStatus &status : statuses) {
+                if (status == TxnStatus::Ok) {
+                    status = TxnStatus::NotDurable;
+                }
+            }
+        }
+        return statuses;
+    }
+
+    std::vector<TxnStatus> applyBatch(const std::vector<Txn> &txns) {
+        return applyBatch(txns.data(), txns.size());
+    }
+
+    // Bulk-loads a CSV file of accounts and transactions, one record per
+    // line ('#' starts a comment). Meant to run before the system starts
+    // serving other threads, and not alongside startSnapshot(), since new
+    // accounts are logged a chunk after they become visible:
+    //
+    //     A,<account number>,<owner>,<opening balance>
+    //     D,<account>,<amount>      W,<account>,<amount>
+    //     T,<from account>,<to account>,<amount>
+    //
+    // The file is memory-mapped and parsed in place. Accounts are inserted
+    // straight into the dense index and logged in chunks, transactions go
+    // through applyBatch(), and the file order between the two is preserved.
+    ImportResult importFile(const std::string &path) {
+        ImportResult result;
+        MappedFile file(path);
+        if (!file.isOpen() || isReadOnly()) {
+            result.ok = false;
+            return result;
+        }
+        std::string_view text = file.contents();
+
+        const std::size_t CHUNK_ROWS = 1 << 20;
+        std::vector<TransactionLog::Entry> accountEntries;
+        std::vector<Txn> txns;
+        auto flushAccounts = [this, &accountEntries, &result]() {
+            if (!accountEntries.empty() && log.isOpen()
+                && !waitDurable(log.appendBatch(accountEntries.data(), accountEntries.size()))) {
+                result.durable = false;
+            }
+            accountEntries.clear();
+        };
+        auto flushTxns = [this, &txns, &result]() {
+            if (txns.empty()) {
+                return;
+            }
+            for (TxnStatus status : applyBatch(txns)) {
+                if (status == TxnStatus::Ok) {
+                    result.transactions++;
+                } else if (status == TxnStatus::NotDurable) {
+                    result.transactions++;
+                    result.durable = false;
+                } else {
+                    result.rejected++;
+                }
+            }
+            txns.clear();
+        };
+
+        std::int64_t timestamp = nowMicros();
+        std::string_view fields[4];
+        for (std::size_t pos = 0; pos < text.size();) {
+            const void *newline = std::memchr(text.data() + pos, '\n', text.size() - pos);
+            std::size_t end = newline ? static_cast<const char *>(newline) - text.data() : text.size();
+            std::string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            std::size_t fieldCount = 0;
+            while (fieldCount < 4) {
+                std::size_t comma = line.find(',');
+                fields[fieldCount++] = line.substr(0, comma);
+                if (comma == std::string_view::npos) {
+                    break;
+                }
+                line.remove_prefix(comma + 1);
+            }
+
+            int accountNumber = 0;
+            int counterparty = 0;
+            Money amount;
+            char kind = fields[0].size() == 1 ? fields[0][0] : '?';
+            bool valid = fieldCount >= 3 && parseInt(fields[1], accountNumber);
+            if (kind == 'A') {
+                Account* account = nullptr;
+                valid = valid && fieldCount == 4 && Money::parse(fields[3], amount) && !(amount < Money())
+                        && (account = insertAccount(accountNumber, std::string(fields[2]))) != nullptr;
+                if (!valid) {
+                    result.rejected++;
+                    continue;
+                }
+                flushTxns();
+                if (amount.isPositive()) {
+                    auto lock = account->lock();
+                    account->deposit(amount, timestamp);
+                    commit(&account, 1);
+                }
+                if (log.isOpen()) {
+                    accountEntries.push_back({TransactionLog::RecordType::CreateAccount, accountNumber, 0, Money(), timestamp, fields[2]});
+                    if (amount.isPositive()) {
+                        accountEntries.push_back({TransactionLog::RecordType::Deposit, accountNumber, 0, amount, timestamp, {}});
+                    }
+                }
+                result.accounts++;
+                if (accountEntries.size() >= CHUNK_ROWS) {
+                    flushAccounts();
+                }
+            } else if (kind == 'D' || kind == 'W' || kind == 'T') {
+                bool transfer = kind == 'T';
+                valid = valid && fieldCount == (transfer ? 4u : 3u) && Money::parse(fields[transfer ? 3 : 2], amount)
+                        && (!transfer || parseInt(fields[2], counterparty));
+                if (!valid) {
+                    result.rejected++;
+                    continue;
+                }
+                flushAccounts();
+                Txn::Kind txnKind = kind == 'D' ? Txn::Kind::Deposit : kind == 'W' ? Txn::Kind::Withdraw : Txn::Kind::Transfer;
+                txns.push_back({txnKind, accountNumber, counterparty, amount});
+                if (txns.size() >= CHUNK_ROWS) {
+                    flushTxns();
+                }
+            } else {
+                result.rejected++;
+            }
+        }
+        flushAccounts();
+        flushTxns();
+        return result;
+    }
+
+    // Pays interest and charges the monthly fee on every account per rule,
+    // recording an Interest and/or Fee event on each account it changes.
+    // The accounts are split by index chunk across the worker pool, and
+    // each chunk's balances are gathered into one array for sweepKernel().
+    // Writers wait at the gate while the sweep runs, so it takes no account
+    // locks; read views see all of it or none of it.
+    SweepResult sweep(const SweepRule &rule) {
+        SweepResult result;
+        if (!rule.isValid() || isReadOnly()) {
+            result.ok = false;
+            return result;
+        }
+        std::lock_guard<std::mutex> bulkLock(bulkMutex);
+        std::uint64_t lsn = 0;
+        gate.pause();
+        std::int64_t timestamp = nowMicros();
+        if (log.isOpen()) {
+            std::vector<char> waiver;
+            putPod(waiver, rule.feeWaiverBalance.minorUnits());
+            lsn = log.append(TransactionLog::RecordType::Sweep, rule.interestBasisPoints, 0, rule.monthlyFee, timestamp,
+                             std::string_view(waiver.data(), waiver.size()));
+        }
+        result = applySweep(rule, timestamp);
+        gate.resume();
+        result.durable = waitDurable(lsn);
+        return result;
+    }
+
+    // Checks every account's history against its hash chain on the worker
+    // pool. An account that passed its last audit is only re-hashed from
+    // where that audit ended, unless full is set; one that fails is
+    // reported and checked from the start again next time. Writers keep
+    // running: each account is locked only while its chain end is read.
+    AuditResult auditHistories(bool full = false) {
+        std::lock_guard<std::mutex> bulkLock(bulkMutex);
+        std::size_t tasks = accounts.chunkCount() + 1;
+        std::vector<AuditResult> parts(tasks);
+        workers().run(tasks, [&](std::size_t task) {
+            std::vector<std::pair<Account*, TransactionHistory::Checkpoint>> ends;
+            {
+                CheckpointGate::Pass pass(gate);
+                auto collect = [&ends](int, Account &account) {
+                    auto lock = account.lock();
+                    ends.emplace_back(&account, account.history.checkpoint());
+                };
+                if (task + 1 < tasks) {
+                    accounts.forEachInChunk(task, collect);
+                } else {
+                    accounts.forEachSparse(collect);
+                }
+            }
+            AuditResult &part = parts[task];
+            for (const auto &end : ends) {
+                Account &account = *end.first;
+                TransactionHistory::Checkpoint from = full || account.audited.events == 0 ? account.history.genesis() : account.audited;
+                part.accounts++;
+                part.events += end.second.events - std::min(from.events, end.second.events);
+                if (account.history.verify(from, end.second)) {
+                    account.audited = end.second;
+                } else {
+                    account.audited = TransactionHistory::Checkpoint();
+                    part.failed.push_back(account.accountNumber);
+                }
+            }
+        });
+
+        AuditResult result;
+        for (const AuditResult &part : parts) {
+            result.accounts += part.accounts;
+            result.events += part.events;
+            result.failed.insert(result.failed.end(), part.failed.begin(), part.failed.end());
+        }
+        std::sort(result.failed.begin(), result.failed.end());
+        return result;
+    }
+
+    // Current end of an account's hash chain, for an auditor to keep; the
+    // digest then vouches for every event up to that point.
+    bool historyCheckpoint(int accountNumber, TransactionHistory::Checkpoint &checkpoint) {
+        Account* account = findAccount(accountNumber);
+        if (!account) {
+            return false;
+        }
+        CheckpointGate::Pass pass(gate);
+        auto lock = account->lock();
+        checkpoint = account->history.checkpoint();
+        return true;
+    }
+
+    // Starts copying every history event into a HistoryIndex with the given
+    // block width. Call before loadSnapshot() and openLog() so restored
+    // history is indexed too.
+    void enableHistoryIndex(std::int64_t blockMicros = 3600LL * 1000000) {
+        eventIndex.reset(new HistoryIndex(blockMicros));
+    }
+
+    // The index enabled by enableHistoryIndex(), or nullptr.
+    const HistoryIndex *historyIndex() const {
+        return eventIndex.get();
+    }
+
+    // Replaces the velocity limits withdraw(), transfer() and applyBatch()
+    // enforce; an empty list removes them. Counting starts afresh under the
+    // new rules. Returns false, changing nothing, if a rule is invalid.
+    bool setVelocityLimits(const std::vector<VelocityRule> &rules) {
+        std::lock_guard<std::mutex> bulkLock(bulkMutex);
+        std::unique_ptr<VelocityLimits> compiled;
+        if (!rules.empty()) {
+            compiled = VelocityLimits::compile(rules, ++limitGeneration);
+            if (!compiled) {
+                return false;
+            }
+        }
+        gate.pause();
+        limits.swap(compiled);
+        gate.resume();
+        return true;
+    }
+
+    // Number of threads bulk jobs such as sweep() use; defaults to the
+    // hardware thread count. Not to be changed while one runs.
+    void setWorkerThreads(unsigned threads) {
+        pool.reset(new WorkerPool(threads > 0 ? threads : 1));
+    }
+
+    // Starts writing a point-in-time image of the whole system (accounts,
+    // balances, histories, nextAccountNumber and the log position it
+    // covers) to path; finish with waitSnapshot(). Writers are held at the
+    // gate only for the fork(): the child serializes its copy-on-write view
+    // of memory while this process keeps applying transactions. Windows has
+    // no fork(), so there the image is written with the gate closed.
+    bool startSnapshot(const std::string &path) {
+        if (snapshotRunning) {
+            return false;
+        }
+        snapshotPath = path;
+        gate.pause();
+        std::pair<std::uint64_t, std::uint64_t> position(0, 0);
+        if (log.isOpen()) {
+            position = log.position();
+        }
+        snapshotLsn = position.first;
+#ifdef _WIN32
+        snapshotWritten = writeSnapshot(path + ".tmp", position.first, position.second);
+        gate.resume();
+#else
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(writeSnapshot(path + ".tmp", position.first, position.second) ? 0 : 1);
+        }
+        gate.resume();
+        if (pid < 0) {
+            return false;
+        }
+        snapshotPid = pid;
+#endif
+        snapshotRunning = true;
+        return true;
+    }
+
+    // Waits for the snapshot started by startSnapshot(). The new image only
+    // replaces the previous one once every transaction it contains is
+    // durable in the log, so it never gets ahead of the log.
+    bool waitSnapshot() {
+        if (!snapshotRunning) {
+            return false;
+        }
+        snapshotRunning = false;
+#ifndef _WIN32
+        int status = 0;
+        snapshotWritten = waitpid(snapshotPid, &status, 0) == snapshotPid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+        if (!snapshotWritten || (snapshotLsn > 0 && !log.waitDurable(snapshotLsn))) {
+            std::remove((snapshotPath + ".tmp").c_str());
+            return false;
+        }
+#ifdef _WIN32
+        return MoveFileExA((snapshotPath + ".tmp").c_str(), snapshotPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename((snapshotPath + ".tmp").c_str(), snapshotPath.c_str()) == 0;
+#endif
+    }
+
+    // Restores the state saved by a snapshot; call before openLog(), which
+    // then replays only the records written after it. Returns false, and
+    // leaves the system untouched, if the file is missing or damaged.
+    bool loadSnapshot(const std::string &path) {
+        MappedFile file(path);
+        std::string_view image = file.contents();
+        if (image.size() < SNAPSHOT_HEADER_SIZE + 4 || image.substr(0, 8) != std::string_view(SNAPSHOT_MAGIC, 8)) {
+            return false;
+        }
+        const char *trailer = image.data() + image.size() - 4;
+        if (crc32(image.data(), image.size() - 4) != getPod<std::uint32_t>(trailer)) {
+            return false;
+        }
+
+        const char *in = image.data() + 8;
+        const char *end = image.data() + image.size() - 4;
+        std::uint64_t lsn = getPod<std::uint64_t>(in);
+        std::uint64_t offset = getPod<std::uint64_t>(in);
+        std::int32_t next = getPod<std::int32_t>(in);
+        std::uint64_t count = getPod<std::uint64_t>(in);
+
+        // Walk the whole image before inserting anything, so a damaged one
+        // fails without leaving some of its accounts behind.
+        const char *accountsStart = in;
+        std::vector<std::int32_t> numbers;
+        for (std::uint64_t a = 0; a < count; a++) {
+            if (end - in < 4 + 2) {
+                return false;
+            }
+            std::int32_t accountNumber = getPod<std::int32_t>(in);
+            std::uint16_t ownerLength = getPod<std::uint16_t>(in);
+            if (static_cast<std::size_t>(end - in) < ownerLength + 8u + 8u + 32u) {
+                return false;
+            }
+            in += ownerLength + 8;
+            std::uint64_t events = getPod<std::uint64_t>(in);
+            in += 32;
+            if (static_cast<std::uint64_t>(end - in) / 21 < events || findAccount(accountNumber)) {
+                return false;
+            }
+            in += 21 * events;
+            numbers.push_back(accountNumber);
+        }
+        std::sort(numbers.begin(), numbers.end());
+        if (std::adjacent_find(numbers.begin(), numbers.end()) != numbers.end()) {
+            return false;
+        }
+
+        in = accountsStart;
+        for (std::uint64_t a = 0; a < count; a++) {
+            std::int32_t accountNumber = getPod<std::int32_t>(in);
+            std::uint16_t ownerLength = getPod<std::uint16_t>(in);
+            Account* account = insertAccount(accountNumber, std::string(in, ownerLength));
+            in += ownerLength;
+            Money balance = Money::fromCents(getPod<std::int64_t>(in));
+            std::uint64_t events = getPod<std::uint64_t>(in);
+            Sha256::Digest digest;
+            std::memcpy(digest.data(), in, digest.size());
+            in += digest.size();
+            account->balance = balance;
+            const char *types = in;
+            const char *amounts = types + events;
+            const char *counterparties = amounts + 8 * events;
+            const char *timestamps = counterparties + 4 * events;
+            for (std::uint64_t e = 0; e < events; e++) {
+                account->history.appendUnchained(static_cast<TransactionHistory::EventType>(getPod<std::uint8_t>(types)),
+                                                 Money::fromCents(getPod<std::int64_t>(amounts)),
+                                                 getPod<std::int32_t>(counterparties), getPod<std::int64_t>(timestamps));
+            }
+            account->history.restoreChain(digest);
+            in += 21 * events;
+        }
+        if (next > nextAccountNumber.load()) {
+            nextAccountNumber.store(next);
+        }
+        commitAll();
+        snapshotLsn = lsn;
+        snapshotOffset = offset;
+        return true;
+    }
+
+private:
+    static const int FIRST_ACCOUNT_NUMBER = 1000;
+    static constexpr const char *SNAPSHOT_MAGIC = "BANKSNP2";
+    static const std::size_t SNAPSHOT_HEADER_SIZE = 8 + 8 + 8 + 4 + 8;
+
+    // Snapshot image: magic, u64 lsn, u64 log offset, i32 nextAccountNumber,
+    // u64 account count, then per account i32 number, u16 owner length,
+    // owner, i64 balance, u64 event count, the 32-byte history chain digest
+    // and the history columns (types, amounts, counterparties, timestamps),
+    // and finally a CRC-32 of
+    // everything before it. Called with every writer stopped (or in a
+    // forked child), so no account locks are taken.
+    bool writeSnapshot(const std::string &path, std::uint64_t lsn, std::uint64_t offset) {
+#ifdef _WIN32
+        int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0) {
+            return false;
+        }
+        std::vector<char> buffer;
+        std::uint32_t checksum = 0;
+        bool ok = true;
+        auto flush = [&]() {
+            checksum = crc32(buffer.data(), buffer.size(), checksum);
+            ok = ok && writeFully(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        };
+
+        buffer.insert(buffer.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 8);
+        putPod(buffer, lsn);
+        putPod(buffer, offset);
+        putPod(buffer, static_cast<std::int32_t>(nextAccountNumber.load()));
+        putPod(buffer, static_cast<std::uint64_t>(accounts.size()));
+        accounts.forEach([&](int accountNumber, const Account &account) {
+            std::uint16_t ownerLength = static_cast<std::uint16_t>(account.owner.size() < 0xFFFF ? account.owner.size() : 0xFFFF);
+            putPod(buffer, static_cast<std::int32_t>(accountNumber));
+            putPod(buffer, ownerLength);
+            buffer.insert(buffer.end(), account.owner.data(), account.owner.data() + ownerLength);
+            putPod(buffer, account.balance.minorUnits());
+            putPod(buffer, static_cast<std::uint64_t>(account.history.size()));
+            Sha256::Digest digest = account.history.checkpoint().digest;
+            buffer.insert(buffer.end(), digest.begin(), digest.end());
+            auto column = [&buffer](const void *data, std::size_t bytes) {
+                const char *begin = static_cast<const char *>(data);
+                buffer.insert(buffer.end(), begin, begin + bytes);
+            };
+            account.history.forEachChunk([&](const TransactionHistory::EventType *types, const std::int64_t *, const std::int32_t *, const std::int64_t *, std::uint32_t n) { column(types, n); });
+            account.history.forEachChunk([&](const TransactionHistory::EventType *, const std::int64_t *amounts, const std::int32_t *, const std::int64_t *, std::uint32_t n) { column(amounts, 8 * n); });
+            account.history.forEachChunk([&](const TransactionHistory::EventType *, const std::int64_t *, const std::int32_t *counterparties, const std::int64_t *, std::uint32_t n) { column(counterparties, 4 * n); });
+            account.history.forEachChunk([&](const TransactionHistory::EventType *, const std::int64_t *, const std::int32_t *, const std::int64_t *timestamps, std::uint32_t n) { column(timestamps, 8 * n); });
+            if (buffer.size() >= (1u << 20)) {
+                flush();
+            }
+        });
+        flush();
+        ok = ok && writeFully(fd, reinterpret_cast<const char *>(&checksum), 4) && syncFile(fd);
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        return ok;
+    }
+
+    // Inserts an account under a number chosen by the caller (replay and
+    // bulk import) and keeps nextAccountNumber past it. Returns nullptr if
+    // the number is already taken.
+    Account* insertAccount(int accountNumber, const std::string &owner) {
+        auto inserted = accounts.emplace(accountNumber, owner, accountNumber, versions, memory);
+        if (!inserted.second) {
+            return nullptr;
+        }
+        int next = nextAccountNumber.load();
+        while (accountNumber >= next && !nextAccountNumber.compare_exchange_weak(next, accountNumber + 1)) {
+        }
+        return inserted.first;
+    }
+
+    static bool parseInt(std::string_view text, int &value) {
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+    }
+
+    // False if the log failed before lsn reached stable storage; the
+    // change is applied in memory but may be lost in a crash.
+    bool waitDurable(std::uint64_t lsn) {
+        return lsn == 0 || log.waitDurable(lsn);
+    }
+
+    // Publishes the current balances of the given accounts, which the
+    // caller has locked, as one commit for read views.
+    void commit(Account* const *touched, std::size_t count) {
+        Account::BalanceVersion *staged[2];
+        std::vector<Account::BalanceVersion *> stagedMany;
+        Account::BalanceVersion **nodes = staged;
+        if (count > 2) {
+            stagedMany.resize(count);
+            nodes = stagedMany.data();
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            nodes[i] = touched[i]->publish();
+            indexNewEvents(*touched[i], nodes[i]);
+        }
+        std::uint64_t version = versions.takeVersion();
+        for (std::size_t i = 0; i < count; i++) {
+            nodes[i]->version.store(version, std::memory_order_release);
+        }
+    }
+
+    // Publishes every account as one commit. Replay and snapshot loading
+    // change balances without committing, before anything else runs, and
+    // finish with this.
+    void commitAll() {
+        std::vector<Account*> all;
+        all.reserve(accounts.size());
+        accounts.forEach([&all](int, Account &account) {
+            all.push_back(&account);
+        });
+        commit(all.data(), all.size());
+    }
+
+    // Adds the events an account gained since its previous version to the
+    // history index, if there is one.
+    void indexNewEvents(const Account &account, const Account::BalanceVersion *node) {
+        if (!eventIndex) {
+            return;
+        }
+        const Account::BalanceVersion *older = node->older.load(std::memory_order_relaxed);
+        std::size_t added = node->events - (older ? older->events : 0);
+        if (added == 0) {
+            return;
+        }
+        auto add = [this, &account](const TransactionHistory::Event &event) {
+            eventIndex->add(account.accountNumber, event);
+        };
+        account.history.forEachRecent(added, add);
+    }
+
+    // Runs apply(), the debit of amount from account, unless it would break
+    // a velocity limit, and counts it if it goes through. The caller holds
+    // the account locks and a gate pass, which keeps the limits in place.
+    // A debit the balance cannot cover is refused for that, not the limit.
+    template <typename Apply>
+    TxnStatus limitedDebit(Account &account, TransactionHistory::EventType type, Money amount, std::int64_t timestamp, Apply apply) {
+        const VelocityLimits *rules = limits.get();
+        if (!rules || !rules->covers(type) || !amount.isPositive() || amount > account.balance) {
+            return apply();
+        }
+        if (!account.withinLimits(*rules, type, amount, timestamp)) {
+            return TxnStatus::LimitExceeded;
+        }
+        TxnStatus status = apply();
+        if (status == TxnStatus::Ok) {
+            account.countDebit(*rules, type, amount, timestamp, memory);
+        }
+        return status;
+    }
+
+    WorkerPool &workers() {
+        if (!pool) {
+            setWorkerThreads(std::thread::hardware_concurrency());
+        }
+        return *pool;
+    }
+
+    // Runs a sweep with every writer stopped (or during replay). Each task
+    // is one dense index chunk, plus a last one for the sparse accounts.
+    // The changed accounts are published staged as the tasks go, then
+    // marked pending and stamped with a single version in two more passes.
+    SweepResult applySweep(const SweepRule &rule, std::int64_t timestamp) {
+        std::size_t tasks = accounts.chunkCount() + 1;
+        std::vector<SweepResult> totals(tasks);
+        std::vector<std::vector<Account::BalanceVersion *>> staged(tasks);
+        WorkerPool &threads = workers();
+        threads.run(tasks, [&](std::size_t task) {
+            std::vector<Account*> block;
+            auto collect = [&block](int, Account &account) {
+                block.push_back(&account);
+            };
+            if (task + 1 < tasks) {
+                accounts.forEachInChunk(task, collect);
+            } else {
+                accounts.forEachSparse(collect);
+            }
+            totals[task] = sweepBlock(rule, timestamp, block.data(), block.size(), staged[task]);
+        });
+        threads.run(tasks, [&staged](std::size_t task) {
+            for (Account::BalanceVersion *node : staged[task]) {
+                node->version.store(VersionClock::PENDING);
+            }
+        });
+        std::uint64_t version = versions.takeVersion();
+        threads.run(tasks, [&staged, version](std::size_t task) {
+            for (Account::BalanceVersion *node : staged[task]) {
+                node->version.store(version, std::memory_order_release);
+            }
+        });
+
+        SweepResult result;
+        for (const SweepResult &part : totals) {
+            result.accounts += part.accounts;
+            result.interestPaid.checkedAdd(part.interestPaid, result.interestPaid);
+            result.feesCharged.checkedAdd(part.feesCharged, result.feesCharged);
+        }
+        return result;
+    }
+
+    SweepResult sweepBlock(const SweepRule &rule, std::int64_t timestamp, Account* const *block, std::size_t n,
+                           std::vector<Account::BalanceVersion *> &staged) {
+        std::vector<std::int64_t> columns(3 * n);
+        std::int64_t *balances = columns.data();
+        std::int64_t *interest = balances + n;
+        std::int64_t *fees = interest + n;
+        for (std::size_t i = 0; i < n; i++) {
+            balances[i] = block[i]->balance.minorUnits();
+        }
+        sweepKernel(rule, balances, interest, fees, n);
+
+        SweepResult totals;
+        for (std::size_t i = 0; i < n; i++) {
+            if (interest[i] == 0 && fees[i] == 0) {
+                continue;
+            }
+            Account &account = *block[i];
+            account.balance = Money::fromCents(balances[i] + interest[i] - fees[i]);
+            if (interest[i] != 0) {
+                Money earned = Money::fromCents(interest[i]);
+                account.history.append(TransactionHistory::EventType::Interest, earned, 0, timestamp);
+                totals.interestPaid.checkedAdd(earned, totals.interestPaid);
+            }
+            if (fees[i] != 0) {
+                Money charged = Money::fromCents(fees[i]);
+                account.history.append(TransactionHistory::EventType::Fee, charged, 0, timestamp);
+                totals.feesCharged.checkedAdd(charged, totals.feesCharged);
+            }
+            staged.push_back(account.publish(VersionClock::STAGED));
+            indexNewEvents(account, staged.back());
+            totals.accounts++;
+        }
+        return totals;
+    }
+
+    // Applies a logged change during startup or on a replication follower,
+    // where readers such as historyCheckpoint() may be running, so balance
+    // changes take the account locks. A sweep takes none: the caller keeps
+    // the gate closed around it, or nothing else is running yet. Publishing
+    // the changes is up to the caller.
+    void replay(const TransactionLog::Record &record) {
+        if (record.type == TransactionLog::RecordType::CreateAccount) {
+            insertAccount(record.account, record.owner);
+            return;
+        }
+        if (record.type == TransactionLog::RecordType::Sweep) {
+            SweepRule rule;
+            rule.interestBasisPoints = record.account;
+            rule.monthlyFee = record.amount;
+            const char *waiver = record.owner.data();
+            rule.feeWaiverBalance = Money::fromCents(record.owner.size() == 8 ? getPod<std::int64_t>(waiver) : 0);
+            if (rule.isValid()) {
+                applySweep(rule, record.timestamp);
+            }
+            return;
+        }
+        Account* account = findAccount(record.account);
+        if (!account) {
+            return;
+        }
+        switch (record.type) {
+            case TransactionLog::RecordType::Deposit: {
+                auto lock = account->lock();
+                account->deposit(record.amount, record.timestamp);
+                break;
+            }
+            case TransactionLog::RecordType::Withdraw: {
+                auto lock = account->lock();
+                account->withdraw(record.amount, record.timestamp);
+                break;
+            }
+            case TransactionLog::RecordType::Transfer: {
+                Account* toAccount = findAccount(record.counterparty);
+                if (toAccount && toAccount != account) {
+                    auto locks = account->lockWith(*toAccount);
+                    account->transfer(*toAccount, record.amount, record.timestamp);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Declared before the accounts so it outlives them.
+    BankArena arena;
+    std::pmr::memory_resource *memory;
+    VersionClock versions;
+    DenseIndex<Account> accounts;
+    std::atomic<int> nextAccountNumber{FIRST_ACCOUNT_NUMBER};
+    TransactionLog log;
+    CheckpointGate gate;
+    // One bulk job (sweep or audit) at a time; they share the pool. Taken
+    // before the gate, since audit tasks pass through it.
+    std::mutex bulkMutex;
+    std::unique_ptr<WorkerPool> pool;
+    std::unique_ptr<HistoryIndex> eventIndex;
+    // Swapped only while the gate is paused.
+    std::unique_ptr<VelocityLimits> limits;
+    std::uint64_t limitGeneration = 0;
+
+    std::string logPath;
+    std::atomic<bool> readOnly{false};
+    // Last LSN applied by applyReplicated(), for followers without a log.
+    std::atomic<std::uint64_t> replicatedLsn{0};
+
+    std::uint64_t snapshotLsn = 0;
+    std::uint64_t snapshotOffset = 0;
+    std::string snapshotPath;
+    bool snapshotRunning = false;
+    bool snapshotWritten = false;
+#ifndef _WIN32
+    pid_t snapshotPid = -1;
+#endif
+};
+
+// Binary protocol spoken by the server mode. Every request and response is
+// a fixed-size frame in host byte order (the socket is local), except that
+// a CreateAccount request is followed by ownerLength bytes of owner name.
+// Clients may pipeline any number of requests on a connection; responses
+// come back in request order and carry the request's tag.
+struct WireRequest {
+    enum class Op : std::uint8_t {CreateAccount = 1, Deposit, Withdraw, Transfer, Balance};
+
+    // tag u32, op u8, account i32, counterparty i32, amount i64 (cents),
+    // ownerLength u16
+    static const std::size_t HEADER_SIZE = 4 + 1 + 4 + 4 + 8 + 2;
+
+    std::uint32_t tag;
+    Op op;
+    std::int32_t account;
+    std::int32_t counterparty;
+    Money amount;
+    std::string_view owner;
+
+    void encode(std::vector<char> &out) const {
+        putPod(out, tag);
+        putPod(out, static_cast<std::uint8_t>(op));
+        putPod(out, account);
+        putPod(out, counterparty);
+        putPod(out, amount.minorUnits());
+        putPod(out, static_cast<std::uint16_t>(owner.size()));
+        out.insert(out.end(), owner.begin(), owner.end());
+    }
+
+    // Decodes one request from [in, end) and advances in past it. Returns
+    // false, leaving in alone, if the frame is not complete yet.
+    static bool decode(const char *&in, const char *end, WireRequest &request) {
+        if (static_cast<std::size_t>(end - in) < HEADER_SIZE) {
+            return false;
+        }
+        const char *p = in;
+        request.tag = getPod<std::uint32_t>(p);
+        request.op = static_cast<Op>(getPod<std::uint8_t>(p));
+        request.account = getPod<std::int32_t>(p);
+        request.counterparty = getPod<std::int32_t>(p);
+        request.amount = Money::fromCents(getPod<std::int64_t>(p));
+        std::uint16_t ownerLength = getPod<std::uint16_t>(p);
+        if (end - p < ownerLength) {
+            return false;
+        }
+        request.owner = std::string_view(p, ownerLength);
+        in = p + ownerLength;
+        return true;
+    }
+};
+
+struct WireResponse {
+    // tag u32, status u8, account i32 (new account number for
+    // CreateAccount), balance i64 (cents, for Balance)
+    static const std::size_t SIZE = 4 + 1 + 4 + 8;
+
+    std::uint32_t tag;
+    TxnStatus status;
+    std::int32_t account;
+    Money balance;
+
+    void encode(std::vector<char> &out) const {
+        putPod(out, tag);
+        putPod(out, static_cast<std::uint8_t>(status));
+        putPod(out, account);
+        putPod(out, balance.minorUnits());
+    }
+
+    static WireResponse decode(const char *&in) {
+        WireResponse response;
+        response.tag = getPod<std::uint32_t>(in);
+        response.status = static_cast<TxnStatus>(getPod<std::uint8_t>(in));
+        response.account = getPod<std::int32_t>(in);
+        response.balance = Money::fromCents(getPod<std::int64_t>(in));
+        return response;
+    }
+};
+
+#ifdef __linux__
+volatile std::sig_atomic_t stopRequested = 0;
+volatile std::sig_atomic_t metricsRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+void requestMetrics(int) {
+    metricsRequested = 1;
+}
+
+volatile std::sig_atomic_t promotionRequested = 0;
+
+void requestPromotion(int) {
+    promotionRequested = 1;
+}
+
+// Single-threaded epoll server in front of a BankingSystem, listening on a
+// Unix-domain socket. Work is done in rounds: every connection with
+// buffered requests contributes its deposits, withdrawals and transfers,
+// up to its next CreateAccount or Balance request, to one shared
+// applyBatch() call, so a round costs one lock pass and one log sync no
+// matter how many requests are in flight. The stopping request of each
+// connection runs right after the batch, which keeps every connection's
+// requests in order, and any rest waits for the next round.
+class BankServer {
+public:
+    explicit BankServer(BankingSystem &bank) : bank(bank) {}
+
+    BankServer(const BankServer &) = delete;
+    BankServer &operator=(const BankServer &) = delete;
+
+    ~BankServer() {
+        for (auto &entry : connections) {
+            ::close(entry.first);
+        }
+        if (listenFd >= 0) {
+            ::close(listenFd);
+            ::unlink(socketPath.c_str());
+        }
+        if (epollFd >= 0) {
+            ::close(epollFd);
+        }
+    }
+
+    bool listen(const std::string &path) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (listenFd < 0 || epollFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(listenFd, SOMAXCONN) != 0) {
+            return false;
+        }
+        socketPath = path;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        return ::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+    }
+
+    // Serves until stop becomes true (checked at least every 100 ms). A
+    // SIGUSR1 dumps the metrics to stdout as JSON.
+    void run(const volatile std::sig_atomic_t &stop) {
+        std::vector<epoll_event> events(256);
+        while (!stop) {
+            if (metricsRequested) {
+                metricsRequested = 0;
+                Metrics::writeJson(std::cout);
+            }
+            // Don't sleep while earlier rounds left requests behind.
+            int timeout = ready.empty() ? 100 : 0;
+            int n = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeout);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptAll();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    continue;
+                }
+                Connection &connection = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readAll(connection);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    writeAll(connection);
+                }
+            }
+            processRound();
+            closeFinished();
+        }
+    }
+
+private:
+    // A connection stops being read while this much input is waiting for a
+    // round or this much output is waiting for the client, so a client that
+    // sends without reading cannot grow either buffer without bound.
+    static const std::size_t HIGH_WATER = 1 << 20;
+
+    struct Connection {
+        int fd;
+        std::vector<char> in;
+        std::size_t inPos = 0;
+        std::vector<char> out;
+        std::size_t outPos = 0;
+        std::uint32_t events = EPOLLIN;
+        bool readClosed = false;
+        bool failed = false;
+        bool queued = false;
+    };
+
+    // A connection's share of the current round.
+    struct Slice {
+        Connection* connection;
+        std::size_t firstTxn;
+        std::vector<std::uint32_t> tags;
+        bool hasStop = false;
+        WireRequest stop;
+    };
+
+    void acceptAll() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                ::close(fd);
+                continue;
+            }
+            connections[fd].fd = fd;
+        }
+    }
+
+    void readAll(Connection &connection) {
+        char buffer[64 * 1024];
+        while (!connection.readClosed && !connection.failed && !aboveHighWater(connection)) {
+            ssize_t n = ::read(connection.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                connection.in.insert(connection.in.end(), buffer, buffer + n);
+                continue;
+            }
+            if (n == 0) {
+                connection.readClosed = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                connection.failed = true;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        queue(connection);
+        watch(connection);
+    }
+
+    void writeAll(Connection &connection) {
+        while (connection.outPos < connection.out.size()) {
+            ssize_t n = ::write(connection.fd, connection.out.data() + connection.outPos, connection.out.size() - connection.outPos);
+            if (n > 0) {
+                connection.outPos += static_cast<std::size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    connection.failed = true;
+                }
+                break;
+            }
+        }
+        if (connection.outPos == connection.out.size()) {
+            connection.out.clear();
+            connection.outPos = 0;
+        }
+        watch(connection);
+    }
+
+    bool aboveHighWater(const Connection &connection) const {
+        return connection.in.size() - connection.inPos >= HIGH_WATER || connection.out.size() - connection.outPos >= HIGH_WATER;
+    }
+
+    // Asks epoll only for what the connection can act on: readability while
+    // the client may still send and neither buffer is full, writability
+    // while output is pending. Level-triggered EPOLLIN on a half-closed
+    // socket would otherwise fire on every wait.
+    void watch(Connection &connection) {
+        std::uint32_t events = 0;
+        if (!connection.failed) {
+            if (!connection.readClosed && !aboveHighWater(connection)) {
+                events |= EPOLLIN;
+            }
+            if (!connection.out.empty()) {
+                events |= EPOLLOUT;
+            }
+        }
+        if (events != connection.events) {
+            epoll_event event{};
+            event.events = events;
+            event.data.fd = connection.fd;
+            ::epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.events = events;
+        }
+    }
+
+    void queue(Connection &connection) {
+        if (!connection.queued && connection.in.size() > connection.inPos) {
+            connection.queued = true;
+            ready.push_back(connection.fd);
+        }
+    }
+
+    void processRound() {
+        if (ready.empty()) {
+            return;
+        }
+        std::vector<int> round;
+        round.swap(ready);
+        slices.clear();
+        txns.clear();
+        for (int fd : round) {
+            Connection &connection = connections[fd];
+            connection.queued = false;
+            Slice slice;
+            slice.connection = &connection;
+            slice.firstTxn = txns.size();
+            const char *begin = connection.in.data() + connection.inPos;
+            const char *in = begin;
+            const char *end = connection.in.data() + connection.in.size();
+            WireRequest request;
+            while (WireRequest::decode(in, end, request)) {
+                if (request.op == WireRequest::Op::Deposit) {
+                    txns.push_back({Txn::Kind::Deposit, request.account, 0, request.amount});
+                } else if (request.op == WireRequest::Op::Withdraw) {
+                    txns.push_back({Txn::Kind::Withdraw, request.account, 0, request.amount});
+                } else if (request.op == WireRequest::Op::Transfer) {
+                    txns.push_back({Txn::Kind::Transfer, request.account, request.counterparty, request.amount});
+                } else {
+                    // CreateAccount's owner points into connection.in,
+                    // which stays put until the round is answered.
+                    slice.hasStop = true;
+                    slice.stop = request;
+                    break;
+                }
+                slice.tags.push_back(request.tag);
+            }
+            connection.inPos += static_cast<std::size_t>(in - begin);
+            slices.push_back(std::move(slice));
+        }
+
+        std::vector<TxnStatus> statuses;
+        if (!txns.empty()) {
+            statuses = bank.applyBatch(txns);
+        }
+        for (Slice &slice : slices) {
+            Connection &connection = *slice.connection;
+            for (std::size_t i = 0; i < slice.tags.size(); i++) {
+                WireResponse{slice.tags[i], statuses[slice.firstTxn + i], 0, Money()}.encode(connection.out);
+            }
+            if (slice.hasStop) {
+                answer(slice.stop).encode(connection.out);
+            }
+            if (connection.inPos == connection.in.size()) {
+                connection.in.clear();
+                connection.inPos = 0;
+            } else if (connection.inPos > (1u << 20)) {
+                connection.in.erase(connection.in.begin(), connection.in.begin() + static_cast<std::ptrdiff_t>(connection.inPos));
+                connection.inPos = 0;
+            }
+            writeAll(connection);
+            if (slice.hasStop) {
+                queue(connection);
+            }
+        }
+    }
+
+    WireResponse answer(const WireRequest &request) {
+        WireResponse response{request.tag, TxnStatus::Ok, request.account, Money()};
+        if (request.op == WireRequest::Op::CreateAccount) {
+            response.account = bank.openAccount(std::string(request.owner), &response.status);
+        } else if (request.op != WireRequest::Op::Balance) {
+            response.status = TxnStatus::InvalidAmount;
+        } else if (Account* account = bank.findAccount(request.account)) {
+            response.balance = account->getBalance();
+        } else {
+            response.status = TxnStatus::AccountNotFound;
+        }
+        return response;
+    }
+
+    // Drops connections that failed, or that hung up and have been fully
+    // answered.
+    void closeFinished() {
+        for (auto it = connections.begin(); it != connections.end();) {
+            Connection &connection = it->second;
+            bool drained = connection.readClosed && !connection.queued && connection.out.empty();
+            if (connection.failed || drained) {
+                ::epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+                ::close(connection.fd);
+                if (connection.queued) {
+                    ready.erase(std::remove(ready.begin(), ready.end(), connection.fd), ready.end());
+                }
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    BankingSystem &bank;
+    int listenFd = -1;
+    int epollFd = -1;
+    std::string socketPath;
+    std::unordered_map<int, Connection> connections;
+    std::vector<int> ready;
+    std::vector<Slice> slices;
+    std::vector<Txn> txns;
+};
+#endif
+
+#ifdef __linux__
+int connectTo(const std::string &socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Reads exactly size bytes unless the peer closes or the read fails.
+bool readFully(int fd, char *data, std::size_t size) {
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, data + done, size - done);
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Compact encoding of log records for replication. A frame carries whole
+// records with consecutive LSNs, so only the first LSN is sent; each
+// record is its type byte followed by varints: the account as a zigzag
+// delta from the previous record's, the counterparty, the amount in
+// cents, the timestamp as a delta from the previous record's, and the
+// owner length, then the owner bytes. A transfer shrinks from 61 bytes in
+// the log to about 12.
+//
+// Frame: u32 body length, u32 record count, u64 first LSN, u32 CRC-32 of
+// the body, body; host byte order, as the socket is local.
+class ReplicationCodec {
+public:
+    static const std::size_t HEADER_SIZE = 4 + 4 + 8 + 4;
+
+    static void encodeFrame(const TransactionLog::Record *records, std::size_t count, std::vector<char> &out) {
+        std::size_t headerAt = out.size();
+        out.resize(headerAt + HEADER_SIZE);
+        std::int64_t previousAccount = 0;
+        std::int64_t previousTimestamp = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            const TransactionLog::Record &record = records[i];
+            out.push_back(static_cast<char>(record.type));
+            putVarint(out, zigzag(record.account - previousAccount));
+            putVarint(out, zigzag(record.counterparty));
+            putVarint(out, zigzag(record.amount.minorUnits()));
+            putVarint(out, zigzag(record.timestamp - previousTimestamp));
+            putVarint(out, record.owner.size());
+            out.insert(out.end(), record.owner.begin(), record.owner.end());
+            previousAccount = record.account;
+            previousTimestamp = record.timestamp;
+        }
+        std::uint32_t bodyLength = static_cast<std::uint32_t>(out.size() - headerAt - HEADER_SIZE);
+        std::uint32_t recordCount = static_cast<std::uint32_t>(count);
+        std::uint64_t firstLsn = count > 0 ? records[0].lsn : 0;
+        std::uint32_t checksum = crc32(out.data() + headerAt + HEADER_SIZE, bodyLength);
+        char *header = out.data() + headerAt;
+        std::memcpy(header, &bodyLength, 4);
+        std::memcpy(header + 4, &recordCount, 4);
+        std::memcpy(header + 8, &firstLsn, 8);
+        std::memcpy(header + 16, &checksum, 4);
+    }
+
+    static std::uint32_t bodyLength(const char *header) {
+        return getPod<std::uint32_t>(header);
+    }
+
+    // Decodes the frame with the given header and body into records
+    // (replacing its contents). Returns false if the frame is damaged.
+    static bool decodeFrame(const char *header, const char *body, std::vector<TransactionLog::Record> &records) {
+        std::uint32_t length = getPod<std::uint32_t>(header);
+        std::uint32_t count = getPod<std::uint32_t>(header);
+        std::uint64_t lsn = getPod<std::uint64_t>(header);
+        std::uint32_t checksum = getPod<std::uint32_t>(header);
+        if (crc32(body, length) != checksum || count > length) {
+            return false;
+        }
+        const char *end = body + length;
+        records.resize(count);
+        std::int64_t previousAccount = 0;
+        std::int64_t previousTimestamp = 0;
+        for (TransactionLog::Record &record : records) {
+            std::uint64_t account, counterparty, amount, timestamp, ownerLength;
+            if (body == end) {
+                return false;
+            }
+            record.type = static_cast<TransactionLog::RecordType>(*body++);
+            if (!getVarint(body, end, account) || !getVarint(body, end, counterparty) || !getVarint(body, end, amount)
+                || !getVarint(body, end, timestamp) || !getVarint(body, end, ownerLength)
+                || ownerLength > static_cast<std::uint64_t>(end - body)) {
+                return false;
+            }
+            record.lsn = lsn++;
+            record.account = static_cast<std::int32_t>(previousAccount + unzigzag(account));
+            record.counterparty = static_cast<std::int32_t>(unzigzag(counterparty));
+            record.amount = Money::fromCents(unzigzag(amount));
+            record.timestamp = previousTimestamp + unzigzag(timestamp);
+            record.owner.assign(body, static_cast<std::size_t>(ownerLength));
+            body += ownerLength;
+            previousAccount = record.account;
+            previousTimestamp = record.timestamp;
+        }
+        return body == end;
+    }
+
+private:
+    static std::uint64_t zigzag(std::int64_t value) {
+        return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    static std::int64_t unzigzag(std::uint64_t value) {
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    static void putVarint(std::vector<char> &out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static bool getVarint(const char *&in, const char *end, std::uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && in != end; shift += 7) {
+            std::uint8_t byte = static_cast<std::uint8_t>(*in++);
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Leader side of log shipping. Followers connect to a Unix-domain socket
+// and send the last LSN they hold (u64). The leader hooks its log's
+// flusher, so every group-commit batch is re-encoded as one compressed
+// frame as soon as it is durable and queued to every follower; followers
+// therefore never see a change the leader could still lose, and batching
+// follows the load by itself. A follower that is behind is first sent
+// the missing records straight from the log file, in frames of up to
+// CATCH_UP_RECORDS; it is subscribed to the live frames before that read
+// starts, so the two overlap rather than leave a gap, and the follower
+// drops what it already has. Each follower has its own sending thread; one
+// that falls more than MAX_QUEUED_BYTES behind is disconnected and
+// catches up from the file when it reconnects. Needs the log open.
+class ReplicationLeader {
+public:
+    explicit ReplicationLeader(BankingSystem &bank) : bank(bank) {}
+    ReplicationLeader(const ReplicationLeader &) = delete;
+    ReplicationLeader &operator=(const ReplicationLeader &) = delete;
+
+    ~ReplicationLeader() {
+        stop();
+    }
+
+    bool listen(const std::string &path) {
+        sockaddr_un address{};
+        if (bank.logFile().empty() || path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(listenFd, SOMAXCONN) != 0) {
+            return false;
+        }
+        socketPath = path;
+        publishedLsn.store(bank.lastLsn());
+        bank.setLogListener([this](std::string_view bytes, std::uint64_t lsn) { publish(bytes, lsn); });
+        acceptor = std::thread(&ReplicationLeader::acceptLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!acceptor.joinable()) {
+            return;
+        }
+        bank.setLogListener(nullptr);
+        stopping.store(true);
+        ::shutdown(listenFd, SHUT_RDWR);
+        acceptor.join();
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+        std::vector<std::shared_ptr<Session>> all;
+        {
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            all.swap(sessions);
+        }
+        for (const std::shared_ptr<Session> &session : all) {
+            close(*session);
+            session->thread.join();
+        }
+    }
+
+    std::size_t followers() {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        std::size_t live = 0;
+        for (const std::shared_ptr<Session> &session : sessions) {
+            live += !session->finished.load();
+        }
+        return live;
+    }
+
+private:
+    static const std::size_t CATCH_UP_RECORDS = 4096;
+    static const std::size_t MAX_QUEUED_BYTES = 64 << 20;
+
+    using Frame = std::shared_ptr<const std::vector<char>>;
+
+    struct Session {
+        int fd;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Frame> queue;
+        std::size_t queuedBytes = 0;
+        bool subscribed = false;
+        bool closed = false;
+        std::atomic<bool> finished{false};
+        std::thread thread;
+    };
+
+    // Runs on the log's flusher thread, once per durable batch.
+    void publish(std::string_view bytes, std::uint64_t lsn) {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        publishedLsn.store(lsn);
+        if (sessions.empty()) {
+            return;
+        }
+        std::vector<TransactionLog::Record> records;
+        TransactionLog::Record record;
+        std::size_t offset = 0;
+        while (TransactionLog::decode(bytes, offset, record)) {
+            records.push_back(record);
+        }
+        auto frame = std::make_shared<std::vector<char>>();
+        ReplicationCodec::encodeFrame(records.data(), records.size(), *frame);
+        for (const std::shared_ptr<Session> &session : sessions) {
+            std::lock_guard<std::mutex> sessionLock(session->mutex);
+            if (!session->subscribed || session->closed) {
+                continue;
+            }
+            if (session->queuedBytes + frame->size() > MAX_QUEUED_BYTES) {
+                session->closed = true;
+                ::shutdown(session->fd, SHUT_RDWR);
+            } else {
+                session->queue.push_back(frame);
+                session->queuedBytes += frame->size();
+            }
+            session->cv.notify_one();
+        }
+    }
+
+    void acceptLoop() {
+        while (!stopping.load()) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            auto session = std::make_shared<Session>();
+            session->fd = fd;
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            // Reap followers that have gone.
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                if ((*it)->finished.load()) {
+                    (*it)->thread.join();
+                    it = sessions.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            sessions.push_back(session);
+            session->thread = std::thread(&ReplicationLeader::serve, this, session.get());
+        }
+    }
+
+    void serve(Session *session) {
+        char hello[8];
+        if (readFully(session->fd, hello, sizeof(hello))) {
+            const char *in = hello;
+            std::uint64_t since = getPod<std::uint64_t>(in);
+            {
+                std::lock_guard<std::mutex> lock(session->mutex);
+                session->subscribed = true;
+            }
+            if (catchUp(*session, since)) {
+                sendLive(*session);
+            }
+        }
+        close(*session);
+        session->finished.store(true);
+    }
+
+    // Sends the records after since that were published before the
+    // session subscribed, read from the log file, never splitting a batch
+    // across frames. Later ones are in its queue.
+    bool catchUp(Session &session, std::uint64_t since) {
+        std::uint64_t until = publishedLsn.load();
+        MappedFile file(bank.logFile());
+        std::string_view data = file.contents();
+        std::vector<TransactionLog::Record> records;
+        std::vector<char> frame;
+        TransactionLog::Record record;
+        std::size_t offset = 0;
+        std::size_t wholeRecords = 0;
+        std::int32_t batchRemaining = 0;
+        while (TransactionLog::decode(data, offset, record) && record.lsn <= until) {
+            if (record.lsn <= since) {
+                continue;
+            }
+            if (record.type == TransactionLog::RecordType::BatchBegin) {
+                batchRemaining = record.counterparty;
+            } else if (batchRemaining > 0) {
+                batchRemaining--;
+            }
+            records.push_back(record);
+            if (batchRemaining == 0) {
+                wholeRecords = records.size();
+                if (wholeRecords >= CATCH_UP_RECORDS) {
+                    if (!sendRecords(session, records.data(), wholeRecords, frame)) {
+                        return false;
+                    }
+                    records.clear();
+                    wholeRecords = 0;
+                }
+            }
+        }
+        return sendRecords(session, records.data(), wholeRecords, frame);
+    }
+
+    bool sendRecords(Session &session, const TransactionLog::Record *records, std::size_t count, std::vector<char> &frame) {
+        if (count == 0) {
+            return true;
+        }
+        frame.clear();
+        ReplicationCodec::encodeFrame(records, count, frame);
+        return writeFully(session.fd, frame.data(), frame.size());
+    }
+
+    void sendLive(Session &session) {
+        std::deque<Frame> sending;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(session.mutex);
+                session.cv.wait(lock, [&session]() { return !session.queue.empty() || session.closed; });
+                if (session.closed) {
+                    return;
+                }
+                sending.swap(session.queue);
+                session.queuedBytes = 0;
+            }
+            for (const Frame &frame : sending) {
+                if (!writeFully(session.fd, frame->data(), frame->size())) {
+                    return;
+                }
+            }
+            sending.clear();
+        }
+    }
+
+    void close(Session &session) {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        if (!session.closed) {
+            session.closed = true;
+            ::shutdown(session.fd, SHUT_RDWR);
+        }
+        session.cv.notify_one();
+    }
+
+    BankingSystem &bank;
+    int listenFd = -1;
+    std::string socketPath;
+    std::atomic<bool> stopping{false};
+    std::atomic<std::uint64_t> publishedLsn{0};
+    std::thread acceptor;
+    std::mutex sessionsMutex;
+    std::vector<std::shared_ptr<Session>> sessions;
+};
+
+// Follower side of log shipping: a hot replica of the leader's
+// BankingSystem. The system is made read-only, then a thread connects to
+// the leader, sends the last LSN the system holds (so a follower with a
+// log of its own resumes where it stopped), and applies every frame it
+// receives through applyReplicated(), reconnecting every RETRY_MS while
+// the leader is unreachable. Reads are served from the system as usual.
+// promote() stops following and accepts writes; making sure the old
+// leader is really gone is up to whoever promotes.
+//
+// Lag is measured per frame as the time from the newest record's
+// timestamp on the leader to the moment it is visible here; both are
+// wall-clock microseconds, so it is only meaningful on one machine.
+class ReplicationFollower {
+public:
+    struct Stats {
+        std::uint64_t appliedLsn = 0;
+        std::uint64_t frames = 0;
+        std::uint64_t records = 0;
+        std::uint64_t bytes = 0;
+        // Over the last LAG_SAMPLES frames, in microseconds.
+        std::int64_t lagP50 = 0;
+        std::int64_t lagP99 = 0;
+        std::int64_t lagMax = 0;
+    };
+
+    explicit ReplicationFollower(BankingSystem &bank) : bank(bank) {}
+    ReplicationFollower(const ReplicationFollower &) = delete;
+    ReplicationFollower &operator=(const ReplicationFollower &) = delete;
+
+    ~ReplicationFollower() {
+        stop();
+    }
+
+    void start(const std::string &leaderSocket) {
+        bank.setReadOnly(true);
+        stopping = false;
+        receiver = std::thread(&ReplicationFollower::run, this, leaderSocket);
+    }
+
+    // Stops following; the system stays read-only.
+    void stop() {
+        if (!receiver.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(fdMutex);
+            stopping = true;
+            if (fd >= 0) {
+                ::shutdown(fd, SHUT_RDWR);
+            }
+        }
+        receiver.join();
+    }
+
+    // Stops following and makes the system writable. Changes carry on from
+    // the last LSN received.
+    void promote() {
+        stop();
+        bank.setReadOnly(false);
+    }
+
+    bool connected() const {
+        return isConnected.load();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        Stats copy = totals;
+        std::vector<std::int64_t> lags(lagRing.begin(), lagRing.begin() + std::min<std::size_t>(lagRing.size(), totals.frames));
+        if (!lags.empty()) {
+            std::sort(lags.begin(), lags.end());
+            copy.lagP50 = lags[lags.size() / 2];
+            copy.lagP99 = lags[std::min(lags.size() - 1, lags.size() * 99 / 100)];
+            copy.lagMax = lags.back();
+        }
+        return copy;
+    }
+
+private:
+    static constexpr int RETRY_MS = 50;
+    static const std::size_t LAG_SAMPLES = 65536;
+
+    void run(const std::string &leaderSocket) {
+        std::vector<char> body;
+        std::vector<TransactionLog::Record> records;
+        while (true) {
+            int socket = connectTo(leaderSocket);
+            {
+                std::lock_guard<std::mutex> lock(fdMutex);
+                if (stopping) {
+                    if (socket >= 0) {
+                        ::close(socket);
+                    }
+                    return;
+                }
+                fd = socket;
+            }
+            if (socket < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_MS));
+                continue;
+            }
+            std::vector<char> hello;
+            putPod(hello, bank.lastLsn());
+            bool ok = writeFully(socket, hello.data(), hello.size());
+            isConnected.store(ok);
+            char header[ReplicationCodec::HEADER_SIZE];
+            while (ok && readFully(socket, header, sizeof(header))) {
+                body.resize(ReplicationCodec::bodyLength(header));
+                ok = readFully(socket, body.data(), body.size()) && ReplicationCodec::decodeFrame(header, body.data(), records)
+                     && bank.applyReplicated(records.data(), records.size());
+                if (ok) {
+                    recordFrame(records, sizeof(header) + body.size());
+                }
+            }
+            isConnected.store(false);
+            {
+                std::lock_guard<std::mutex> lock(fdMutex);
+                fd = -1;
+            }
+            ::close(socket);
+        }
+    }
+
+    void recordFrame(const std::vector<TransactionLog::Record> &records, std::size_t bytes) {
+        std::int64_t newest = 0;
+        for (const TransactionLog::Record &record : records) {
+            newest = std::max(newest, record.timestamp);
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (!records.empty()) {
+            totals.appliedLsn = std::max(totals.appliedLsn, records.back().lsn);
+        }
+        if (lagRing.empty()) {
+            lagRing.resize(LAG_SAMPLES);
+        }
+        lagRing[totals.frames % LAG_SAMPLES] = newest > 0 ? nowMicros() - newest : 0;
+        totals.frames++;
+        totals.records += records.size();
+        totals.bytes += bytes;
+    }
+
+    BankingSystem &bank;
+    std::thread receiver;
+    std::mutex fdMutex;
+    int fd = -1;
+    bool stopping = false;
+    std::atomic<bool> isConnected{false};
+    mutable std::mutex statsMutex;
+    Stats totals;
+    std::vector<std::int64_t> lagRing;
+};
+
+// Promotes a follower once SIGUSR2 has set promotionRequested, polling
+// every 50 ms, until it is destroyed.
+class PromotionWatcher {
+public:
+    explicit PromotionWatcher(ReplicationFollower &follower)
+        : thread([this, &follower]() {
+              while (!done.load()) {
+                  if (promotionRequested) {
+                      promotionRequested = 0;
+                      follower.promote();
+                      std::cout << "Promoted to leader; accepting writes." << std::endl;
+                  }
+                  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+              }
+          }) {}
+
+    ~PromotionWatcher() {
+        done.store(true);
+        thread.join();
+    }
+
+private:
+    std::atomic<bool> done{false};
+    std::thread thread;
+};
+#endif
+
+// Drives a mixed deposit/withdraw/transfer load from 1..maxThreads worker
+// threads against a fresh system and reports transactions per second.
+// With a log path every transaction is made durable through the
+// group-committed write-ahead log (the file is recreated for each run).
+void runThroughputBenchmark(int maxThreads, int numAccounts, int opsPerThread, const std::string &logPath = "") {
+    std::cout << "Throughput benchmark: " << numAccounts << " accounts, "
+              << opsPerThread << " ops per thread"
+              << (logPath.empty() ? "" : ", write-ahead log at " + logPath) << std::endl;
+
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        BankingSystem bank;
+        if (!logPath.empty()) {
+            std::remove(logPath.c_str());
+            if (bank.openLog(logPath) < 0) {
+                return;
+            }
+        }
+        std::vector<int> accountNumbers;
+        accountNumbers.reserve(numAccounts);
+        for (int i = 0; i < numAccounts; i++) {
+            int accountNumber = bank.openAccount("bench" + std::to_string(i));
+            bank.deposit(accountNumber, Money::fromCents(100000000));
+            accountNumbers.push_back(accountNumber);
+        }
+
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&bank, &accountNumbers, opsPerThread, t]() {
+                std::mt19937 rng(12345u + t);
+                std::uniform_int_distribution<std::size_t> pick(0, accountNumbers.size() - 1);
+                for (int i = 0; i < opsPerThread; i++) {
+                    int from = accountNumbers[pick(rng)];
+                    int to = accountNumbers[pick(rng)];
+                    switch (rng() % 3) {
+                        case 0: bank.deposit(from, Money::fromCents(500)); break;
+                        case 1: bank.withdraw(from, Money::fromCents(500)); break;
+                        default: bank.transfer(from, to, Money::fromCents(500)); break;
+                    }
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double total = static_cast<double>(threads) * opsPerThread;
+        std::cout << threads << " thread(s): " << static_cast<long long>(total / seconds) << " tx/s" << std::endl;
+    }
+#ifndef BANK_NO_METRICS
+    std::cout << "Operation metrics over all runs:" << std::endl;
+    Metrics::writeText(std::cout);
+#endif
+}
+
+// Replays the same synthetic settlement file once row by row through the
+// single-transaction API and once through applyBatch(), both durable.
+void runBatchBenchmark(int numAccounts, int numRows, const std::string &logPath) {
+    std::mt19937 rng(7);
+    std::vector<Txn> rows(numRows);
+    for (Txn &row : rows) {
+        row.kind = static_cast<Txn::Kind>(rng() % 3);
+        row.account = 1000 + static_cast<int>(rng() % numAccounts);
+        row.counterparty = 1000 + static_cast<int>(rng() % numAccounts);
+        row.amount = Money::fromCents(1 + rng() % 10000);
+    }
 
-    Account(std::string owner, int accountNumber) 
-        : owner(owner), accountNumber(accountNumber), balance(0) {}
+    std::cout << "Batch benchmark: " << numAccounts << " accounts, " << numRows << " rows" << std::endl;
+    for (int batched = 0; batched < 2; batched++) {
+        BankingSystem bank;
+        std::remove(logPath.c_str());
+        if (bank.openLog(logPath) < 0) {
+            return;
+        }
+        std::vector<Txn> openingDeposits;
+        for (int i = 0; i < numAccounts; i++) {
+            openingDeposits.push_back({Txn::Kind::Deposit, bank.openAccount("bench" + std::to_string(i)), 0, Money::fromCents(100000)});
+        }
+        bank.applyBatch(openingDeposits);
 
-    void deposit(double amount) {
-        if (amount > 0) {
-            balance += amount;
-            transactions.push_back("Deposit: $" + std::to_string(amount));
+        auto start = std::chrono::steady_clock::now();
+        if (batched) {
+            bank.applyBatch(rows);
         } else {
-            std::cout << "Invalid deposit amount." << std::endl;
+            for (const Txn &row : rows) {
+                switch (row.kind) {
+                    case Txn::Kind::Deposit: bank.deposit(row.account, row.amount); break;
+                    case Txn::Kind::Withdraw: bank.withdraw(row.account, row.amount); break;
+                    default: bank.transfer(row.account, row.counterparty, row.amount); break;
+                }
+            }
         }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (batched ? "applyBatch: " : "per row:    ") << static_cast<long long>(numRows / seconds) << " rows/s" << std::endl;
+    }
+    std::remove(logPath.c_str());
+}
+
+// Writes an import CSV with numAccounts accounts and numTransfers random
+// transfers between them.
+void writeSyntheticCsv(const std::string &csvPath, int numAccounts, int numTransfers) {
+    std::ofstream out(csvPath, std::ios::binary);
+    std::mt19937 rng(3);
+    std::string line;
+    for (int i = 0; i < numAccounts; i++) {
+        line = "A," + std::to_string(1000 + i) + ",owner" + std::to_string(i) + "," + std::to_string(rng() % 100000) + ".00\n";
+        out << line;
     }
+    for (int i = 0; i < numTransfers; i++) {
+        int from = 1000 + static_cast<int>(rng() % numAccounts);
+        int to = 1000 + static_cast<int>(rng() % numAccounts);
+        out << "T," << from << "," << to << "," << (rng() % 5000) << "." << (rng() % 100) << "\n";
+    }
+}
 
-    void withdraw(double amount) {
-        if (amount > 0 && amount <= balance) {
-            balance -= amount;
-            transactions.push_back("Withdraw: $" + std::to_string(amount));
-        } else {
-            std::cout << "Invalid withdraw amount or insufficient funds." << std::endl;
+// Writes a CSV with numAccounts accounts and as many transactions, then
+// times importFile() on it (without a log, to measure the loader itself).
+void runImportBenchmark(int numAccounts, const std::string &csvPath) {
+    writeSyntheticCsv(csvPath, numAccounts, numAccounts);
+
+    BankingSystem bank;
+    auto start = std::chrono::steady_clock::now();
+    ImportResult result = bank.importFile(csvPath);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Imported " << result.accounts << " accounts and " << result.transactions << " transactions ("
+              << result.rejected << " rejected) in " << seconds << " s" << std::endl;
+    std::remove(csvPath.c_str());
+}
+
+// Builds a logged system of numAccounts accounts with transfersPerAccount
+// transfers each, times how long writers are held up by startSnapshot() and
+// how long the image takes to write, then compares a cold start that
+// replays the whole log with one that loads the snapshot and replays the
+// tail written after it.
+void runSnapshotBenchmark(int numAccounts, int transfersPerAccount, const std::string &logPath) {
+    std::string csvPath = logPath + ".csv";
+    std::string snapshotPath = logPath + ".snapshot";
+    std::remove(logPath.c_str());
+    std::remove(snapshotPath.c_str());
+    writeSyntheticCsv(csvPath, numAccounts, numAccounts * transfersPerAccount);
+    {
+        BankingSystem bank;
+        bank.openLog(logPath);
+        bank.importFile(csvPath);
+
+        auto start = std::chrono::steady_clock::now();
+        bool started = bank.startSnapshot(snapshotPath);
+        auto forked = std::chrono::steady_clock::now();
+        // Keep writing while the image is produced; this becomes the tail.
+        std::mt19937 rng(5);
+        for (int i = 0; i < numAccounts / 10; i++) {
+            bank.deposit(1000 + static_cast<int>(rng() % numAccounts), Money::fromCents(100));
+        }
+        bool saved = started && bank.waitSnapshot();
+        auto done = std::chrono::steady_clock::now();
+        std::cout << "Snapshot of " << numAccounts << " accounts: writers paused "
+                  << std::chrono::duration<double, std::milli>(forked - start).count() << " ms, written in "
+                  << std::chrono::duration<double>(done - start).count() << " s" << (saved ? "" : " (FAILED)") << std::endl;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    long long fullReplay;
+    {
+        BankingSystem bank;
+        fullReplay = bank.openLog(logPath);
+        std::cout << "Cold start from log only: " << fullReplay << " records in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+    }
+    start = std::chrono::steady_clock::now();
+    {
+        BankingSystem bank;
+        bool loaded = bank.loadSnapshot(snapshotPath);
+        long long tail = bank.openLog(logPath);
+        std::cout << "Cold start from snapshot: " << (loaded ? "loaded" : "FAILED") << ", " << tail << " tail records in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+    }
+    std::remove(csvPath.c_str());
+    std::remove(logPath.c_str());
+    std::remove(snapshotPath.c_str());
+}
+
+#ifdef __linux__
+// Load generator for the server mode. Creates numAccounts accounts, then
+// opens numConnections connections that each send requestsPerConnection
+// requests (40% deposits, 30% withdrawals, 20% transfers, 10% balance
+// reads on random accounts), keeping up to depth of them in flight, and
+// reports throughput and p50/p99 request latency.
+void runLoadTest(const std::string &socketPath, int numConnections, int requestsPerConnection, int depth, int numAccounts) {
+    std::vector<int> accountNumbers;
+    {
+        int fd = connectTo(socketPath);
+        if (fd < 0) {
+            std::cout << "Cannot connect to " << socketPath << std::endl;
+            return;
+        }
+        auto exchange = [fd](const std::vector<char> &out, std::vector<char> &in) {
+            if (!writeFully(fd, out.data(), out.size())) {
+                return false;
+            }
+            for (std::size_t got = 0; got < in.size();) {
+                ssize_t n = ::read(fd, in.data() + got, in.size() - got);
+                if (n <= 0) {
+                    return false;
+                }
+                got += static_cast<std::size_t>(n);
+            }
+            return true;
+        };
+        std::vector<char> out;
+        std::vector<char> in(WireResponse::SIZE * static_cast<std::size_t>(numAccounts));
+        for (int i = 0; i < numAccounts; i++) {
+            std::string owner = "load" + std::to_string(i);
+            WireRequest{static_cast<std::uint32_t>(i), WireRequest::Op::CreateAccount, 0, 0, Money(), owner}.encode(out);
+        }
+        bool ok = exchange(out, in);
+        const char *p = in.data();
+        out.clear();
+        for (int i = 0; ok && i < numAccounts; i++) {
+            accountNumbers.push_back(WireResponse::decode(p).account);
+            WireRequest{static_cast<std::uint32_t>(i), WireRequest::Op::Deposit, accountNumbers.back(), 0, Money::fromCents(100000000), {}}.encode(out);
+        }
+        ok = ok && exchange(out, in);
+        ::close(fd);
+        if (!ok) {
+            std::cout << "Setup failed" << std::endl;
+            return;
+        }
+    }
+
+    std::vector<std::vector<double>> latencies(numConnections);
+    std::atomic<int> failures{0};
+    auto client = [&](int c) {
+        int fd = connectTo(socketPath);
+        if (fd < 0) {
+            failures++;
+            return;
         }
+        std::mt19937 rng(1000 + c);
+        std::vector<std::chrono::steady_clock::time_point> sentAt(requestsPerConnection);
+        std::vector<double> &samples = latencies[c];
+        samples.reserve(requestsPerConnection);
+        std::vector<char> out;
+        std::vector<char> in;
+        char buffer[64 * 1024];
+        int sent = 0;
+        int received = 0;
+        while (received < requestsPerConnection) {
+            out.clear();
+            while (sent < requestsPerConnection && sent - received < depth) {
+                unsigned roll = rng() % 10;
+                int account = accountNumbers[rng() % accountNumbers.size()];
+                int counterparty = accountNumbers[rng() % accountNumbers.size()];
+                WireRequest::Op op = roll < 4 ? WireRequest::Op::Deposit : roll < 7 ? WireRequest::Op::Withdraw
+                                   : roll < 9 ? WireRequest::Op::Transfer : WireRequest::Op::Balance;
+                WireRequest{static_cast<std::uint32_t>(sent), op, account, counterparty, Money::fromCents(1 + rng() % 10000), {}}.encode(out);
+                sentAt[sent++] = std::chrono::steady_clock::now();
+            }
+            if (!out.empty() && !writeFully(fd, out.data(), out.size())) {
+                break;
+            }
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                break;
+            }
+            auto now = std::chrono::steady_clock::now();
+            in.insert(in.end(), buffer, buffer + n);
+            const char *p = in.data();
+            while (static_cast<std::size_t>(in.data() + in.size() - p) >= WireResponse::SIZE) {
+                WireResponse response = WireResponse::decode(p);
+                samples.push_back(std::chrono::duration<double, std::micro>(now - sentAt[response.tag]).count());
+                received++;
+            }
+            in.erase(in.begin(), in.begin() + (p - in.data()));
+        }
+        if (received < requestsPerConnection) {
+            failures++;
+        }
+        ::close(fd);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < numConnections; c++) {
+        threads.emplace_back(client, c);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const std::vector<double> &samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    if (all.empty()) {
+        std::cout << "No responses" << std::endl;
+        return;
+    }
+    auto percentile = [&all](double p) {
+        std::size_t rank = std::min(all.size() - 1, static_cast<std::size_t>(p * all.size()));
+        std::nth_element(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(rank), all.end());
+        return all[rank];
+    };
+    std::cout << numConnections << " connections, depth " << depth << ": " << all.size() << " requests in " << seconds
+              << " s (" << static_cast<long long>(all.size() / seconds) << " req/s), p50 " << percentile(0.50)
+              << " us, p99 " << percentile(0.99) << " us";
+    if (failures > 0) {
+        std::cout << " (" << failures << " connections failed)";
+    }
+    std::cout << std::endl;
+}
+#endif
+
+// Runs random transfers from numWriters threads for a few seconds, first
+// alone and then alongside a reporting thread that keeps summing every
+// balance through a read view. Transfers conserve money, so any total
+// other than the opening one would be a torn read.
+void runReadViewBenchmark(int numAccounts, int numWriters, double seconds) {
+    for (int withReader = 0; withReader < 2; withReader++) {
+        BankingSystem bank;
+        std::vector<int> accountNumbers;
+        for (int i = 0; i < numAccounts; i++) {
+            accountNumbers.push_back(bank.openAccount("bench" + std::to_string(i)));
+            bank.deposit(accountNumbers.back(), Money::fromCents(100000));
+        }
+        Money expected = Money::fromCents(100000 * static_cast<std::int64_t>(numAccounts));
+
+        std::atomic<bool> stop{false};
+        std::atomic<long long> transfers{0};
+        long long scans = 0;
+        long long torn = 0;
+        std::vector<std::thread> writers;
+        for (int t = 0; t < numWriters; t++) {
+            writers.emplace_back([&, t]() {
+                std::mt19937 rng(99u + t);
+                long long done = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    int from = accountNumbers[rng() % accountNumbers.size()];
+                    int to = accountNumbers[rng() % accountNumbers.size()];
+                    bank.transfer(from, to, Money::fromCents(1 + rng() % 500));
+                    done++;
+                }
+                transfers += done;
+            });
+        }
+        std::thread reader;
+        if (withReader) {
+            reader = std::thread([&]() {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    VersionClock::ReadView view = bank.readView();
+                    if (bank.totalBalance(view) != expected) {
+                        torn++;
+                    }
+                    scans++;
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (std::thread &writer : writers) {
+            writer.join();
+        }
+        if (reader.joinable()) {
+            reader.join();
+        }
+        std::cout << numWriters << " writer thread(s)" << (withReader ? " + 1 reporting thread: " : ": ")
+                  << static_cast<long long>(transfers / seconds) << " transfers/s";
+        if (withReader) {
+            std::cout << ", " << scans << " full-bank totals (" << scans / seconds << "/s), " << torn << " inconsistent";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Imports numAccounts accounts (without a log) and times one interest and
+// fee sweep over all of them per thread count, doubling from 1 up to
+// maxThreads. Throughput is also given as the time 50M accounts would take.
+void runSweepBenchmark(int numAccounts, int maxThreads, const std::string &csvPath) {
+    writeSyntheticCsv(csvPath, numAccounts, 0);
+    BankingSystem bank;
+    ImportResult imported = bank.importFile(csvPath);
+    std::remove(csvPath.c_str());
+    std::cout << "Sweep benchmark: " << imported.accounts << " accounts" << std::endl;
+
+    SweepRule rule;
+    rule.interestBasisPoints = 17;
+    rule.monthlyFee = Money::fromCents(500);
+    rule.feeWaiverBalance = Money::fromCents(2500000);
+    for (int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        bank.setWorkerThreads(static_cast<unsigned>(threads));
+        auto start = std::chrono::steady_clock::now();
+        SweepResult result = bank.sweep(rule);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << threads << " thread(s): " << seconds << " s, " << static_cast<long long>(imported.accounts / seconds)
+                  << " accounts/s (" << 50e6 * seconds / static_cast<double>(imported.accounts) << " s per 50M); "
+                  << result.accounts << " changed, interest $" << result.interestPaid << ", fees $" << result.feesCharged
+                  << std::endl;
+        if (threads >= maxThreads) {
+            break;
+        }
+    }
+}
+
+// Imports numAccounts accounts with transfersPerAccount transfers each,
+// then times a full history audit, one more deposit on every account, and
+// an incremental audit that only re-hashes those deposits.
+void runAuditBenchmark(int numAccounts, int transfersPerAccount, const std::string &csvPath) {
+    writeSyntheticCsv(csvPath, numAccounts, numAccounts * transfersPerAccount);
+    BankingSystem bank;
+    ImportResult imported = bank.importFile(csvPath);
+    std::remove(csvPath.c_str());
+
+    auto timeAudit = [&bank](const char *label, bool full) {
+        auto start = std::chrono::steady_clock::now();
+        AuditResult result = bank.auditHistories(full);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << ": " << result.accounts << " accounts, " << result.events << " events re-hashed in "
+                  << seconds << " s (" << static_cast<long long>(result.events / seconds) << " events/s), "
+                  << result.failed.size() << " failed" << std::endl;
+    };
+    std::cout << "Audit benchmark: " << imported.accounts << " accounts, " << imported.transactions << " transfers" << std::endl;
+    timeAudit("full audit       ", true);
+    for (int i = 0; i < numAccounts; i++) {
+        bank.deposit(1000 + i, Money::fromCents(100));
     }
+    timeAudit("incremental audit", false);
+}
 
-    void transfer(Account &toAccount, double amount) {
-        if (amount > 0 && amount <= balance) {
-            balance -= amount;
-            toAccount.deposit(amount);
-            transactions.push_back("Transfer: $" + std::to_string(amount) + " to Account " + std::to_string(toAccount.getAccountNumber()));
+// Fills a HistoryIndex with numEvents synthetic events from numAccounts
+// accounts spread evenly over one week (deposits, withdrawals and
+// transfers, each transfer giving an out and an in row), then times a
+// day's transfers to one account through the counterparty index against
+// a scan of every row, and the ten largest withdrawals of the week.
+void runHistoryIndexBenchmark(std::size_t numEvents, int numAccounts) {
+    const std::int64_t WEEK = 7LL * 24 * 3600 * 1000000;
+    const std::int64_t start = 1700000000LL * 1000000;
+    HistoryIndex index;
+    std::mt19937 rng(21);
+    auto fillStart = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < numEvents;) {
+        std::int64_t timestamp = start + static_cast<std::int64_t>(static_cast<double>(i) / numEvents * WEEK);
+        int account = 1000 + static_cast<int>(rng() % numAccounts);
+        Money amount = Money::fromCents(1 + rng() % 1000000);
+        unsigned roll = rng() % 10;
+        if (roll < 3) {
+            index.add(account, {TransactionHistory::EventType::Deposit, amount, 0, timestamp});
+            i++;
+        } else if (roll < 6) {
+            index.add(account, {TransactionHistory::EventType::Withdraw, amount, 0, timestamp});
+            i++;
         } else {
-            std::cout << "Invalid transfer amount or insufficient funds." << std::endl;
+            int to = 1000 + static_cast<int>(rng() % numAccounts);
+            index.add(account, {TransactionHistory::EventType::TransferOut, amount, to, timestamp});
+            index.add(to, {TransactionHistory::EventType::TransferIn, amount, account, timestamp});
+            i += 2;
         }
     }
+    double fillSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fillStart).count();
+    std::cout << "History index benchmark: " << index.size() << " events, " << numAccounts << " accounts, indexed in "
+              << fillSeconds << " s (" << static_cast<long long>(index.size() / fillSeconds) << " events/s)" << std::endl;
+
+    auto timeQuery = [](const char *label, const std::function<std::size_t()> &query) {
+        auto queryStart = std::chrono::steady_clock::now();
+        std::size_t found = query();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - queryStart).count();
+        std::cout << "  " << label << ": " << found << " events in " << seconds * 1000 << " ms" << std::endl;
+    };
+    HistoryIndex::Query transfers;
+    transfers.from = start + 3 * WEEK / 7;
+    transfers.to = transfers.from + WEEK / 7;
+    transfers.types = HistoryIndex::typeBit(TransactionHistory::EventType::TransferOut);
+    transfers.counterparty = 1000 + numAccounts / 2;
+    timeQuery("transfers to one account in one day (first query builds the inverted index)",
+              [&]() { return index.find(transfers).size(); });
+    timeQuery("same query again", [&]() { return index.find(transfers).size(); });
+    timeQuery("same query scanning every row", [&]() {
+        HistoryIndex::Query everything;
+        everything.types = transfers.types;
+        std::size_t found = 0;
+        index.forEachMatch(everything, [&](const HistoryIndex::Row &row) {
+            found += row.event.counterparty == transfers.counterparty && row.event.timestamp >= transfers.from
+                     && row.event.timestamp < transfers.to;
+        });
+        return found;
+    });
+    HistoryIndex::Query withdrawals;
+    withdrawals.from = start;
+    withdrawals.to = start + WEEK;
+    withdrawals.types = HistoryIndex::typeBit(TransactionHistory::EventType::Withdraw);
+    timeQuery("top 10 withdrawals of the week", [&]() { return index.largest(withdrawals, 10).size(); });
+    withdrawals.from = start + 6 * WEEK / 7;
+    timeQuery("top 10 withdrawals of the last day", [&]() { return index.largest(withdrawals, 10).size(); });
+}
+
+// Times the velocity check and count on their own over numAccounts
+// windows, then withdrawals and transfers through BankingSystem without
+// limits and with limits that never trip (best of three rounds each, after
+// a round that sets up the windows), and finally counts how many
+// withdrawals a tight limit refuses.
+void runVelocityBenchmark(int numAccounts, int numOps) {
+    using EventType = TransactionHistory::EventType;
+    const std::int64_t second = 1000000;
+    std::vector<VelocityRule> rules(4);
+    rules[0].types = VelocityRule::typeBit(EventType::Withdraw);
+    rules[0].windowMicros = 60 * second;
+    rules[0].maxCount = 1000000;
+    rules[1].types = VelocityRule::typeBit(EventType::TransferOut);
+    rules[1].windowMicros = 86400 * second;
+    rules[1].maxAmount = Money::fromCents(100000000000);
+    rules[2].types = rules[0].types | rules[1].types;
+    rules[2].windowMicros = second;
+    rules[2].maxCount = 1000000;
+    rules[3].types = rules[2].types;
+    rules[3].windowMicros = 3600 * second;
+    rules[3].maxCount = 10000000;
+    rules[3].maxAmount = Money::fromCents(100000000000);
+    std::cout << "Velocity benchmark: " << numAccounts << " accounts, " << numOps << " operations, " << rules.size() << " rules" << std::endl;
 
-    double getBalance() const {
-        return balance;
+    std::unique_ptr<VelocityLimits> limits = VelocityLimits::compile(rules, 1);
+    std::vector<VelocityLimits::Window *> windows(numAccounts, nullptr);
+    std::mt19937 rng(7);
+    std::int64_t timestamp = nowMicros();
+    auto start = std::chrono::steady_clock::now();
+    long long refused = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numOps; i++) {
+            VelocityLimits::Window *&window = windows[rng() % windows.size()];
+            EventType type = i & 1 ? EventType::TransferOut : EventType::Withdraw;
+            timestamp += 3;
+            if (limits->allows(window, type, Money::fromCents(500), timestamp)) {
+                limits->record(window, type, Money::fromCents(500), timestamp, std::pmr::new_delete_resource());
+            } else {
+                refused++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "check and count alone: " << seconds * 1e9 / numOps << " ns per debit (" << refused << " refused)" << std::endl;
+    for (VelocityLimits::Window *&window : windows) {
+        VelocityLimits::release(window);
     }
 
-    int getAccountNumber() const {
-        return accountNumber;
+    BankingSystem bank;
+    std::vector<int> accountNumbers;
+    for (int i = 0; i < numAccounts; i++) {
+        accountNumbers.push_back(bank.openAccount("velocity" + std::to_string(i)));
+        bank.deposit(accountNumbers.back(), Money::fromCents(100000000000));
+    }
+    double best[2] = {1e9, 1e9};
+    for (int round = 0; round < 7; round++) {
+        bool limited = round >= 3;
+        if (round == 3) {
+            bank.setVelocityLimits(rules);
+        }
+        std::mt19937 opRng(11 + round);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numOps; i++) {
+            int from = accountNumbers[opRng() % accountNumbers.size()];
+            int to = accountNumbers[opRng() % accountNumbers.size()];
+            if (i & 1) {
+                bank.transfer(from, to, Money::fromCents(500));
+            } else {
+                bank.withdraw(from, Money::fromCents(500));
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (round != 3) {
+            best[limited] = std::min(best[limited], seconds * 1e9 / numOps);
+        }
     }
+    std::cout << "withdraw/transfer without limits: " << best[0] << " ns, with limits: " << best[1] << " ns (+"
+              << best[1] - best[0] << " ns)" << std::endl;
 
-    void printTransactionHistory() const {
-        std::cout << "Transaction history for account " << accountNumber << ":" << std::endl;
-        for (const auto &transaction : transactions) {
-            std::cout << transaction << std::endl;
+    std::vector<VelocityRule> tight(1);
+    tight[0].types = VelocityRule::typeBit(EventType::Withdraw);
+    tight[0].windowMicros = 60 * second;
+    tight[0].maxCount = 3;
+    bank.setVelocityLimits(tight);
+    long long accepted = 0;
+    long long limited = 0;
+    for (int i = 0; i < 10; i++) {
+        TxnStatus status = bank.withdraw(accountNumbers[0], Money::fromCents(100));
+        accepted += status == TxnStatus::Ok;
+        limited += status == TxnStatus::LimitExceeded;
+    }
+    std::cout << "at most 3 withdrawals a minute: " << accepted << " of 10 accepted, " << limited << " refused" << std::endl;
+}
+
+// Peak resident set size of this process so far, in bytes (0 if unknown).
+std::size_t peakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Imports numAccounts accounts with as many transfers, once with account
+// names and histories allocated straight from the heap and once from an
+// arena, and reports how many allocations reached the heap, the peak RSS
+// and how long loading and tearing the bank down took. Each run gets its
+// own child process where fork() exists, so the peaks are separate.
+void runArenaBenchmark(int numAccounts, const std::string &csvPath) {
+    writeSyntheticCsv(csvPath, numAccounts, numAccounts);
+    for (int useArena = 0; useArena < 2; useArena++) {
+#ifndef _WIN32
+        std::cout.flush();
+        pid_t child = fork();
+        if (child > 0) {
+            waitpid(child, nullptr, 0);
+            continue;
         }
+#endif
+        CountingResource heap(std::pmr::new_delete_resource());
+        auto arena = useArena ? std::make_unique<BankArena>(&heap) : nullptr;
+        auto bank = std::make_unique<BankingSystem>(useArena ? static_cast<std::pmr::memory_resource *>(arena.get()) : &heap);
+        auto start = std::chrono::steady_clock::now();
+        ImportResult result = bank->importFile(csvPath);
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::size_t allocations = heap.allocations();
+        std::size_t bytes = heap.bytes();
+        std::size_t peak = peakRssBytes();
+        start = std::chrono::steady_clock::now();
+        bank.reset();
+        arena.reset();
+        double releaseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (useArena ? "arena: " : "heap:  ") << result.accounts << " accounts, " << result.transactions
+                  << " transactions loaded in " << loadSeconds << " s; " << allocations << " heap allocations ("
+                  << bytes / (1024 * 1024) << " MB) for names and histories; peak RSS " << peak / (1024 * 1024)
+                  << " MB; released in " << releaseSeconds << " s" << std::endl;
+#ifndef _WIN32
+        std::_Exit(0);
+#endif
     }
+    std::remove(csvPath.c_str());
+}
 
-private:
-    std::string owner;
-    int accountNumber;
-    double balance;
-    std::vector<std::string> transactions;
+// A synthetic workload for runWorkloadBenchmark(): how many accounts and
+// threads, how skewed account popularity is (Zipf exponent theta; 0 is
+// uniform, 0.99 is YCSB's default), and the percentages of balance reads,
+// deposits, withdrawals and transfers. The same spec and seed always give
+// the same operations, whatever the platform.
+struct WorkloadSpec {
+    int accounts = 100000;
+    int threads = 1;
+    int opsPerThread = 1000000;
+    double theta = 0.99;
+    int mix[4] = {50, 15, 15, 20};
+    std::uint64_t seed = 42;
+
+    bool isValid() const {
+        return accounts > 1 && threads > 0 && opsPerThread > 0 && theta >= 0.0 && theta < 1.0
+               && mix[0] >= 0 && mix[1] >= 0 && mix[2] >= 0 && mix[3] >= 0 && mix[0] + mix[1] + mix[2] + mix[3] == 100;
+    }
 };
 
-class BankingSystem {
+// Draws ranks 0..n-1 with probability proportional to 1/(rank+1)^theta,
+// in O(1) per draw after an O(n) setup, using the method of Gray et al.,
+// "Quickly Generating Billion-Record Synthetic Databases" (as in YCSB).
+// Takes uniform doubles in [0, 1) so the caller owns the random stream.
+class ZipfGenerator {
 public:
-    void createAccount(const std::string &owner) {
-        int accountNumber = nextAccountNumber++;
-        accounts[accountNumber] = Account(owner, accountNumber);
-        std::cout << "Account created for " << owner << " with account number " << accountNumber << std::endl;
+    ZipfGenerator(std::uint64_t n, double theta) : n(n), theta(theta) {
+        for (std::uint64_t i = 1; i <= n; i++) {
+            zetaN += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        double zeta2 = 1.0 + std::pow(0.5, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / zetaN);
+        secondLimit = zeta2;
     }
 
-    Account* getAccount(int accountNumber) {
-        if (accounts.find(accountNumber) != accounts.end()) {
-            return &accounts[accountNumber];
-        } else {
-            std::cout << "Account not found." << std::endl;
-            return nullptr;
+    std::uint64_t rank(double uniform) const {
+        double scaled = uniform * zetaN;
+        if (scaled < 1.0) {
+            return 0;
+        }
+        if (scaled < secondLimit) {
+            return 1;
         }
+        std::uint64_t r = static_cast<std::uint64_t>(static_cast<double>(n) * std::pow(eta * uniform - eta + 1.0, alpha));
+        return std::min(r, n - 1);
     }
 
 private:
-    std::unordered_map<int, Account> accounts;
-    int nextAccountNumber = 1000;
+    std::uint64_t n;
+    double theta;
+    double zetaN = 0.0;
+    double alpha = 0.0;
+    double eta = 0.0;
+    double secondLimit = 0.0;
+};
+
+struct WorkloadOp {
+    enum class Kind : std::uint8_t {Read, Deposit, Withdraw, Transfer};
+    Kind kind;
+    // Indexes into the benchmark's account list.
+    std::int32_t account;
+    std::int32_t counterparty;
+    std::int64_t cents;
+};
+
+// Generates every thread's operations from spec up front, so the timed run
+// only replays them. Popular ranks are spread over the accounts by a
+// seeded shuffle rather than being the lowest numbers, and a transfer
+// whose two ends collide goes to the next account instead. Only the
+// standard mt19937_64 output is used, never a library distribution, so
+// the streams are identical on every standard library.
+std::vector<std::vector<WorkloadOp>> generateWorkload(const WorkloadSpec &spec) {
+    std::mt19937_64 rng(spec.seed);
+    auto below = [&rng](std::uint64_t bound) {
+        return rng() % bound;
+    };
+    std::vector<std::int32_t> byRank(spec.accounts);
+    for (int i = 0; i < spec.accounts; i++) {
+        byRank[i] = i;
+    }
+    for (std::size_t i = byRank.size() - 1; i > 0; i--) {
+        std::swap(byRank[i], byRank[below(i + 1)]);
+    }
+
+    ZipfGenerator zipf(static_cast<std::uint64_t>(spec.accounts), spec.theta);
+    std::vector<std::vector<WorkloadOp>> streams(spec.threads);
+    for (int t = 0; t < spec.threads; t++) {
+        std::mt19937_64 threadRng(spec.seed ^ (0x9E3779B97F4A7C15ULL * static_cast<std::uint64_t>(t + 1)));
+        auto uniform = [&threadRng]() {
+            return static_cast<double>(threadRng() >> 11) * (1.0 / 9007199254740992.0);
+        };
+        std::vector<WorkloadOp> &ops = streams[t];
+        ops.resize(spec.opsPerThread);
+        for (WorkloadOp &op : ops) {
+            int roll = static_cast<int>(threadRng() % 100);
+            int kind = 0;
+            while (roll >= spec.mix[kind]) {
+                roll -= spec.mix[kind];
+                kind++;
+            }
+            op.kind = static_cast<WorkloadOp::Kind>(kind);
+            op.account = byRank[zipf.rank(uniform())];
+            op.counterparty = byRank[zipf.rank(uniform())];
+            if (op.counterparty == op.account) {
+                op.counterparty = (op.account + 1) % spec.accounts;
+            }
+            op.cents = 1 + static_cast<std::int64_t>(threadRng() % 10000);
+        }
+    }
+    return streams;
+}
+
+// Latency summary of one kind of operation, from every timed sample.
+struct LatencyReport {
+    std::uint64_t count = 0;
+    std::uint64_t failed = 0;
+    double meanNs = 0.0;
+    std::uint64_t p50Ns = 0;
+    std::uint64_t p90Ns = 0;
+    std::uint64_t p99Ns = 0;
+    std::uint64_t p999Ns = 0;
+    std::uint64_t maxNs = 0;
+
+    static LatencyReport of(std::vector<std::uint32_t> &samples, std::uint64_t failed) {
+        LatencyReport report;
+        report.count = samples.size();
+        report.failed = failed;
+        if (samples.empty()) {
+            return report;
+        }
+        std::sort(samples.begin(), samples.end());
+        double total = 0.0;
+        for (std::uint32_t sample : samples) {
+            total += sample;
+        }
+        auto at = [&samples](double q) {
+            return static_cast<std::uint64_t>(samples[std::min(samples.size() - 1, static_cast<std::size_t>(q * static_cast<double>(samples.size())))]);
+        };
+        report.meanNs = total / static_cast<double>(samples.size());
+        report.p50Ns = at(0.50);
+        report.p90Ns = at(0.90);
+        report.p99Ns = at(0.99);
+        report.p999Ns = at(0.999);
+        report.maxNs = samples.back();
+        return report;
+    }
+
+    void writeJson(std::ostream &out) const {
+        out << "{\"count\":" << count << ",\"failed\":" << failed << ",\"meanNs\":" << static_cast<std::uint64_t>(meanNs)
+            << ",\"p50Ns\":" << p50Ns << ",\"p90Ns\":" << p90Ns << ",\"p99Ns\":" << p99Ns << ",\"p999Ns\":" << p999Ns
+            << ",\"maxNs\":" << maxNs << "}";
+    }
 };
 
+// Replays the operations generated from spec against a fresh
+// BankingSystem with one thread per stream, timing every operation, and
+// reports throughput and latency percentiles per kind of operation, both
+// as text and as JSON written to jsonPath (label is copied into it, e.g.
+// a commit id). Every account starts with enough money that nothing
+// fails, so the final balances do not depend on how the threads
+// interleaved; stateDigest, a SHA-256 of them, must match between runs of
+// the same spec on any commit.
+void runWorkloadBenchmark(const WorkloadSpec &spec, const std::string &jsonPath, const std::string &label) {
+    static const char *const kindNames[4] = {"read", "deposit", "withdraw", "transfer"};
+    std::cout << "Workload benchmark: " << spec.accounts << " accounts, " << spec.threads << " thread(s) x "
+              << spec.opsPerThread << " ops, theta " << spec.theta << ", mix " << spec.mix[0] << "/" << spec.mix[1] << "/"
+              << spec.mix[2] << "/" << spec.mix[3] << " (read/deposit/withdraw/transfer), seed " << spec.seed << std::endl;
+    std::vector<std::vector<WorkloadOp>> streams = generateWorkload(spec);
+
+    BankingSystem bank;
+    std::vector<int> accountNumbers(spec.accounts);
+    for (int i = 0; i < spec.accounts; i++) {
+        accountNumbers[i] = bank.openAccount("workload" + std::to_string(i));
+        bank.deposit(accountNumbers[i], Money::fromCents(100000000000LL));
+    }
+
+    // Per thread and kind: latency samples in ns, and failure counts.
+    std::vector<std::array<std::vector<std::uint32_t>, 4>> latencies(spec.threads);
+    std::vector<std::array<std::uint64_t, 4>> failures(spec.threads, std::array<std::uint64_t, 4>{});
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < spec.threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (std::vector<std::uint32_t> &samples : latencies[t]) {
+                samples.reserve(streams[t].size() / 2);
+            }
+            for (const WorkloadOp &op : streams[t]) {
+                int account = accountNumbers[op.account];
+                Money amount = Money::fromCents(op.cents);
+                auto begin = std::chrono::steady_clock::now();
+                TxnStatus status = TxnStatus::Ok;
+                switch (op.kind) {
+                    case WorkloadOp::Kind::Read:
+                        if (Account* found = bank.findAccount(account)) {
+                            static_cast<void>(found->getBalance());
+                        } else {
+                            status = TxnStatus::AccountNotFound;
+                        }
+                        break;
+                    case WorkloadOp::Kind::Deposit:
+                        status = bank.deposit(account, amount);
+                        break;
+                    case WorkloadOp::Kind::Withdraw:
+                        status = bank.withdraw(account, amount);
+                        break;
+                    case WorkloadOp::Kind::Transfer:
+                        status = bank.transfer(account, accountNumbers[op.counterparty], amount);
+                        break;
+                }
+                auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+                std::size_t kind = static_cast<std::size_t>(op.kind);
+                latencies[t][kind].push_back(static_cast<std::uint32_t>(std::min<long long>(nanos, UINT32_MAX)));
+                failures[t][kind] += status != TxnStatus::Ok;
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double totalOps = static_cast<double>(spec.threads) * spec.opsPerThread;
+
+    Sha256 state;
+    for (int accountNumber : accountNumbers) {
+        std::int64_t cents = bank.findAccount(accountNumber)->getBalance().minorUnits();
+        state.update(&accountNumber, sizeof(accountNumber));
+        state.update(&cents, sizeof(cents));
+    }
+    std::string stateDigest = Sha256::toHex(state.finish());
+
+    LatencyReport reports[5];
+    std::vector<std::uint32_t> all;
+    std::uint64_t allFailed = 0;
+    for (std::size_t kind = 0; kind < 4; kind++) {
+        std::vector<std::uint32_t> merged;
+        std::uint64_t failed = 0;
+        for (int t = 0; t < spec.threads; t++) {
+            merged.insert(merged.end(), latencies[t][kind].begin(), latencies[t][kind].end());
+            std::vector<std::uint32_t>().swap(latencies[t][kind]);
+            failed += failures[t][kind];
+        }
+        all.insert(all.end(), merged.begin(), merged.end());
+        allFailed += failed;
+        reports[kind] = LatencyReport::of(merged, failed);
+    }
+    reports[4] = LatencyReport::of(all, allFailed);
+
+    std::cout << static_cast<long long>(totalOps / seconds) << " ops/s over " << seconds << " s; state digest "
+              << stateDigest.substr(0, 16) << std::endl;
+    std::cout << "operation   count      failed  mean(us)  p50(us)   p90(us)   p99(us)   p99.9(us)  max(us)" << std::endl;
+    for (std::size_t kind = 0; kind < 5; kind++) {
+        const LatencyReport &r = reports[kind];
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-9s %9llu %9llu %9.2f %8.2f %9.2f %9.2f %10.2f %9.2f", kind < 4 ? kindNames[kind] : "all",
+                      static_cast<unsigned long long>(r.count), static_cast<unsigned long long>(r.failed), r.meanNs / 1000.0,
+                      r.p50Ns / 1000.0, r.p90Ns / 1000.0, r.p99Ns / 1000.0, r.p999Ns / 1000.0, r.maxNs / 1000.0);
+        std::cout << line << std::endl;
+    }
+
+    std::ofstream out(jsonPath, std::ios::binary);
+    out << "{\"label\":\"";
+    for (char c : label) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            out << c;
+        }
+    }
+    out << "\",\"workload\":{\"accounts\":" << spec.accounts << ",\"threads\":" << spec.threads << ",\"opsPerThread\":"
+        << spec.opsPerThread << ",\"theta\":" << spec.theta << ",\"seed\":" << spec.seed << ",\"mix\":{";
+    for (std::size_t kind = 0; kind < 4; kind++) {
+        out << (kind ? "," : "") << "\"" << kindNames[kind] << "\":" << spec.mix[kind];
+    }
+    out << "}},\"seconds\":" << seconds << ",\"opsPerSecond\":" << static_cast<long long>(totalOps / seconds)
+        << ",\"stateDigest\":\"" << stateDigest << "\",\"operations\":{";
+    for (std::size_t kind = 0; kind < 5; kind++) {
+        out << (kind ? "," : "") << "\"" << (kind < 4 ? kindNames[kind] : "all") << "\":";
+        reports[kind].writeJson(out);
+    }
+    out << "}}" << std::endl;
+    if (out) {
+        std::cout << "Results written to " << jsonPath << std::endl;
+    } else {
+        std::cout << "Could not write " << jsonPath << std::endl;
+    }
+}
+
+#ifdef __linux__
+// SHA-256 over the balance and history hash chain of accounts first to
+// first + count - 1, to compare a replica with its leader.
+Sha256::Digest replicaDigest(BankingSystem &bank, int first, int count) {
+    Sha256 state;
+    for (int accountNumber = first; accountNumber < first + count; accountNumber++) {
+        Account* account = bank.findAccount(accountNumber);
+        TransactionHistory::Checkpoint checkpoint;
+        std::int64_t cents = account ? account->getBalance().minorUnits() : -1;
+        bank.historyCheckpoint(accountNumber, checkpoint);
+        state.update(&accountNumber, sizeof(accountNumber));
+        state.update(&cents, sizeof(cents));
+        state.update(checkpoint.digest.data(), checkpoint.digest.size());
+    }
+    return state.finish();
+}
+
+// Two-process replication test. A forked follower, with a log of its own,
+// follows a leader that opens numAccounts accounts and then runs random
+// transfers at txPerSecond for the given time, one applyBatch() per
+// millisecond, durable through the leader's log. Reports the lag from a
+// transfer's timestamp on the leader to it being applied on the follower,
+// and how much smaller the stream is than the log. Then checks that both
+// hold the same state, stops the leader and promotes the follower, which
+// must take a write and continue the LSN sequence.
+void runReplicationBenchmark(int txPerSecond, double seconds, int numAccounts) {
+    const std::string socketPath = "bench-replication.sock";
+    const std::string leaderLog = "bench-leader.wal";
+    const std::string followerLog = "bench-follower.wal";
+    std::remove(leaderLog.c_str());
+    std::remove(followerLog.c_str());
+    std::signal(SIGPIPE, SIG_IGN);
+    int toFollower[2], toLeader[2];
+    if (::pipe(toFollower) != 0 || ::pipe(toLeader) != 0) {
+        return;
+    }
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        ::close(toFollower[1]);
+        ::close(toLeader[0]);
+        BankingSystem bank;
+        ReplicationFollower follower(bank);
+        if (bank.openLog(followerLog) < 0) {
+            std::_Exit(1);
+        }
+        follower.start(socketPath);
+        while (!follower.connected()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        char ready = 1;
+        writeFully(toLeader[1], &ready, 1);
+
+        // Leader's final LSN, its accounts and their digest.
+        char message[8 + 4 + 4 + 32];
+        if (!readFully(toFollower[0], message, sizeof(message))) {
+            std::_Exit(1);
+        }
+        const char *in = message;
+        std::uint64_t target = getPod<std::uint64_t>(in);
+        int first = getPod<std::int32_t>(in);
+        int count = getPod<std::int32_t>(in);
+        Sha256::Digest leaderDigest;
+        std::memcpy(leaderDigest.data(), in, leaderDigest.size());
+        while (bank.lastLsn() < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ReplicationFollower::Stats stats = follower.stats();
+        TxnStatus refused = bank.transfer(first, first + 1, Money::fromCents(1));
+        bool same = replicaDigest(bank, first, count) == leaderDigest;
+        std::uint64_t logBytes = MappedFile(followerLog).contents().size();
+        std::cout << "follower: " << stats.records << " records in " << stats.frames << " frames, " << stats.bytes
+                  << " bytes on the wire (" << logBytes / std::max<double>(stats.bytes, 1) << "x smaller than the log)" << std::endl;
+        std::cout << "lag: p50 " << stats.lagP50 << " us, p99 " << stats.lagP99 << " us, max " << stats.lagMax
+                  << " us (last " << std::min<std::uint64_t>(stats.frames, 65536) << " frames)" << std::endl;
+        std::cout << "state digest " << (same ? "matches" : "DIFFERS FROM") << " the leader at LSN " << target
+                  << "; write while following: " << describeStatus(refused) << std::endl;
+        writeFully(toLeader[1], &ready, 1);
+
+        // The leader closes its end of the pipe when it is gone.
+        while (::read(toFollower[0], &ready, 1) > 0) {
+        }
+        auto start = std::chrono::steady_clock::now();
+        follower.promote();
+        TxnStatus status = bank.transfer(first, first + 1, Money::fromCents(1));
+        int opened = bank.openAccount("after failover");
+        double promoteMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "promoted in " << promoteMicros << " us: transfer " << describeStatus(status) << ", opened account "
+                  << opened << ", now at LSN " << bank.lastLsn() << std::endl;
+        std::_Exit(0);
+    }
+    ::close(toFollower[0]);
+    ::close(toLeader[1]);
+
+    {
+        BankingSystem bank;
+        ReplicationLeader leader(bank);
+        if (bank.openLog(leaderLog) < 0 || !leader.listen(socketPath)) {
+            std::cout << "Cannot start the leader on " << socketPath << std::endl;
+            ::close(toFollower[1]);
+            waitpid(child, nullptr, 0);
+            return;
+        }
+        char ready;
+        readFully(toLeader[0], &ready, 1);
+        std::vector<Txn> batch;
+        int first = bank.openAccount("bench0");
+        for (int i = 1; i < numAccounts; i++) {
+            bank.openAccount("bench" + std::to_string(i));
+        }
+        for (int i = 0; i < numAccounts; i++) {
+            batch.push_back(Txn{Txn::Kind::Deposit, first + i, 0, Money::fromCents(100000000)});
+        }
+        bank.applyBatch(batch);
+
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> pick(first, first + numAccounts - 1);
+        long long issued = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto tick = start;
+        while (true) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= seconds) {
+                break;
+            }
+            long long due = static_cast<long long>(elapsed * txPerSecond) - issued;
+            if (due > 0) {
+                batch.clear();
+                for (long long i = 0; i < due; i++) {
+                    int from = pick(rng);
+                    int to = pick(rng);
+                    batch.push_back(Txn{Txn::Kind::Transfer, from, to == from ? first + (to - first + 1) % numAccounts : to,
+                                        Money::fromCents(1 + rng() % 1000)});
+                }
+                bank.applyBatch(batch);
+                issued += due;
+            }
+            tick += std::chrono::milliseconds(1);
+            std::this_thread::sleep_until(tick);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "leader: " << issued << " transfers in " << elapsed << " s (" << static_cast<long long>(issued / elapsed)
+                  << " tx/s) to " << leader.followers() << " follower(s)" << std::endl;
+
+        std::vector<char> message;
+        putPod(message, bank.lastLsn());
+        putPod(message, static_cast<std::int32_t>(first));
+        putPod(message, static_cast<std::int32_t>(numAccounts));
+        Sha256::Digest digest = replicaDigest(bank, first, numAccounts);
+        message.insert(message.end(), digest.begin(), digest.end());
+        writeFully(toFollower[1], message.data(), message.size());
+        readFully(toLeader[0], &ready, 1);
+    }
+    // The leader is gone; let the follower take over.
+    ::close(toFollower[1]);
+    ::close(toLeader[0]);
+    waitpid(child, nullptr, 0);
+    std::remove(leaderLog.c_str());
+    std::remove(followerLog.c_str());
+}
+#endif
+
+// Looks up random existing account numbers in a std::unordered_map the way
+// getAccount() used to (find, then operator[]) and in a DenseIndex, at each
+// requested size. The payload is a balance-sized int64 so that the 100M
+// case fits in memory; the map is freed before the index is built.
+void runIndexBenchmark(const std::vector<std::size_t> &sizes, std::size_t lookups) {
+    for (std::size_t n : sizes) {
+        std::mt19937 rng(11);
+        std::vector<int> probes(lookups);
+        for (int &probe : probes) {
+            probe = 1000 + static_cast<int>(rng() % n);
+        }
+        std::cout << "Index benchmark: " << n << " accounts, " << lookups << " random lookups" << std::endl;
+
+        std::int64_t checksum = 0;
+        {
+            std::unordered_map<int, std::int64_t> map;
+            map.reserve(n);
+            for (std::size_t i = 0; i < n; i++) {
+                map[1000 + static_cast<int>(i)] = static_cast<std::int64_t>(i);
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (int probe : probes) {
+                if (map.find(probe) != map.end()) {
+                    checksum += map[probe];
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  unordered_map: " << seconds * 1e9 / lookups << " ns/lookup" << std::endl;
+        }
+        {
+            DenseIndex<std::int64_t> index;
+            for (std::size_t i = 0; i < n; i++) {
+                index.emplace(1000 + static_cast<int>(i), static_cast<std::int64_t>(i));
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (int probe : probes) {
+                if (std::int64_t *value = index.find(probe)) {
+                    checksum -= *value;
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  DenseIndex:    " << seconds * 1e9 / lookups << " ns/lookup" << std::endl;
+        }
+        if (checksum != 0) {
+            std::cout << "  lookup results differ!" << std::endl;
+        }
+    }
+}
+
+// Compares the two bulk paths that matter for balances -- summing every
+// balance and applying a batch of signed deltas -- on plain double balances
+// and on Money balances, and shows how far the double total drifts from the
+// exact one.
+void runMoneyBenchmark(std::size_t numAccounts, int rounds) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::int64_t> balanceCents(0, 10000000);
+    std::uniform_int_distribution<std::int64_t> deltaCents(-10000, 10000);
+
+    std::vector<double> doubleBalances(numAccounts), doubleDeltas(numAccounts);
+    std::vector<Money> moneyBalances(numAccounts), moneyDeltas(numAccounts);
+    for (std::size_t i = 0; i < numAccounts; i++) {
+        std::int64_t balance = balanceCents(rng);
+        std::int64_t delta = deltaCents(rng);
+        doubleBalances[i] = balance / 100.0;
+        doubleDeltas[i] = delta / 100.0;
+        moneyBalances[i] = Money::fromCents(balance);
+        moneyDeltas[i] = Money::fromCents(delta);
+    }
+
+    auto timeIt = [rounds, numAccounts](const char *label, const std::function<void()> &body) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << ": " << seconds * 1e9 / (static_cast<double>(rounds) * numAccounts) << " ns/account" << std::endl;
+    };
+
+    double doubleTotal = 0;
+    Money moneyTotal;
+    bool overflow = false;
+
+    std::cout << "Money benchmark: " << numAccounts << " accounts, " << rounds << " rounds" << std::endl;
+    timeIt("aggregate double", [&]() {
+        double sum = 0;
+        for (double balance : doubleBalances) {
+            sum += balance;
+        }
+        doubleTotal = sum;
+    });
+    timeIt("aggregate Money ", [&]() {
+        Money sum;
+        bool failed = false;
+        for (Money balance : moneyBalances) {
+            failed |= !sum.checkedAdd(balance, sum);
+        }
+        moneyTotal = sum;
+        overflow |= failed;
+    });
+    timeIt("batch apply double", [&]() {
+        for (std::size_t i = 0; i < numAccounts; i++) {
+            doubleBalances[i] += doubleDeltas[i];
+        }
+    });
+    timeIt("batch apply Money ", [&]() {
+        bool failed = false;
+        for (std::size_t i = 0; i < numAccounts; i++) {
+            failed |= !moneyBalances[i].checkedAdd(moneyDeltas[i], moneyBalances[i]);
+        }
+        overflow |= failed;
+    });
+
+    std::cout << "aggregate: double " << std::fixed << doubleTotal << ", Money " << moneyTotal
+              << ", drift " << doubleTotal - moneyTotal.minorUnits() / 100.0 << std::defaultfloat
+              << (overflow ? " (overflow detected)" : "") << std::endl;
+}
+
 void showMenu() {
     std::cout << "Banking System Menu:" << std::endl;
     std::cout << "1. Create Account" << std::endl;
@@ -91,15 +6093,258 @@ void showMenu() {
     std::cout << "5. View Balance" << std::endl;
     std::cout << "6. View Transaction History" << std::endl;
     std::cout << "7. Exit" << std::endl;
+    std::cout << "8. View Metrics" << std::endl;
+    std::cout << "9. Audit Transaction Histories" << std::endl;
     std::cout << "Enter your choice: ";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && (std::string(argv[1]) == "--bench-throughput" || std::string(argv[1]) == "--bench-wal")) {
+        int maxThreads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+        int numAccounts = argc > 3 ? std::atoi(argv[3]) : 10000;
+        int opsPerThread = argc > 4 ? std::atoi(argv[4]) : 1000000;
+        std::string logPath;
+        if (std::string(argv[1]) == "--bench-wal") {
+            logPath = argc > 5 ? argv[5] : "bench.wal";
+        }
+        runThroughputBenchmark(maxThreads > 0 ? maxThreads : 1, numAccounts, opsPerThread, logPath);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-money") {
+        std::size_t numAccounts = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000;
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 20;
+        runMoneyBenchmark(numAccounts, rounds > 0 ? rounds : 1);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-batch") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int numRows = argc > 3 ? std::atoi(argv[3]) : 200000;
+        runBatchBenchmark(numAccounts > 0 ? numAccounts : 1, numRows, argc > 4 ? argv[4] : "bench.wal");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-index") {
+        std::vector<std::size_t> sizes;
+        for (int i = 2; i < argc; i++) {
+            sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+        }
+        if (sizes.empty()) {
+            sizes = {1000, 1000000, 100000000};
+        }
+        runIndexBenchmark(sizes, 10000000);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-import") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 10000000;
+        runImportBenchmark(numAccounts > 0 ? numAccounts : 1, argc > 3 ? argv[3] : "bench-import.csv");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-read-view") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 10000;
+        int numWriters = argc > 3 ? std::atoi(argv[3]) : 4;
+        double seconds = argc > 4 ? std::atof(argv[4]) : 3.0;
+        runReadViewBenchmark(numAccounts > 1 ? numAccounts : 2, numWriters > 0 ? numWriters : 1, seconds > 0 ? seconds : 1.0);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-sweep") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 5000000;
+        int maxThreads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+        runSweepBenchmark(numAccounts > 0 ? numAccounts : 1, maxThreads > 0 ? maxThreads : 1,
+                          argc > 4 ? argv[4] : "bench-sweep.csv");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-audit") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        int transfersPerAccount = argc > 3 ? std::atoi(argv[3]) : 8;
+        runAuditBenchmark(numAccounts > 0 ? numAccounts : 1, transfersPerAccount > 0 ? transfersPerAccount : 0,
+                          argc > 4 ? argv[4] : "bench-audit.csv");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-history-index") {
+        std::size_t numEvents = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000000;
+        int numAccounts = argc > 3 ? std::atoi(argv[3]) : 1000000;
+        runHistoryIndexBenchmark(numEvents > 0 ? numEvents : 1, numAccounts > 0 ? numAccounts : 1);
+        return 0;
+    }
+
+    // --bench-workload [accounts] [threads] [opsPerThread] [theta]
+    //                 [read/deposit/withdraw/transfer %] [seed] [json file] [label]
+    if (argc > 1 && std::string(argv[1]) == "--bench-workload") {
+        WorkloadSpec spec;
+        spec.accounts = argc > 2 ? std::atoi(argv[2]) : spec.accounts;
+        spec.threads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+        spec.opsPerThread = argc > 4 ? std::atoi(argv[4]) : spec.opsPerThread;
+        spec.theta = argc > 5 ? std::atof(argv[5]) : spec.theta;
+        if (argc > 6 && std::sscanf(argv[6], "%d/%d/%d/%d", &spec.mix[0], &spec.mix[1], &spec.mix[2], &spec.mix[3]) != 4) {
+            spec.mix[0] = -1;
+        }
+        spec.seed = argc > 7 ? std::strtoull(argv[7], nullptr, 10) : spec.seed;
+        if (!spec.isValid()) {
+            std::cout << "Invalid workload: needs 2+ accounts, 1+ threads and ops, 0 <= theta < 1, and a mix adding up to 100." << std::endl;
+            return 1;
+        }
+        runWorkloadBenchmark(spec, argc > 8 ? argv[8] : "bench-workload.json", argc > 9 ? argv[9] : "");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-velocity") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int numOps = argc > 3 ? std::atoi(argv[3]) : 2000000;
+        runVelocityBenchmark(numAccounts > 0 ? numAccounts : 1, numOps > 0 ? numOps : 1);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-arena") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 10000000;
+        runArenaBenchmark(numAccounts > 0 ? numAccounts : 1, argc > 3 ? argv[3] : "bench-arena.csv");
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-snapshot") {
+        int numAccounts = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        int transfersPerAccount = argc > 3 ? std::atoi(argv[3]) : 4;
+        runSnapshotBenchmark(numAccounts > 0 ? numAccounts : 1, transfersPerAccount > 0 ? transfersPerAccount : 0,
+                             argc > 4 ? argv[4] : "bench-snapshot.wal");
+        return 0;
+    }
+
+#ifdef __linux__
+    if (argc > 1 && std::string(argv[1]) == "--bench-replication") {
+        int txPerSecond = argc > 2 ? std::atoi(argv[2]) : 100000;
+        double seconds = argc > 3 ? std::atof(argv[3]) : 5;
+        int numAccounts = argc > 4 ? std::atoi(argv[4]) : 10000;
+        runReplicationBenchmark(txPerSecond > 0 ? txPerSecond : 1, seconds > 0 ? seconds : 1, numAccounts > 1 ? numAccounts : 2);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--load-test") {
+        std::string socketPath = argc > 2 ? argv[2] : "bank.sock";
+        int numConnections = argc > 3 ? std::atoi(argv[3]) : 8;
+        int requestsPerConnection = argc > 4 ? std::atoi(argv[4]) : 200000;
+        int depth = argc > 5 ? std::atoi(argv[5]) : 64;
+        int numAccounts = argc > 6 ? std::atoi(argv[6]) : 10000;
+        std::signal(SIGPIPE, SIG_IGN);
+        runLoadTest(socketPath, numConnections > 0 ? numConnections : 1, requestsPerConnection > 0 ? requestsPerConnection : 1,
+                    depth > 0 ? depth : 1, numAccounts > 1 ? numAccounts : 2);
+        return 0;
+    }
+#endif
+
+    // Usage: BankingSystemCode [log file] [--import accounts.csv] [--serve socket]
+    //                          [--replicate socket | --follow socket]
+    // With --serve the menu is replaced by the request server (Linux only),
+    // which runs until interrupted. --replicate ships the log to followers
+    // connecting on the given socket; --follow makes this a read-only
+    // replica of the leader there (give it a log file of its own), and a
+    // SIGUSR2 promotes it to accept writes. Both are Linux only.
+    std::string logPath = "bank.wal";
+    std::string importPath;
+    std::string socketPath;
+    std::string replicatePath;
+    std::string followPath;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--import" && i + 1 < argc) {
+            importPath = argv[++i];
+        } else if (std::string(argv[i]) == "--serve" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::string(argv[i]) == "--replicate" && i + 1 < argc) {
+            replicatePath = argv[++i];
+        } else if (std::string(argv[i]) == "--follow" && i + 1 < argc) {
+            followPath = argv[++i];
+        } else {
+            logPath = argv[i];
+        }
+    }
+
     BankingSystem bank;
+    std::string snapshotPath = logPath + ".snapshot";
+    if (bank.loadSnapshot(snapshotPath)) {
+        std::cout << "Loaded snapshot " << snapshotPath << std::endl;
+    }
+    long long replayed = bank.openLog(logPath);
+    if (replayed < 0) {
+        return 1;
+    }
+    if (replayed > 0) {
+        std::cout << "Restored " << replayed << " transactions from " << logPath << std::endl;
+    }
+    if (!importPath.empty()) {
+        ImportResult result = bank.importFile(importPath);
+        if (!result.ok) {
+            std::cout << "Cannot open " << importPath << std::endl;
+            return 1;
+        }
+        std::cout << "Imported " << result.accounts << " accounts and " << result.transactions
+                  << " transactions from " << importPath << " (" << result.rejected << " rows rejected)" << std::endl;
+        if (!result.durable) {
+            std::cout << describeStatus(TxnStatus::NotDurable) << std::endl;
+        }
+    }
+
+#ifdef __linux__
+    std::unique_ptr<ReplicationLeader> leader;
+    std::unique_ptr<ReplicationFollower> follower;
+    std::unique_ptr<PromotionWatcher> promotionWatcher;
+    if (!replicatePath.empty() || !followPath.empty()) {
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+    if (!replicatePath.empty()) {
+        leader = std::make_unique<ReplicationLeader>(bank);
+        if (!leader->listen(replicatePath)) {
+            std::cout << "Cannot replicate on " << replicatePath << std::endl;
+            return 1;
+        }
+        std::cout << "Shipping the log to followers on " << replicatePath << std::endl;
+    }
+    if (!followPath.empty()) {
+        follower = std::make_unique<ReplicationFollower>(bank);
+        follower->start(followPath);
+        std::signal(SIGUSR2, requestPromotion);
+        promotionWatcher = std::make_unique<PromotionWatcher>(*follower);
+        std::cout << "Following the leader on " << followPath << " (read-only; SIGUSR2 to promote)" << std::endl;
+    }
+#else
+    if (!replicatePath.empty() || !followPath.empty()) {
+        std::cout << "Replication is only available on Linux." << std::endl;
+        return 1;
+    }
+#endif
+
+    if (!socketPath.empty()) {
+#ifdef __linux__
+        BankServer server(bank);
+        if (!server.listen(socketPath)) {
+            std::cout << "Cannot listen on " << socketPath << std::endl;
+            return 1;
+        }
+        std::signal(SIGINT, requestStop);
+        std::signal(SIGTERM, requestStop);
+        std::signal(SIGPIPE, SIG_IGN);
+        std::signal(SIGUSR1, requestMetrics);
+        std::cout << "Serving on " << socketPath << " (Ctrl+C to stop)" << std::endl;
+        server.run(stopRequested);
+        if (bank.startSnapshot(snapshotPath) && bank.waitSnapshot()) {
+            std::cout << "Snapshot saved to " << snapshotPath << std::endl;
+        }
+        return 0;
+#else
+        std::cout << "Server mode is only available on Linux." << std::endl;
+        return 1;
+#endif
+    }
+
     int choice;
     std::string owner;
     int accountNumber;
-    double amount;
+    std::string amountText;
+    Money amount;
     int toAccountNumber;
 
     while (true) {
@@ -117,18 +6362,36 @@ int main() {
                 std::cout << "Enter account number: ";
                 std::cin >> accountNumber;
                 std::cout << "Enter amount to deposit: ";
-                std::cin >> amount;
-                if (Account* account = bank.getAccount(accountNumber)) {
-                    account->deposit(amount);
+                std::cin >> amountText;
+                if (!Money::parse(amountText, amount)) {
+                    std::cout << "Invalid amount." << std::endl;
+                    break;
+                }
+                if (bank.getAccount(accountNumber)) {
+                    TxnStatus status = bank.deposit(accountNumber, amount);
+                    if (status == TxnStatus::Overflow || status == TxnStatus::ReadOnly || status == TxnStatus::NotDurable) {
+                        std::cout << describeStatus(status) << std::endl;
+                    } else if (status != TxnStatus::Ok) {
+                        std::cout << "Invalid deposit amount." << std::endl;
+                    }
                 }
                 break;
             case 3:
                 std::cout << "Enter account number: ";
                 std::cin >> accountNumber;
                 std::cout << "Enter amount to withdraw: ";
-                std::cin >> amount;
-                if (Account* account = bank.getAccount(accountNumber)) {
-                    account->withdraw(amount);
+                std::cin >> amountText;
+                if (!Money::parse(amountText, amount)) {
+                    std::cout << "Invalid amount." << std::endl;
+                    break;
+                }
+                if (bank.getAccount(accountNumber)) {
+                    TxnStatus status = bank.withdraw(accountNumber, amount);
+                    if (status == TxnStatus::LimitExceeded || status == TxnStatus::ReadOnly || status == TxnStatus::NotDurable) {
+                        std::cout << describeStatus(status) << std::endl;
+                    } else if (status != TxnStatus::Ok) {
+                        std::cout << "Invalid withdraw amount or insufficient funds." << std::endl;
+                    }
                 }
                 break;
             case 4:
@@ -137,10 +6400,18 @@ int main() {
                 std::cout << "Enter recipient account number: ";
                 std::cin >> toAccountNumber;
                 std::cout << "Enter amount to transfer: ";
-                std::cin >> amount;
-                if (Account* fromAccount = bank.getAccount(accountNumber)) {
-                    if (Account* toAccount = bank.getAccount(toAccountNumber)) {
-                        fromAccount->transfer(*toAccount, amount);
+                std::cin >> amountText;
+                if (!Money::parse(amountText, amount)) {
+                    std::cout << "Invalid amount." << std::endl;
+                    break;
+                }
+                if (bank.getAccount(accountNumber) && bank.getAccount(toAccountNumber)) {
+                    TxnStatus status = bank.transfer(accountNumber, toAccountNumber, amount);
+                    if (status == TxnStatus::SameAccount || status == TxnStatus::Overflow || status == TxnStatus::LimitExceeded
+                        || status == TxnStatus::ReadOnly || status == TxnStatus::NotDurable) {
+                        std::cout << describeStatus(status) << std::endl;
+                    } else if (status != TxnStatus::Ok) {
+                        std::cout << "Invalid transfer amount or insufficient funds." << std::endl;
                     }
                 }
                 break;
@@ -159,7 +6430,25 @@ int main() {
                 }
                 break;
             case 7:
+                if (bank.startSnapshot(snapshotPath) && bank.waitSnapshot()) {
+                    std::cout << "Snapshot saved to " << snapshotPath << std::endl;
+                }
                 return 0;
+            case 8:
+#ifdef BANK_NO_METRICS
+                std::cout << "Metrics were compiled out." << std::endl;
+#else
+                Metrics::writeText(std::cout);
+#endif
+                break;
+            case 9: {
+                AuditResult result = bank.auditHistories();
+                std::cout << "Checked " << result.accounts << " accounts (" << result.events << " new events)." << std::endl;
+                for (int failed : result.failed) {
+                    std::cout << "History of account " << failed << " does not match its hash chain." << std::endl;
+                }
+                break;
+            }
             default:
                 std::cout << "Invalid choice. Please try again." << std::endl;
         }
@@ -170,4 +6459,4 @@ int main() {
     }
 
     return 0;
-}1
\ No newline at end of file
+}
\ No newline at end of file